@@ -6,10 +6,21 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Sectors move either by PIO, where the CPU copies each word
+   through the data register, or, when the channel sits behind a
+   PCI bus-master IDE (BMIDE) controller such as QEMU's PIIX3/4,
+   by DMA, where the controller copies the data itself while the
+   requesting thread sleeps.  DMA is used whenever the controller,
+   the disk and the buffer allow it, and PIO otherwise. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -28,10 +39,17 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's
+   block of the controller's BAR4 I/O space. */
+#define reg_bm_cmd(CHANNEL) ((CHANNEL)->bm_base + 0)    /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2) /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)   /* PRD table address. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +65,47 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Bus master command register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master status register bits.  INTR and ERROR are cleared
+   by writing 1 to them. */
+#define BM_STA_ACTIVE 0x01      /* Transfer in progress. */
+#define BM_STA_ERROR 0x02       /* Transfer failed. */
+#define BM_STA_INTR 0x04        /* Disk raised its interrupt. */
+
+/* A physical region descriptor: one physically contiguous piece
+   of a DMA buffer.  A region may not cross a 64 kB boundary. */
+struct prd {
+	uint32_t addr;              /* Physical address. */
+	uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+	uint16_t flags;             /* PRD_EOT on the table's last entry. */
+};
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
+/* Most sectors moved by one ATA command.  The sector count
+   register allows 256; 128 sectors, 64 kB, keeps the PRD table
+   small and the channel from being held too long. */
+#define MAX_XFER_SECTORS 128
+
+/* Most requests merged into one command by the request queue. */
+#define MAX_MERGE 32
+
+/* A piece of the memory side of a transfer: CNT sectors at
+   BUFFER.  A transfer's pieces go to consecutive disk sectors. */
+struct segment {
+	uint8_t *buffer;
+	size_t cnt;
+};
+
+/* If false, all transfers use PIO.  Set by the -pio kernel
+   command-line option. */
+bool disk_use_dma = true;
 
 /* An ATA device. */
 struct disk {
@@ -59,6 +118,19 @@ struct disk {
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
+	long long cache_hit_cnt;    /* Cache lookups satisfied from memory. */
+	long long cache_miss_cnt;   /* Cache lookups that went to the disk. */
+
+	bool dma_ok;                /* Disk supports DMA and it has not failed. */
+	long long dma_bytes;        /* Bytes transferred by DMA. */
+	long long pio_bytes;        /* Bytes transferred by PIO. */
+	uint64_t busy_cycles;       /* CPU cycles spent on transfers, not
+	                               counting time asleep waiting for
+	                               the disk. */
+
+	disk_sector_t head;         /* Sector after the last one transferred. */
+	long long queued_cnt;       /* Requests submitted to the queue. */
+	long long merged_cnt;       /* Requests merged into another's command. */
 };
 
 /* An ATA channel (aka controller).
@@ -72,6 +144,15 @@ struct channel {
 	bool expecting_interrupt;   /* True if an interrupt is expected, false if
 								   any interrupt would be spurious. */
 	struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+	uint64_t wait_cycles;       /* Cycles asleep on COMPLETION_WAIT
+	                               during the current transfer. */
+
+	uint16_t bm_base;           /* Bus master I/O port base, 0 if none. */
+	struct prd *prdt;           /* PRD table, one page, if BM_BASE. */
+
+	struct lock queue_lock;     /* Protects QUEUE. */
+	struct condition queue_nonempty;    /* Signaled on submission. */
+	struct list queue;          /* Pending struct disk_requests. */
 
 	struct disk devices[2];     /* The devices on this channel. */
 };
@@ -84,7 +165,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -94,11 +175,25 @@ static bool wait_while_busy (const struct disk *);
 static void select_device (const struct disk *);
 static void select_device_wait (const struct disk *);
 
+static uint16_t find_bmide (void);
+static void transfer (struct disk *, disk_sector_t,
+		const struct segment *, size_t seg_cnt, bool write);
+static bool dma_transfer (struct disk *, disk_sector_t,
+		const struct segment *, size_t seg_cnt, size_t cnt, bool write);
+static void pio_transfer (struct disk *, disk_sector_t,
+		const struct segment *, size_t seg_cnt, bool write);
+static void wait_for_completion (struct channel *);
+static uint64_t begin_transfer (struct channel *);
+static void end_transfer (struct disk *, uint64_t start);
+
+static thread_func queue_worker NO_RETURN;
+
 static void interrupt_handler (struct intr_frame *);
 
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
+	uint16_t bmide = find_bmide ();
 	size_t chan_no;
 
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -122,6 +217,21 @@ disk_init (void) {
 		lock_init (&c->lock);
 		c->expecting_interrupt = false;
 		sema_init (&c->completion_wait, 0);
+		c->wait_cycles = 0;
+
+		/* Each channel has 8 bus master ports, the primary's
+		   first. */
+		lock_init (&c->queue_lock);
+		cond_init (&c->queue_nonempty);
+		list_init (&c->queue);
+
+		c->bm_base = 0;
+		c->prdt = NULL;
+		if (bmide != 0) {
+			c->prdt = palloc_get_page (0);
+			if (c->prdt != NULL)
+				c->bm_base = bmide + chan_no * 8;
+		}
 
 		/* Initialize devices. */
 		for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -134,6 +244,12 @@ disk_init (void) {
 			d->capacity = 0;
 
 			d->read_cnt = d->write_cnt = 0;
+			d->cache_hit_cnt = d->cache_miss_cnt = 0;
+			d->dma_ok = false;
+			d->dma_bytes = d->pio_bytes = 0;
+			d->busy_cycles = 0;
+			d->head = 0;
+			d->queued_cnt = d->merged_cnt = 0;
 		}
 
 		/* Register interrupt handler. */
@@ -150,6 +266,13 @@ disk_init (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++)
 			if (c->devices[dev_no].is_ata)
 				identify_ata_device (&c->devices[dev_no]);
+
+		/* Start the request queue's worker. */
+		if (c->devices[0].is_ata || c->devices[1].is_ata) {
+			char name[16];
+			snprintf (name, sizeof name, "%s-io", c->name);
+			thread_create (name, PRI_DEFAULT, queue_worker, c);
+		}
 	}
 
 	/* DO NOT MODIFY BELOW LINES. */
@@ -166,13 +289,41 @@ disk_print_stats (void) {
 
 		for (dev_no = 0; dev_no < 2; dev_no++) {
 			struct disk *d = disk_get (chan_no, dev_no);
-			if (d != NULL && d->is_ata)
-				printf ("%s: %lld reads, %lld writes\n",
-						d->name, d->read_cnt, d->write_cnt);
+			long long lookups;
+
+			if (d == NULL || !d->is_ata)
+				continue;
+			printf ("%s: %lld reads, %lld writes\n",
+					d->name, d->read_cnt, d->write_cnt);
+			printf ("%s: %lld kB by DMA, %lld kB by PIO, "
+					"%"PRIu64" CPU cycles in transfers\n",
+					d->name, d->dma_bytes / 1024, d->pio_bytes / 1024,
+					d->busy_cycles);
+			if (d->queued_cnt > 0)
+				printf ("%s: %lld queued requests, %lld merged\n",
+						d->name, d->queued_cnt, d->merged_cnt);
+			lookups = d->cache_hit_cnt + d->cache_miss_cnt;
+			if (lookups > 0)
+				printf ("%s: %lld cache hits, %lld misses (%lld%% hit rate)\n",
+						d->name, d->cache_hit_cnt, d->cache_miss_cnt,
+						d->cache_hit_cnt * 100 / lookups);
 		}
 	}
 }
 
+/* Records one lookup of a sector of D in a sector cache, for
+   disk_print_stats().  HIT is true if the lookup was satisfied
+   without going to the disk. */
+void
+disk_count_cache_lookup (struct disk *d, bool hit) {
+	ASSERT (d != NULL);
+
+	if (hit)
+		d->cache_hit_cnt++;
+	else
+		d->cache_miss_cnt++;
+}
+
 /* Returns the disk numbered DEV_NO--either 0 or 1 for master or
    slave, respectively--within the channel numbered CHAN_NO.
 
@@ -209,21 +360,7 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
-	struct channel *c;
-
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
-
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
+	disk_read_multiple (d, sec_no, buffer, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -233,23 +370,278 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
    per-disk locking is unneeded. */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
-	struct channel *c;
+	disk_write_multiple (d, sec_no, buffer, 1);
+}
 
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Moves up to MAX_XFER_SECTORS sectors per command, so
+   a large read costs one lock acquisition and one interrupt
+   wait per 64 kB rather than per sector. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, void *buffer,
+		size_t cnt) {
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
 
-	c = d->channel;
+	while (cnt > 0) {
+		struct segment seg;
+
+		seg.buffer = buffer;
+		seg.cnt = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+		transfer (d, sec_no, &seg, 1, false);
+
+		buffer = seg.buffer + seg.cnt * DISK_SECTOR_SIZE;
+		sec_no += seg.cnt;
+		cnt -= seg.cnt;
+	}
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+		const void *buffer, size_t cnt) {
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+
+	while (cnt > 0) {
+		struct segment seg;
+
+		seg.buffer = (uint8_t *) buffer;
+		seg.cnt = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+		transfer (d, sec_no, &seg, 1, true);
+
+		buffer = seg.buffer + seg.cnt * DISK_SECTOR_SIZE;
+		sec_no += seg.cnt;
+		cnt -= seg.cnt;
+	}
+}
+
+/* Moves the sectors described by the SEG_CNT segments in SEGS
+   to or from disk D, starting at sector SEC_NO, using one ATA
+   command.  Uses DMA if possible, otherwise PIO. */
+static void
+transfer (struct disk *d, disk_sector_t sec_no,
+		const struct segment *segs, size_t seg_cnt, bool write) {
+	struct channel *c = d->channel;
+	size_t cnt = 0;
+	uint64_t start;
+	size_t i;
+
+	for (i = 0; i < seg_cnt; i++)
+		cnt += segs[i].cnt;
+	ASSERT (cnt > 0 && cnt <= MAX_XFER_SECTORS);
+
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
+	start = begin_transfer (c);
+	if (dma_transfer (d, sec_no, segs, seg_cnt, cnt, write))
+		d->dma_bytes += cnt * DISK_SECTOR_SIZE;
+	else {
+		pio_transfer (d, sec_no, segs, seg_cnt, write);
+		d->pio_bytes += cnt * DISK_SECTOR_SIZE;
+	}
+	end_transfer (d, start);
+	if (write)
+		d->write_cnt += cnt;
+	else
+		d->read_cnt += cnt;
+	d->head = sec_no + cnt;
 	lock_release (&c->lock);
 }
-
+
+/* Moves sectors to or from disk D by PIO, as transfer().  The
+   disk interrupts once per sector: before each sector is ready
+   to read, or after each sector has been written. */
+static void
+pio_transfer (struct disk *d, disk_sector_t sec_no,
+		const struct segment *segs, size_t seg_cnt, bool write) {
+	struct channel *c = d->channel;
+	disk_sector_t sector = sec_no;
+	size_t cnt = 0;
+	size_t i, j;
+
+	for (i = 0; i < seg_cnt; i++)
+		cnt += segs[i].cnt;
+
+	select_sector (d, sec_no, cnt);
+	issue_pio_command (c, write ? CMD_WRITE_SECTOR_RETRY
+			: CMD_READ_SECTOR_RETRY);
+	for (i = 0; i < seg_cnt; i++)
+		for (j = 0; j < segs[i].cnt; j++, sector++) {
+			uint8_t *buffer = segs[i].buffer + j * DISK_SECTOR_SIZE;
+
+			if (!write) {
+				wait_for_completion (c);
+				if (!wait_while_busy (d))
+					PANIC ("%s: disk read failed, sector=%"PRDSNu,
+							d->name, sector);
+				input_sector (c, buffer);
+			} else {
+				if (!wait_while_busy (d))
+					PANIC ("%s: disk write failed, sector=%"PRDSNu,
+							d->name, sector);
+				output_sector (c, buffer);
+				wait_for_completion (c);
+			}
+		}
+}
+
+/* Asynchronous request queue.
+
+   Each channel keeps a queue of submitted requests, served by
+   a worker thread in C-LOOK elevator order: the request at or
+   after the position where the last transfer ended, in
+   ascending sector order, and once none remains ahead, the
+   lowest-numbered request.  Requests for sectors that directly
+   follow the chosen one, in the same direction, are merged into
+   the same command, up to MAX_XFER_SECTORS sectors.  Callers
+   submit a batch with disk_submit() and then disk_wait() for
+   each request. */
+
+/* Submits request R to move CNT sectors starting at SEC_NO
+   between disk D and BUFFER, which must be CNT *
+   DISK_SECTOR_SIZE bytes, writing if WRITE is true and reading
+   otherwise.  Returns at once; the caller must not touch BUFFER
+   or R until disk_wait(R) has returned. */
+void
+disk_submit (struct disk_request *r, struct disk *d, disk_sector_t sec_no,
+		void *buffer, size_t cnt, bool write) {
+	struct channel *c;
+
+	ASSERT (r != NULL);
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+	ASSERT (cnt > 0);
+	ASSERT (sec_no + cnt <= d->capacity);
+
+	r->disk = d;
+	r->sector = sec_no;
+	r->cnt = cnt;
+	r->buffer = buffer;
+	r->write = write;
+	sema_init (&r->done, 0);
+
+	c = d->channel;
+	lock_acquire (&c->queue_lock);
+	list_push_back (&c->queue, &r->elem);
+	d->queued_cnt++;
+	cond_signal (&c->queue_nonempty, &c->queue_lock);
+	lock_release (&c->queue_lock);
+}
+
+/* Waits for request R, submitted with disk_submit(), to
+   complete. */
+void
+disk_wait (struct disk_request *r) {
+	ASSERT (r != NULL);
+
+	sema_down (&r->done);
+}
+
+/* Returns true if request A comes before request B in C-LOOK
+   order. */
+static bool
+clook_less (const struct disk_request *a, const struct disk_request *b) {
+	bool a_ahead = a->sector >= a->disk->head;
+	bool b_ahead = b->sector >= b->disk->head;
+
+	if (a_ahead != b_ahead)
+		return a_ahead;
+	return a->sector < b->sector;
+}
+
+/* Removes from channel C's queue and returns the next request in
+   C-LOOK order.  C's queue_lock must be held and the queue must
+   not be empty. */
+static struct disk_request *
+pick_request (struct channel *c) {
+	struct disk_request *best = NULL;
+	struct list_elem *e;
+
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e)) {
+		struct disk_request *r = list_entry (e, struct disk_request, elem);
+		if (best == NULL || clook_less (r, best))
+			best = r;
+	}
+	list_remove (&best->elem);
+	return best;
+}
+
+/* Removes from channel C's queue and returns a request that can
+   be appended to a transfer of CNT sectors of FIRST's disk that
+   ends at sector END, or a null pointer if there is none.  C's
+   queue_lock must be held. */
+static struct disk_request *
+pick_adjacent (struct channel *c, const struct disk_request *first,
+		disk_sector_t end, size_t cnt) {
+	struct list_elem *e;
+
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e)) {
+		struct disk_request *r = list_entry (e, struct disk_request, elem);
+		if (r->disk == first->disk && r->write == first->write
+				&& r->sector == end && cnt + r->cnt <= MAX_XFER_SECTORS) {
+			list_remove (&r->elem);
+			return r;
+		}
+	}
+	return NULL;
+}
+
+/* Serves channel C's request queue. */
+static void
+queue_worker (void *c_) {
+	struct channel *c = c_;
+
+	for (;;) {
+		struct disk_request *batch[MAX_MERGE];
+		struct segment segs[MAX_MERGE];
+		struct disk_request *first, *r;
+		disk_sector_t end;
+		size_t n, cnt, i;
+
+		lock_acquire (&c->queue_lock);
+		while (list_empty (&c->queue))
+			cond_wait (&c->queue_nonempty, &c->queue_lock);
+		first = pick_request (c);
+		batch[0] = first;
+		n = 1;
+		cnt = first->cnt;
+		end = first->sector + first->cnt;
+		if (cnt <= MAX_XFER_SECTORS)
+			while (n < MAX_MERGE
+					&& (r = pick_adjacent (c, first, end, cnt)) != NULL) {
+				batch[n++] = r;
+				cnt += r->cnt;
+				end += r->cnt;
+				first->disk->merged_cnt++;
+			}
+		lock_release (&c->queue_lock);
+
+		if (n == 1) {
+			/* A lone request may be larger than one command. */
+			if (first->write)
+				disk_write_multiple (first->disk, first->sector,
+						first->buffer, first->cnt);
+			else
+				disk_read_multiple (first->disk, first->sector,
+						first->buffer, first->cnt);
+		} else {
+			for (i = 0; i < n; i++) {
+				segs[i].buffer = batch[i]->buffer;
+				segs[i].cnt = batch[i]->cnt;
+			}
+			transfer (first->disk, first->sector, segs, n, first->write);
+		}
+
+		for (i = 0; i < n; i++)
+			sema_up (&batch[i]->done);
+	}
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -364,6 +756,9 @@ identify_ata_device (struct disk *d) {
 	/* Calculate capacity. */
 	d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+	/* Word 49 bit 8: DMA supported. */
+	d->dma_ok = (id[49] & 0x100) != 0;
+
 	/* Print identification message. */
 	printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
 	if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -402,17 +797,19 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
+	ASSERT (cnt > 0 && cnt <= 256);
 	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt <= d->capacity - sec_no);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt & 0xff);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -446,6 +843,189 @@ output_sector (struct channel *c, const void *sector) {
 	outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
 }
 
+/* Bus master DMA. */
+
+/* PCI configuration space ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Reads the 32-bit PCI configuration register at offset REG of
+   function FUNC of device DEV on bus 0. */
+static uint32_t
+pci_read_config (int dev, int func, int reg) {
+	outl (PCI_CONFIG_ADDR,
+			0x80000000 | (dev << 11) | (func << 8) | (reg & 0xfc));
+	return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit PCI configuration register at
+   offset REG of function FUNC of device DEV on bus 0. */
+static void
+pci_write_config (int dev, int func, int reg, uint32_t value) {
+	outl (PCI_CONFIG_ADDR,
+			0x80000000 | (dev << 11) | (func << 8) | (reg & 0xfc));
+	outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller capable of bus
+   mastering, such as the PIIX3/4 that QEMU emulates.  If one is
+   found, enables bus mastering on it and returns the I/O port
+   base of its bus master registers.  Otherwise, or if the -pio
+   option was given, returns 0. */
+static uint16_t
+find_bmide (void) {
+	int dev, func;
+
+	if (!disk_use_dma)
+		return 0;
+
+	for (dev = 0; dev < 32; dev++)
+		for (func = 0; func < 8; func++) {
+			uint32_t id = pci_read_config (dev, func, 0x00);
+			uint32_t class = pci_read_config (dev, func, 0x08);
+			uint32_t bar4;
+
+			if ((id & 0xffff) == 0xffff)
+				continue;
+
+			/* Class 1 (mass storage), subclass 1 (IDE), with
+			   programming interface bit 7 (bus master). */
+			if ((class >> 16) != 0x0101 || !(class & 0x8000))
+				continue;
+
+			/* BAR4 must be an I/O space BAR. */
+			bar4 = pci_read_config (dev, func, 0x20);
+			if (!(bar4 & 1) || (bar4 & 0xfffc) == 0)
+				continue;
+
+			/* Enable I/O space and bus master access. */
+			pci_write_config (dev, func, 0x04,
+					pci_read_config (dev, func, 0x04) | 0x5);
+			return bar4 & 0xfffc;
+		}
+	return 0;
+}
+
+/* Fills in channel C's PRD table to describe the SEG_CNT
+   segments in SEGS, in order.  Returns false if a segment
+   cannot be reached by the controller, which addresses only the
+   low 4 GB of physical memory in even-aligned pieces, or lies
+   in the vmalloc region, which is not physically contiguous. */
+static bool
+build_prdt (struct channel *c, const struct segment *segs, size_t seg_cnt) {
+	size_t i = 0;
+	size_t s;
+
+	for (s = 0; s < seg_cnt; s++) {
+		uint64_t pa, end;
+
+		if (!is_kernel_vaddr (segs[s].buffer)
+				|| is_vmalloc_vaddr (segs[s].buffer)
+				|| ((uintptr_t) segs[s].buffer & 1) != 0)
+			return false;
+		pa = vtop (segs[s].buffer);
+		end = pa + segs[s].cnt * DISK_SECTOR_SIZE;
+		if (end > 0x100000000ULL)
+			return false;
+
+		/* Kernel virtual memory maps physical memory linearly, so
+		   each segment is physically contiguous and only needs
+		   splitting at 64 kB boundaries. */
+		while (pa < end) {
+			uint64_t next = (pa | 0xffff) + 1;
+			if (next > end)
+				next = end;
+			if (i >= PRD_CNT)
+				return false;
+			c->prdt[i].addr = pa;
+			c->prdt[i].size = (next - pa) & 0xffff;
+			c->prdt[i].flags = 0;
+			pa = next;
+			i++;
+		}
+	}
+	ASSERT (i > 0);
+	c->prdt[i - 1].flags = PRD_EOT;
+	return true;
+}
+
+/* Tries to transfer the CNT sectors starting at SEC_NO of disk D
+   to or from the SEG_CNT segments in SEGS by DMA, reading if
+   WRITE is false.  Returns true if successful.
+   Returns false, having transferred nothing, if DMA is not
+   possible for this disk or buffer; the caller must then use
+   PIO.  If the controller reports an error, DMA is turned off for
+   D and false is returned, so the caller retries by PIO.  The
+   channel's lock must be held. */
+static bool
+dma_transfer (struct disk *d, disk_sector_t sec_no,
+		const struct segment *segs, size_t seg_cnt, size_t cnt, bool write) {
+	struct channel *c = d->channel;
+	uint8_t dir = write ? 0 : BM_CMD_READ;
+	uint8_t bm_status, status;
+
+	ASSERT (lock_held_by_current_thread (&c->lock));
+
+	if (c->bm_base == 0 || !d->dma_ok
+			|| !build_prdt (c, segs, seg_cnt))
+		return false;
+
+	/* Point the controller at the PRD table, set the direction
+	   and clear stale status. */
+	outl (reg_bm_prdt (c), vtop (c->prdt));
+	outb (reg_bm_cmd (c), dir);
+	outb (reg_bm_status (c),
+			inb (reg_bm_status (c)) | BM_STA_INTR | BM_STA_ERROR);
+
+	/* Issue the command, start the engine and sleep until the
+	   disk interrupts. */
+	select_sector (d, sec_no, cnt);
+	issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb (reg_bm_cmd (c), dir | BM_CMD_START);
+	wait_for_completion (c);
+
+	/* Stop the engine and collect status. */
+	outb (reg_bm_cmd (c), dir);
+	bm_status = inb (reg_bm_status (c));
+	outb (reg_bm_status (c), bm_status | BM_STA_INTR | BM_STA_ERROR);
+	wait_while_busy (d);
+	status = inb (reg_alt_status (c));
+
+	if ((bm_status & BM_STA_ERROR) || (status & STA_ERR)) {
+		printf ("%s: DMA %s failed, sector=%"PRDSNu"; using PIO\n",
+				d->name, write ? "write" : "read", sec_no);
+		d->dma_ok = false;
+		return false;
+	}
+	return true;
+}
+
+/* Sleeps until channel C's interrupt handler signals completion
+   of the current command, charging the time asleep to C's
+   WAIT_CYCLES rather than to the transfer. */
+static void
+wait_for_completion (struct channel *c) {
+	uint64_t start = rdtsc ();
+
+	sema_down (&c->completion_wait);
+	c->wait_cycles += rdtsc () - start;
+}
+
+/* Starts timing a transfer on channel C.  Returns the start
+   time for end_transfer(). */
+static uint64_t
+begin_transfer (struct channel *c) {
+	c->wait_cycles = 0;
+	return rdtsc ();
+}
+
+/* Charges the time since START, less time spent asleep, to disk
+   D's BUSY_CYCLES. */
+static void
+end_transfer (struct disk *d, uint64_t start) {
+	d->busy_cycles += rdtsc () - start - d->channel->wait_cycles;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
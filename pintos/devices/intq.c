@@ -3,29 +3,35 @@
 #include "threads/thread.h"
 
 static int next (int pos);
+static bool is_empty (const struct intq *q);
+static bool is_full (const struct intq *q);
+static void wait_locked (struct intq *q, struct thread **waiter);
 static void wait (struct intq *q, struct thread **waiter);
 static void signal (struct intq *q, struct thread **waiter);
 
 /* Initializes interrupt queue Q. */
 void
 intq_init (struct intq *q) {
+	spin_init (&q->spin, "intq");
 	lock_init (&q->lock);
 	q->not_full = q->not_empty = NULL;
 	q->head = q->tail = 0;
 }
 
-/* Returns true if Q is empty, false otherwise. */
+/* Returns true if Q is empty, false otherwise.  Unless the
+   caller keeps other CPUs away from Q, the answer may be stale. */
 bool
 intq_empty (const struct intq *q) {
 	ASSERT (intr_get_level () == INTR_OFF);
-	return q->head == q->tail;
+	return is_empty (q);
 }
 
-/* Returns true if Q is full, false otherwise. */
+/* Returns true if Q is full, false otherwise.  Unless the caller
+   keeps other CPUs away from Q, the answer may be stale. */
 bool
 intq_full (const struct intq *q) {
 	ASSERT (intr_get_level () == INTR_OFF);
-	return next (q->head) == q->tail;
+	return is_full (q);
 }
 
 /* Removes a byte from Q and returns it.
@@ -37,16 +43,14 @@ intq_getc (struct intq *q) {
 	uint8_t byte;
 
 	ASSERT (intr_get_level () == INTR_OFF);
-	while (intq_empty (q)) {
-		ASSERT (!intr_context ());
-		lock_acquire (&q->lock);
+	spin_lock (&q->spin);
+	while (is_empty (q))
 		wait (q, &q->not_empty);
-		lock_release (&q->lock);
-	}
 
 	byte = q->buf[q->tail];
 	q->tail = next (q->tail);
 	signal (q, &q->not_full);
+	spin_unlock (&q->spin);
 	return byte;
 }
 
@@ -57,16 +61,14 @@ intq_getc (struct intq *q) {
 void
 intq_putc (struct intq *q, uint8_t byte) {
 	ASSERT (intr_get_level () == INTR_OFF);
-	while (intq_full (q)) {
-		ASSERT (!intr_context ());
-		lock_acquire (&q->lock);
+	spin_lock (&q->spin);
+	while (is_full (q))
 		wait (q, &q->not_full);
-		lock_release (&q->lock);
-	}
 
 	q->buf[q->head] = byte;
 	q->head = next (q->head);
 	signal (q, &q->not_empty);
+	spin_unlock (&q->spin);
 }
 
 /* Returns the position after POS within an intq. */
@@ -75,17 +77,49 @@ next (int pos) {
 	return (pos + 1) % INTQ_BUFSIZE;
 }
 
+/* Returns true if Q, whose spinlock the caller holds, is empty. */
+static bool
+is_empty (const struct intq *q) {
+	return q->head == q->tail;
+}
+
+/* Returns true if Q, whose spinlock the caller holds, is full. */
+static bool
+is_full (const struct intq *q) {
+	return next (q->head) == q->tail;
+}
+
 /* WAITER must be the address of Q's not_empty or not_full
-   member.  Waits until the given condition is true. */
+   member, and the caller must hold Q's spinlock.  Waits, as the
+   only waiter, until the given condition may have become true,
+   and returns with the spinlock held again. */
 static void
-wait (struct intq *q UNUSED, struct thread **waiter) {
+wait (struct intq *q, struct thread **waiter) {
 	ASSERT (!intr_context ());
+	ASSERT (spin_held_by_current_cpu (&q->spin));
+
+	spin_unlock (&q->spin);
+	lock_acquire (&q->lock);
+	spin_lock (&q->spin);
+	if ((waiter == &q->not_empty && is_empty (q))
+			|| (waiter == &q->not_full && is_full (q)))
+		wait_locked (q, waiter);
+	spin_unlock (&q->spin);
+	lock_release (&q->lock);
+	spin_lock (&q->spin);
+}
+
+/* Sleeps on WAITER, as for wait(), once the caller holds Q's
+   lock as well as its spinlock. */
+static void
+wait_locked (struct intq *q, struct thread **waiter) {
 	ASSERT (intr_get_level () == INTR_OFF);
-	ASSERT ((waiter == &q->not_empty && intq_empty (q))
-			|| (waiter == &q->not_full && intq_full (q)));
+	ASSERT ((waiter == &q->not_empty && is_empty (q))
+			|| (waiter == &q->not_full && is_full (q)));
 
 	*waiter = thread_current ();
-	thread_block ();
+	thread_block_unlock (&q->spin);
+	spin_lock (&q->spin);
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
@@ -94,9 +128,9 @@ wait (struct intq *q UNUSED, struct thread **waiter) {
    the waiting thread. */
 static void
 signal (struct intq *q UNUSED, struct thread **waiter) {
-	ASSERT (intr_get_level () == INTR_OFF);
-	ASSERT ((waiter == &q->not_empty && !intq_empty (q))
-			|| (waiter == &q->not_full && !intq_full (q)));
+	ASSERT (spin_held_by_current_cpu (&q->spin));
+	ASSERT ((waiter == &q->not_empty && !is_empty (q))
+			|| (waiter == &q->not_full && !is_full (q)));
 
 	if (*waiter != NULL) {
 		thread_unblock (*waiter);
@@ -5,6 +5,7 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -54,6 +55,14 @@ static enum { UNINIT, POLL, QUEUE } mode;
 /* Data to be transmitted. */
 static struct intq txq;
 
+/* Protects the port, mode, and txq against other CPUs.  The
+   receive path re-enters through input_putc() and
+   serial_notify(), and a panic may print while the lock is
+   held, so a CPU that already holds it goes on without it. */
+static struct spinlock serial_lock = { .name = "serial" };
+
+static bool serial_acquire (void);
+static void serial_release (bool locked);
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
@@ -86,9 +95,11 @@ serial_init_queue (void) {
 	ASSERT (mode == POLL);
 
 	intr_register_ext (0x20 + 4, serial_interrupt, "serial");
-	mode = QUEUE;
 	old_level = intr_disable ();
+	spin_lock (&serial_lock);
+	mode = QUEUE;
 	write_ier ();
+	spin_unlock (&serial_lock);
 	intr_set_level (old_level);
 }
 
@@ -96,6 +107,7 @@ serial_init_queue (void) {
 void
 serial_putc (uint8_t byte) {
 	enum intr_level old_level = intr_disable ();
+	bool locked = serial_acquire ();
 
 	if (mode != QUEUE) {
 		/* If we're not set up for interrupt-driven I/O yet,
@@ -106,12 +118,11 @@ serial_putc (uint8_t byte) {
 	} else {
 		/* Otherwise, queue a byte and update the interrupt enable
 		   register. */
-		if (old_level == INTR_OFF && intq_full (&txq)) {
-			/* Interrupts are off and the transmit queue is full.
-			   If we wanted to wait for the queue to empty,
-			   we'd have to reenable interrupts.
-			   That's impolite, so we'll send a character via
-			   polling instead. */
+		if (intq_full (&txq)) {
+			/* The transmit queue is full.  Waiting for it to
+			   empty would mean sleeping with serial_lock held,
+			   or with interrupts off, so we'll send a character
+			   via polling instead. */
 			putc_poll (intq_getc (&txq));
 		}
 
@@ -119,6 +130,7 @@ serial_putc (uint8_t byte) {
 		write_ier ();
 	}
 
+	serial_release (locked);
 	intr_set_level (old_level);
 }
 
@@ -127,8 +139,11 @@ serial_putc (uint8_t byte) {
 void
 serial_flush (void) {
 	enum intr_level old_level = intr_disable ();
+	bool locked = serial_acquire ();
+
 	while (!intq_empty (&txq))
 		putc_poll (intq_getc (&txq));
+	serial_release (locked);
 	intr_set_level (old_level);
 }
 
@@ -138,9 +153,30 @@ serial_flush (void) {
    to or removed from the buffer. */
 void
 serial_notify (void) {
+	bool locked;
+
 	ASSERT (intr_get_level () == INTR_OFF);
+	locked = serial_acquire ();
 	if (mode == QUEUE)
 		write_ier ();
+	serial_release (locked);
+}
+
+/* Takes serial_lock, unless this CPU holds it already.  Returns
+   true if it was taken, to be passed to serial_release(). */
+static bool
+serial_acquire (void) {
+	if (spin_held_by_current_cpu (&serial_lock))
+		return false;
+	spin_lock (&serial_lock);
+	return true;
+}
+
+/* Releases serial_lock if serial_acquire() took it. */
+static void
+serial_release (bool locked) {
+	if (locked)
+		spin_unlock (&serial_lock);
 }
 
 /* Configures the serial port for BPS bits per second. */
@@ -196,6 +232,8 @@ putc_poll (uint8_t byte) {
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) {
+	bool locked = serial_acquire ();
+
 	/* Inquire about interrupt in UART.  Without this, we can
 	   occasionally miss an interrupt running under QEMU. */
 	inb (IIR_REG);
@@ -212,4 +250,5 @@ serial_interrupt (struct intr_frame *f UNUSED) {
 
 	/* Update interrupt enable register based on queue status. */
 	write_ier ();
+	serial_release (locked);
 }
@@ -1,10 +1,12 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -20,6 +22,16 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Threads blocked in timer_sleep(), ordered by wakeup tick.
+   Threads with equal wakeup ticks stay in FIFO order. */
+static struct list sleep_list;
+static struct spinlock sleep_lock;      /* Protects sleep_list. */
+
+/* Wakeup tick of the front of sleep_list, or INT64_MAX if the
+   list is empty.  Lets timer_interrupt() skip the list entirely
+   on ticks where nobody is due. */
+static int64_t next_wakeup = INT64_MAX;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -28,6 +40,9 @@ static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static bool wakeup_less (const struct list_elem *, const struct list_elem *,
+		void *aux);
+static void wake_sleepers (void);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
@@ -42,6 +57,8 @@ timer_init (void) {
 	outb (0x40, count & 0xff);
 	outb (0x40, count >> 8);
 
+	list_init (&sleep_list);
+	spin_init (&sleep_lock, "sleep");
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -87,14 +104,26 @@ timer_elapsed (int64_t then) {
 	return timer_ticks () - then;
 }
 
-/* Suspends execution for approximately TICKS timer ticks. */
+/* Suspends execution for approximately TICKS timer ticks.
+   The caller is blocked on sleep_list until timer_interrupt()
+   observes that its wakeup tick has passed. */
 void
 timer_sleep (int64_t ticks) {
-	int64_t start = timer_ticks ();
+	struct thread *t = thread_current ();
+	enum intr_level old_level;
 
 	ASSERT (intr_get_level () == INTR_ON);
-	while (timer_elapsed (start) < ticks)
-		thread_yield ();
+	if (ticks <= 0)
+		return;
+
+	old_level = intr_disable ();
+	t->wakeup_tick = timer_ticks () + ticks;
+	spin_lock (&sleep_lock);
+	list_insert_ordered (&sleep_list, &t->elem, wakeup_less, NULL);
+	if (t->wakeup_tick < next_wakeup)
+		next_wakeup = t->wakeup_tick;
+	thread_block_unlock (&sleep_lock);
+	intr_set_level (old_level);
 }
 
 /* Suspends execution for approximately MS milliseconds. */
@@ -125,9 +154,43 @@ timer_print_stats (void) {
 static void
 timer_interrupt (struct intr_frame *args UNUSED) {
 	ticks++;
+	if (ticks >= next_wakeup) {
+		wake_sleepers ();
+		thread_preempt ();
+	}
 	thread_tick ();
 }
 
+/* Orders threads on sleep_list by ascending wakeup tick. */
+static bool
+wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+		void *aux UNUSED) {
+	const struct thread *a = list_entry (a_, struct thread, elem);
+	const struct thread *b = list_entry (b_, struct thread, elem);
+
+	return a->wakeup_tick < b->wakeup_tick;
+}
+
+/* Unblocks every thread on sleep_list whose wakeup tick has
+   arrived.  Since the list is sorted, this only touches the K
+   threads being woken plus the new front. */
+static void
+wake_sleepers (void) {
+	spin_lock (&sleep_lock);
+	next_wakeup = INT64_MAX;
+	while (!list_empty (&sleep_list)) {
+		struct thread *t = list_entry (list_front (&sleep_list),
+				struct thread, elem);
+		if (t->wakeup_tick > ticks) {
+			next_wakeup = t->wakeup_tick;
+			break;
+		}
+		list_pop_front (&sleep_list);
+		thread_unblock (t);
+	}
+	spin_unlock (&sleep_lock);
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
@@ -5,6 +5,7 @@
 #include <string.h>
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/vaddr.h"
 
 /* VGA text screen support.  See [FREEVGA] for more information. */
@@ -25,6 +26,11 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+/* Protects the display and cursor against other CPUs.  A CPU
+   that already holds it, because it panicked while writing,
+   writes without it. */
+static struct spinlock vga_lock = { .name = "vga" };
+
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -50,7 +56,10 @@ vga_putc (int c) {
 	/* Disable interrupts to lock out interrupt handlers
 	   that might write to the console. */
 	enum intr_level old_level = intr_disable ();
+	bool locked = !spin_held_by_current_cpu (&vga_lock);
 
+	if (locked)
+		spin_lock (&vga_lock);
 	init ();
 
 	switch (c) {
@@ -88,6 +97,8 @@ vga_putc (int c) {
 	/* Update cursor position. */
 	move_cursor ();
 
+	if (locked)
+		spin_unlock (&vga_lock);
 	intr_set_level (old_level);
 }
 
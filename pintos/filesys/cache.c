@@ -0,0 +1,412 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* A write-back cache of file system disk sectors.
+
+   All file system traffic goes through this cache: a lookup
+   that hits copies to or from memory, and a miss evicts another
+   entry, chosen by the clock algorithm, writing it back first
+   if it is dirty.  Dirty sectors are otherwise written back by
+   a daemon every FLUSH_INTERVAL ticks and by cache_done() at
+   shutdown.  A second daemon reads ahead sectors queued by
+   cache_read_ahead(), so that sequential reads find the next
+   sector already in memory.
+
+   Synchronization is in two levels.  CACHE_LOCK protects the
+   mapping from sectors to entries: every entry's SECTOR,
+   IN_USE, ACCESSED and PIN_CNT fields and the clock hand.  Each
+   entry's own LOCK protects its DATA, LOADED and DIRTY fields and is
+   held across the disk I/O that fills or writes back the entry,
+   so that threads using different sectors never wait for each
+   other's I/O.  An entry with a nonzero PIN_CNT is in use and is
+   never evicted.  Where both locks are needed, CACHE_LOCK is
+   acquired first. */
+
+/* Number of cached sectors. */
+#define CACHE_CNT 64
+
+/* Ticks between write-behind passes. */
+#define FLUSH_INTERVAL TIMER_FREQ
+
+/* Maximum number of queued read-ahead requests.  Requests made
+   while the queue is full are dropped. */
+#define READ_AHEAD_CNT 16
+
+/* A cached sector. */
+struct cache_entry {
+	disk_sector_t sector;       /* Sector held, if IN_USE. */
+	bool in_use;                /* True if SECTOR is meaningful. */
+	bool loaded;                /* True once DATA holds SECTOR's contents. */
+	bool accessed;              /* Clock reference bit. */
+	int pin_cnt;                /* Number of threads using the entry. */
+
+	struct lock lock;           /* Protects DATA, LOADED and DIRTY. */
+	bool dirty;                 /* True if DATA differs from the disk. */
+	uint8_t *data;              /* DISK_SECTOR_SIZE bytes. */
+};
+
+static struct cache_entry cache[CACHE_CNT];
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Signalled, with CACHE_LOCK, whenever an entry's PIN_CNT drops
+   to 0, for cache_get() to wait on when every entry is pinned. */
+static struct condition entry_unpinned;
+
+/* Pending read-ahead requests, a ring buffer protected by
+   CACHE_LOCK.  READ_AHEAD_SEMA counts the requests. */
+static disk_sector_t read_ahead_queue[READ_AHEAD_CNT];
+static size_t read_ahead_head, read_ahead_cnt;
+static struct semaphore read_ahead_sema;
+
+static bool cache_ready;
+
+static thread_func write_behind_daemon NO_RETURN;
+static thread_func read_ahead_daemon NO_RETURN;
+
+/* Initializes the sector cache and starts its daemons. */
+void
+cache_init (void) {
+	uint8_t *pages;
+	size_t i;
+
+	pages = palloc_get_multiple (PAL_ASSERT,
+			CACHE_CNT * DISK_SECTOR_SIZE / PGSIZE);
+	for (i = 0; i < CACHE_CNT; i++) {
+		struct cache_entry *e = &cache[i];
+
+		e->in_use = e->loaded = e->accessed = e->dirty = false;
+		e->pin_cnt = 0;
+		lock_init (&e->lock);
+		e->data = pages + i * DISK_SECTOR_SIZE;
+	}
+	lock_init (&cache_lock);
+	cond_init (&entry_unpinned);
+	clock_hand = 0;
+	read_ahead_head = read_ahead_cnt = 0;
+	sema_init (&read_ahead_sema, 0);
+	cache_ready = true;
+
+	thread_create ("cache-flush", PRI_DEFAULT, write_behind_daemon, NULL);
+	thread_create ("cache-readahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+}
+
+/* Writes every dirty sector back to disk.  Called at shutdown. */
+void
+cache_done (void) {
+	cache_flush ();
+}
+
+/* Writes back entry E if it is dirty.  E's lock must be held. */
+static void
+write_back (struct cache_entry *e) {
+	ASSERT (lock_held_by_current_thread (&e->lock));
+
+	if (e->dirty) {
+		disk_write (filesys_disk, e->sector, e->data);
+		e->dirty = false;
+	}
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if there
+   is none.  CACHE_LOCK must be held. */
+static struct cache_entry *
+lookup (disk_sector_t sector) {
+	size_t i;
+
+	for (i = 0; i < CACHE_CNT; i++)
+		if (cache[i].in_use && cache[i].sector == sector)
+			return &cache[i];
+	return NULL;
+}
+
+/* Drops a pin on entry E, waking the threads waiting for an
+   unpinned entry if it was the last.  CACHE_LOCK must be held. */
+static void
+unpin (struct cache_entry *e) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	ASSERT (e->pin_cnt > 0);
+
+	if (--e->pin_cnt == 0)
+		cond_broadcast (&entry_unpinned, &cache_lock);
+}
+
+/* Chooses an unpinned entry to reuse and returns it clean, or
+   returns a null pointer if every entry is pinned.  Clean entries
+   are preferred over dirty ones: the first sweep clears accessed
+   bits, and a dirty entry is taken only once a whole sweep has
+   found no clean candidate.  CACHE_LOCK must be held.  It is
+   released while a dirty victim is written back, so the caller
+   must look up its sector again afterward. */
+static struct cache_entry *
+evict (void) {
+	for (;;) {
+		struct cache_entry *dirty_victim = NULL;
+		size_t n;
+
+		for (n = 0; n < 2 * CACHE_CNT; n++) {
+			struct cache_entry *e = &cache[clock_hand];
+			clock_hand = (clock_hand + 1) % CACHE_CNT;
+
+			if (e->pin_cnt > 0)
+				continue;
+			if (!e->in_use)
+				return e;
+			if (e->accessed) {
+				e->accessed = false;
+				continue;
+			}
+			if (!e->dirty)
+				return e;
+			if (dirty_victim == NULL)
+				dirty_victim = e;
+		}
+		if (dirty_victim == NULL)
+			return NULL;
+
+		/* Write the victim back holding only its own lock, so that
+		   misses on other sectors do not wait for the disk.  The
+		   pin keeps the entry assigned to its sector meanwhile, so
+		   that a lookup of that sector waits for the entry instead
+		   of reading the old contents from disk. */
+		dirty_victim->pin_cnt++;
+		lock_release (&cache_lock);
+		lock_acquire (&dirty_victim->lock);
+		write_back (dirty_victim);
+		lock_release (&dirty_victim->lock);
+		lock_acquire (&cache_lock);
+		unpin (dirty_victim);
+
+		/* Take it unless someone used it while it was written. */
+		if (dirty_victim->pin_cnt == 0 && !dirty_victim->accessed
+				&& !dirty_victim->dirty)
+			return dirty_victim;
+	}
+}
+
+/* Returns the entry for SECTOR, pinned and with its lock held,
+   loading SECTOR from disk unless FILL is false (for callers
+   about to overwrite the whole sector). */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool fill) {
+	struct cache_entry *e;
+
+	ASSERT (cache_ready);
+
+	lock_acquire (&cache_lock);
+	while ((e = lookup (sector)) == NULL) {
+		struct cache_entry *victim = evict ();
+
+		if (victim == NULL) {
+			/* Every entry is pinned.  Wait for one to be released. */
+			cond_wait (&entry_unpinned, &cache_lock);
+		} else if (lookup (sector) == NULL) {
+			/* Checked again, since evict() may have let another
+			   thread bring SECTOR in. */
+			e = victim;
+			e->sector = sector;
+			e->in_use = true;
+			e->loaded = false;
+			break;
+		}
+	}
+	disk_count_cache_lookup (filesys_disk, e->loaded);
+	e->pin_cnt++;
+	lock_release (&cache_lock);
+
+	lock_acquire (&e->lock);
+	if (!e->loaded) {
+		/* Whoever gets the entry's lock first after a miss
+		   fills it; later users see it loaded. */
+		if (fill)
+			disk_read (filesys_disk, sector, e->data);
+		else
+			memset (e->data, 0, DISK_SECTOR_SIZE);
+		e->loaded = true;
+	}
+	return e;
+}
+
+/* Releases entry E obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e) {
+	lock_release (&e->lock);
+
+	lock_acquire (&cache_lock);
+	e->accessed = true;
+	unpin (e);
+	lock_release (&cache_lock);
+}
+
+/* Copies SIZE bytes starting at offset OFS within SECTOR into
+   BUFFER. */
+void
+cache_read_at (disk_sector_t sector, void *buffer, size_t ofs, size_t size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, true);
+	memcpy (buffer, e->data + ofs, size);
+	cache_put (e);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at offset
+   OFS.  The sector reaches the disk later, when it is evicted
+   or flushed. */
+void
+cache_write_at (disk_sector_t sector, const void *buffer, size_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, ofs != 0 || size != DISK_SECTOR_SIZE);
+	memcpy (e->data + ofs, buffer, size);
+	e->dirty = true;
+	cache_put (e);
+}
+
+/* Reads all of SECTOR into BUFFER. */
+void
+cache_read (disk_sector_t sector, void *buffer) {
+	cache_read_at (sector, buffer, 0, DISK_SECTOR_SIZE);
+}
+
+/* Writes all of SECTOR from BUFFER. */
+void
+cache_write (disk_sector_t sector, const void *buffer) {
+	cache_write_at (sector, buffer, 0, DISK_SECTOR_SIZE);
+}
+
+/* Asks for SECTOR to be brought into the cache in the
+   background, without waiting for it.  Does nothing if SECTOR
+   is already cached or too many requests are pending. */
+void
+cache_read_ahead (disk_sector_t sector) {
+	lock_acquire (&cache_lock);
+	if (lookup (sector) == NULL && read_ahead_cnt < READ_AHEAD_CNT) {
+		read_ahead_queue[(read_ahead_head + read_ahead_cnt++)
+			% READ_AHEAD_CNT] = sector;
+		sema_up (&read_ahead_sema);
+	}
+	lock_release (&cache_lock);
+}
+
+/* Writes every dirty entry back to disk. */
+void
+cache_flush (void) {
+	size_t i;
+
+	if (!cache_ready)
+		return;
+
+	for (i = 0; i < CACHE_CNT; i++) {
+		struct cache_entry *e = &cache[i];
+
+		/* Pin the entry so it cannot be reassigned to another
+		   sector while we wait for its lock. */
+		lock_acquire (&cache_lock);
+		if (!e->in_use || !e->dirty) {
+			lock_release (&cache_lock);
+			continue;
+		}
+		e->pin_cnt++;
+		lock_release (&cache_lock);
+
+		lock_acquire (&e->lock);
+		write_back (e);
+		lock_release (&e->lock);
+
+		lock_acquire (&cache_lock);
+		unpin (e);
+		lock_release (&cache_lock);
+	}
+}
+
+/* Periodically writes dirty sectors back to disk, bounding how
+   much work is lost if the machine stops without cache_done(). */
+static void
+write_behind_daemon (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (FLUSH_INTERVAL);
+		cache_flush ();
+	}
+}
+
+/* Claims an entry for SECTOR for read-ahead and returns it
+   pinned, locked and not yet loaded.  Returns a null pointer if
+   SECTOR is already cached, or if no entry is free, since
+   read-ahead is only a hint. */
+static struct cache_entry *
+cache_claim (disk_sector_t sector) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	if (lookup (sector) != NULL || (e = evict ()) == NULL
+			|| lookup (sector) != NULL) {
+		lock_release (&cache_lock);
+		return NULL;
+	}
+	e->sector = sector;
+	e->in_use = true;
+	e->loaded = false;
+	e->pin_cnt++;
+	disk_count_cache_lookup (filesys_disk, false);
+	lock_release (&cache_lock);
+
+	/* Someone looking up SECTOR may have beaten us to the lock
+	   and loaded the entry already. */
+	lock_acquire (&e->lock);
+	if (e->loaded) {
+		cache_put (e);
+		return NULL;
+	}
+	return e;
+}
+
+/* Services cache_read_ahead() requests.  Takes every pending
+   request at once and submits the reads as one batch, so that
+   the disk queue can sort them and merge adjacent sectors into
+   a single command. */
+static void
+read_ahead_daemon (void *aux UNUSED) {
+	for (;;) {
+		struct cache_entry *entries[READ_AHEAD_CNT];
+		struct disk_request requests[READ_AHEAD_CNT];
+		size_t cnt = 0;
+		size_t i;
+
+		sema_down (&read_ahead_sema);
+		do {
+			disk_sector_t sector;
+			struct cache_entry *e;
+
+			lock_acquire (&cache_lock);
+			sector = read_ahead_queue[read_ahead_head];
+			read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_CNT;
+			read_ahead_cnt--;
+			lock_release (&cache_lock);
+
+			e = cache_claim (sector);
+			if (e != NULL) {
+				disk_submit (&requests[cnt], filesys_disk, sector, e->data, 1,
+						false);
+				entries[cnt++] = e;
+			}
+		} while (sema_try_down (&read_ahead_sema));
+
+		for (i = 0; i < cnt; i++) {
+			disk_wait (&requests[i]);
+			entries[i]->loaded = true;
+			cache_put (entries[i]);
+		}
+	}
+}
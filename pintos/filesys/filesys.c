@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
@@ -22,6 +23,9 @@ filesys_init (bool format) {
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
 	inode_init ();
+	file_init ();
+	dir_init ();
+	cache_init ();
 
 #ifdef EFILESYS
 	fat_init ();
@@ -51,6 +55,7 @@ filesys_done (void) {
 #else
 	free_map_close ();
 #endif
+	cache_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -1,12 +1,16 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <stdio.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct lock free_map_lock;    /* Protects free_map and its file. */
+static size_t free_map_cursor;       /* Where the next search begins. */
 
 /* Initializes the free map. */
 void
@@ -16,6 +20,7 @@ free_map_init (void) {
 		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	lock_init (&free_map_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -24,13 +29,18 @@ free_map_init (void) {
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+	size_t sector;
+
+	lock_acquire (&free_map_lock);
+	sector = bitmap_scan_and_flip_next (free_map, &free_map_cursor, cnt,
+			false);
 	if (sector != BITMAP_ERROR
 			&& free_map_file != NULL
 			&& !bitmap_write (free_map, free_map_file)) {
 		bitmap_set_multiple (free_map, sector, cnt, false);
 		sector = BITMAP_ERROR;
 	}
+	lock_release (&free_map_lock);
 	if (sector != BITMAP_ERROR)
 		*sectorp = sector;
 	return sector != BITMAP_ERROR;
@@ -39,9 +49,11 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
 	bitmap_write (free_map, free_map_file);
+	lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -75,3 +87,28 @@ free_map_create (void) {
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
 }
+
+/* Prints how many sectors are free and how scattered they are,
+ * as the number of maximal runs of free sectors and the length
+ * of the longest one. */
+void
+free_map_print_stats (void) {
+	size_t free_cnt = 0, run_cnt = 0, run = 0, largest = 0;
+	size_t i;
+
+	if (free_map == NULL)
+		return;
+
+	for (i = 0; i < bitmap_size (free_map); i++) {
+		if (!bitmap_test (free_map, i)) {
+			if (run++ == 0)
+				run_cnt++;
+			free_cnt++;
+			if (run > largest)
+				largest = run;
+		} else
+			run = 0;
+	}
+	printf ("Free map: %zu free sectors in %zu runs, largest run %zu\n",
+			free_cnt, run_cnt, largest);
+}
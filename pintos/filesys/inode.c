@@ -3,20 +3,41 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Data sectors are located through a fixed index: DIRECT_CNT
+ * sectors listed in the inode itself, then INDIRECT_CNT through
+ * one indirect block, then INDIRECT_CNT * INDIRECT_CNT through a
+ * doubly indirect block.  Mapping an offset to a sector reads at
+ * most two index blocks, however large the file.  An entry of 0
+ * means "not allocated"; sector 0 holds the free map inode, so it
+ * is never a data or index sector. */
+#define DIRECT_CNT 123
+#define INDIRECT_CNT (DISK_SECTOR_SIZE / sizeof (disk_sector_t))
+#define MAX_SECTORS (DIRECT_CNT + INDIRECT_CNT + INDIRECT_CNT * INDIRECT_CNT)
+
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	disk_sector_t direct[DIRECT_CNT];   /* Direct data sectors. */
+	disk_sector_t indirect;             /* Indirect index block. */
+	disk_sector_t doubly_indirect;      /* Doubly indirect index block. */
+	uint32_t unused[1];                 /* Not used. */
+};
+
+/* An indirect or doubly indirect index block. */
+struct index_block {
+	disk_sector_t sectors[INDIRECT_CNT];
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -26,16 +47,30 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   ELEM, OPEN_CNT and REMOVED are protected by open_inodes_lock.
+   RW guards DATA and DENY_WRITE_CNT: readers of the file hold it
+   shared, and writers, who may grow DATA's index, hold it
+   exclusively.  The contents of data sectors are protected by
+   the buffer cache, so readers of the same file never wait for
+   each other.  DIR_LOCK is only used if the inode is a
+   directory; see inode_lock_dir(). */
 struct inode {
 	struct list_elem elem;              /* Element in inode list. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
+	struct rwlock rw;                   /* Readers-writer lock. */
+	struct lock dir_lock;               /* Serializes directory operations. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 	struct inode_disk data;             /* Inode content. */
 };
 
+static disk_sector_t index_to_sector (const struct inode_disk *, size_t idx);
+static bool inode_grow (struct inode_disk *, off_t length);
+static void inode_release (struct inode_disk *);
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
@@ -44,7 +79,7 @@ static disk_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) {
 	ASSERT (inode != NULL);
 	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
+		return index_to_sector (&inode->data, pos / DISK_SECTOR_SIZE);
 	else
 		return -1;
 }
@@ -53,10 +88,33 @@ byte_to_sector (const struct inode *inode, off_t pos) {
  * returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Protects open_inodes and the open count of each inode in it. */
+static struct lock open_inodes_lock;
+
+/* Object cache for struct inode.  Each inode's locks are
+ * initialized once, by inode_ctor(), and are free again by the
+ * time it is freed. */
+static struct kmem_cache *inode_kmem_cache;
+
+/* Initializes the locks of INODE_, a new object in
+ * INODE_KMEM_CACHE. */
+static void
+inode_ctor (void *inode_) {
+	struct inode *inode = inode_;
+
+	rw_init (&inode->rw);
+	lock_init (&inode->dir_lock);
+}
+
 /* Initializes the inode module. */
 void
 inode_init (void) {
 	list_init (&open_inodes);
+	lock_init (&open_inodes_lock);
+	inode_kmem_cache = kmem_cache_create ("inode", sizeof (struct inode), 0,
+			inode_ctor);
+	if (inode_kmem_cache == NULL)
+		PANIC ("out of memory for inode cache");
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -77,20 +135,13 @@ inode_create (disk_sector_t sector, off_t length) {
 
 	disk_inode = calloc (1, sizeof *disk_inode);
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
+		if (inode_grow (disk_inode, length)) {
+			disk_inode->length = length;
+			cache_write (sector, disk_inode);
 			success = true; 
-		} 
+		} else
+			inode_release (disk_inode);
 		free (disk_inode);
 	}
 	return success;
@@ -104,36 +155,46 @@ inode_open (disk_sector_t sector) {
 	struct list_elem *e;
 	struct inode *inode;
 
+	lock_acquire (&open_inodes_lock);
+
 	/* Check whether this inode is already open. */
 	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
 			e = list_next (e)) {
 		inode = list_entry (e, struct inode, elem);
 		if (inode->sector == sector) {
-			inode_reopen (inode);
+			inode->open_cnt++;
+			lock_release (&open_inodes_lock);
 			return inode; 
 		}
 	}
 
 	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	inode = kmem_cache_alloc (inode_kmem_cache);
+	if (inode == NULL) {
+		lock_release (&open_inodes_lock);
 		return NULL;
+	}
 
-	/* Initialize. */
+	/* Initialize.  The disk inode is read before the lock is
+	 * released so that no other opener can see it half-read. */
 	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	cache_read (inode->sector, &inode->data);
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -148,23 +209,28 @@ inode_get_inumber (const struct inode *inode) {
  * If INODE was also a removed inode, frees its blocks. */
 void
 inode_close (struct inode *inode) {
+	bool last;
+
 	/* Ignore null pointer. */
 	if (inode == NULL)
 		return;
 
-	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
+	lock_acquire (&open_inodes_lock);
+	last = --inode->open_cnt == 0;
+	if (last)
 		list_remove (&inode->elem);
+	lock_release (&open_inodes_lock);
 
+	/* Release resources if this was the last opener.  Nobody else
+	 * can reach INODE any more, so no lock is needed. */
+	if (last) {
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+			inode_release (&inode->data);
 		}
 
-		free (inode); 
+		kmem_cache_free (inode_kmem_cache, inode);
 	}
 }
 
@@ -173,7 +239,9 @@ inode_close (struct inode *inode) {
 void
 inode_remove (struct inode *inode) {
 	ASSERT (inode != NULL);
+	lock_acquire (&open_inodes_lock);
 	inode->removed = true;
+	lock_release (&open_inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -183,8 +251,8 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
+	rw_read_acquire (&inode->rw);
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
@@ -200,45 +268,51 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		cache_read_at (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
+
+	/* Start fetching the sector after the last one read, on the
+	 * guess that the caller is reading sequentially. */
+	if (bytes_read > 0 && offset % DISK_SECTOR_SIZE == 0
+			&& offset < inode_length (inode))
+		cache_read_ahead (byte_to_sector (inode, offset));
+	rw_read_release (&inode->rw);
 
 	return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up or an error occurs.
+ * A write past end of file extends the inode first; any gap
+ * between the old end of file and OFFSET reads as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
 
-	if (inode->deny_write_cnt)
+	rw_write_acquire (&inode->rw);
+	if (inode->deny_write_cnt) {
+		rw_write_release (&inode->rw);
 		return 0;
+	}
+
+	if (size > 0 && offset + size > inode->data.length) {
+		bool grown = inode_grow (&inode->data, offset + size);
+		if (grown)
+			inode->data.length = offset + size;
+		cache_write (inode->sector, &inode->data);
+		if (!grown) {
+			rw_write_release (&inode->rw);
+			return 0;
+		}
+	}
 
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
@@ -255,34 +329,15 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
+	rw_write_release (&inode->rw);
 
 	return bytes_written;
 }
@@ -292,8 +347,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	void
 inode_deny_write (struct inode *inode) 
 {
+	rw_write_acquire (&inode->rw);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	rw_write_release (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -301,9 +358,28 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	rw_write_acquire (&inode->rw);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	rw_write_release (&inode->rw);
+}
+
+/* Acquires the directory lock of INODE, which must be a
+ * directory.  The directory code holds it across each lookup,
+ * add, remove and readdir, so that a lookup never sees a
+ * half-written entry and two adds of the same name cannot both
+ * succeed.  Operations on different directories do not
+ * contend. */
+void
+inode_lock_dir (struct inode *inode) {
+	lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the directory lock of INODE. */
+void
+inode_unlock_dir (struct inode *inode) {
+	lock_release (&inode->dir_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -311,3 +387,146 @@ off_t
 inode_length (const struct inode *inode) {
 	return inode->data.length;
 }
+
+/* Reads entry IDX of the index block in sector BLOCK. */
+static disk_sector_t
+index_get (disk_sector_t block, size_t idx) {
+	disk_sector_t sector;
+
+	ASSERT (idx < INDIRECT_CNT);
+	if (block == 0)
+		return 0;
+	cache_read_at (block, &sector, idx * sizeof sector, sizeof sector);
+	return sector;
+}
+
+/* Returns the data sector at sector index IDX of DISK_INODE, or
+ * 0 if that sector has not been allocated. */
+static disk_sector_t
+index_to_sector (const struct inode_disk *disk_inode, size_t idx) {
+	if (idx < DIRECT_CNT)
+		return disk_inode->direct[idx];
+	idx -= DIRECT_CNT;
+	if (idx < INDIRECT_CNT)
+		return index_get (disk_inode->indirect, idx);
+	idx -= INDIRECT_CNT;
+	if (idx < INDIRECT_CNT * INDIRECT_CNT)
+		return index_get (index_get (disk_inode->doubly_indirect,
+					idx / INDIRECT_CNT), idx % INDIRECT_CNT);
+	return 0;
+}
+
+/* Makes sure *SECTORP names an allocated sector, allocating and
+ * zeroing one if it is 0.  Sets *CHANGED to true if it allocated.
+ * Returns false if the disk is full. */
+static bool
+ensure_sector (disk_sector_t *sectorp, bool *changed) {
+	static char zeros[DISK_SECTOR_SIZE];
+
+	if (*sectorp != 0)
+		return true;
+	if (!free_map_allocate (1, sectorp))
+		return false;
+	cache_write (*sectorp, zeros);
+	*changed = true;
+	return true;
+}
+
+/* Makes sure entry IDX of the index block *BLOCKP is allocated,
+ * allocating the index block itself first if needed, and stores
+ * the entry in *SECTORP.  Returns false if the disk is full. */
+static bool
+ensure_index_entry (disk_sector_t *blockp, size_t idx,
+		disk_sector_t *sectorp, bool *changed) {
+	bool entry_changed = false;
+
+	if (!ensure_sector (blockp, changed))
+		return false;
+	*sectorp = index_get (*blockp, idx);
+	if (!ensure_sector (sectorp, &entry_changed))
+		return false;
+	if (entry_changed)
+		cache_write_at (*blockp, sectorp, idx * sizeof *sectorp,
+				sizeof *sectorp);
+	return true;
+}
+
+/* Makes sure the data sector at sector index IDX of DISK_INODE
+ * is allocated.  Returns false if the disk is full. */
+static bool
+allocate_index (struct inode_disk *disk_inode, size_t idx) {
+	disk_sector_t sector, block;
+	bool changed = false;
+
+	if (idx < DIRECT_CNT)
+		return ensure_sector (&disk_inode->direct[idx], &changed);
+	idx -= DIRECT_CNT;
+	if (idx < INDIRECT_CNT)
+		return ensure_index_entry (&disk_inode->indirect, idx, &sector,
+				&changed);
+	idx -= INDIRECT_CNT;
+	if (idx < INDIRECT_CNT * INDIRECT_CNT)
+		return (ensure_index_entry (&disk_inode->doubly_indirect,
+					idx / INDIRECT_CNT, &block, &changed)
+				&& ensure_index_entry (&block, idx % INDIRECT_CNT, &sector,
+					&changed));
+	return false;
+}
+
+/* Allocates the data sectors DISK_INODE needs to hold LENGTH
+ * bytes, zeroing each new sector.  Does not change the recorded
+ * length.  Returns false if the disk fills up or LENGTH exceeds
+ * the largest file the index can describe; sectors allocated
+ * before the failure stay in the index and are reclaimed by
+ * inode_release(). */
+static bool
+inode_grow (struct inode_disk *disk_inode, off_t length) {
+	size_t sectors = bytes_to_sectors (length);
+	size_t idx;
+
+	if (sectors > MAX_SECTORS)
+		return false;
+	for (idx = bytes_to_sectors (disk_inode->length); idx < sectors; idx++)
+		if (!allocate_index (disk_inode, idx))
+			return false;
+	return true;
+}
+
+/* Releases every allocated sector in the index block in sector
+ * BLOCK, recursing LEVELS more levels down, and then BLOCK
+ * itself. */
+static void
+release_index_block (disk_sector_t block, int levels) {
+	struct index_block *ib;
+	size_t i;
+
+	if (block == 0)
+		return;
+	ib = malloc (sizeof *ib);
+	if (ib != NULL) {
+		cache_read (block, ib);
+		for (i = 0; i < INDIRECT_CNT; i++)
+			if (ib->sectors[i] != 0) {
+				if (levels > 0)
+					release_index_block (ib->sectors[i], levels - 1);
+				else
+					free_map_release (ib->sectors[i], 1);
+			}
+		free (ib);
+	}
+	free_map_release (block, 1);
+}
+
+/* Releases all data and index sectors of DISK_INODE.  Walks
+ * every nonzero entry rather than trusting the length, so that
+ * sectors left over from a failed inode_grow() are freed too. */
+static void
+inode_release (struct inode_disk *disk_inode) {
+	size_t i;
+
+	for (i = 0; i < DIRECT_CNT; i++)
+		if (disk_inode->direct[i] != 0)
+			free_map_release (disk_inode->direct[i], 1);
+	release_index_block (disk_inode->indirect, 0);
+	release_index_block (disk_inode->doubly_indirect, 1);
+}
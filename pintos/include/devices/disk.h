@@ -2,7 +2,11 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "threads/synch.h"
 
 /* Size of a disk sector in bytes. */
 #define DISK_SECTOR_SIZE 512
@@ -15,6 +19,20 @@ typedef uint32_t disk_sector_t;
  * printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* Use bus master DMA when the controller supports it? */
+extern bool disk_use_dma;
+
+/* An asynchronous disk request.  See disk_submit(). */
+struct disk_request {
+	struct list_elem elem;      /* Element in the channel's queue. */
+	struct disk *disk;          /* Disk. */
+	disk_sector_t sector;       /* First sector. */
+	size_t cnt;                 /* Number of sectors. */
+	void *buffer;               /* CNT * DISK_SECTOR_SIZE bytes. */
+	bool write;                 /* True to write, false to read. */
+	struct semaphore done;      /* Up'd when the request completes. */
+};
+
 void disk_init (void);
 void disk_print_stats (void);
 
@@ -22,6 +40,13 @@ struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multiple (struct disk *, disk_sector_t, void *, size_t cnt);
+void disk_write_multiple (struct disk *, disk_sector_t, const void *,
+		size_t cnt);
+void disk_submit (struct disk_request *, struct disk *, disk_sector_t,
+		void *, size_t cnt, bool write);
+void disk_wait (struct disk_request *);
+void disk_count_cache_lookup (struct disk *, bool hit);
 
 void 	register_disk_inspect_intr ();
 #endif /* devices/disk.h */
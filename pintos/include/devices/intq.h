@@ -2,6 +2,7 @@
 #define DEVICES_INTQ_H
 
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 
 /* An "interrupt queue", a circular buffer shared between
@@ -15,13 +16,17 @@
    and condition variables from threads/synch.h cannot be used in
    this case, as they normally would, because they can only
    protect kernel threads from one another, not from interrupt
-   handlers. */
+   handlers.  Instead a spinlock protects the buffer and waiters
+   against interrupt handlers and threads on other CPUs, and is
+   dropped for sleeping. */
 
 /* Queue buffer size, in bytes. */
 #define INTQ_BUFSIZE 64
 
 /* A circular queue of bytes. */
 struct intq {
+	struct spinlock spin;       /* Protects the members below. */
+
 	/* Waiting threads. */
 	struct lock lock;           /* Only one thread may wait at once. */
 	struct thread *not_full;    /* Thread waiting for not-full condition. */
@@ -36,6 +36,10 @@ bool bitmap_all (const struct bitmap *, size_t start, size_t cnt);
 #define BITMAP_ERROR SIZE_MAX
 size_t bitmap_scan (const struct bitmap *, size_t start, size_t cnt, bool);
 size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_scan_next (const struct bitmap *, size_t *cursor, size_t cnt,
+		bool);
+size_t bitmap_scan_and_flip_next (struct bitmap *, size_t *cursor,
+		size_t cnt, bool);
 
 /* File input and output. */
 #ifdef FILESYS
@@ -0,0 +1,55 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/spinlock.h"
+
+/* Maximum number of CPUs the kernel keeps state for. */
+#define NCPU_MAX 8
+
+/* Number of thread priorities; see PRI_MIN and PRI_MAX in
+   threads/thread.h. */
+#define CPU_RQ_LEVELS 64
+
+/* Per-CPU state.
+
+   Each CPU owns a set of run queues, one FIFO per priority, and
+   a mask whose bit P is set exactly when queue P is nonempty.
+   The queues and mask are protected by RQ_LOCK, which other
+   CPUs also take when they steal work.  The remaining members
+   are only touched by the owning CPU with interrupts off. */
+struct cpu {
+	int id;                             /* Index into cpus[]. */
+	uint32_t lapic_id;                  /* Local APIC ID. */
+	bool online;                        /* Scheduling threads? */
+
+	/* Run queues. */
+	struct spinlock rq_lock;            /* Protects members below. */
+	struct list ready_queues[CPU_RQ_LEVELS];
+	uint64_t ready_mask;                /* Nonempty ready_queues[]. */
+	int ready_cnt;                      /* Threads in ready_queues[]. */
+
+	/* Owned by the CPU itself. */
+	struct thread *idle;                /* This CPU's idle thread. */
+	struct thread *prev;                /* Thread switched from, if any. */
+	bool in_external_intr;              /* Handling an external interrupt? */
+	bool yield_on_return;               /* Yield on interrupt return? */
+	struct list destruction_req;        /* Dying threads to free. */
+	unsigned thread_ticks;              /* Ticks since last yield. */
+	long long idle_ticks;               /* # of timer ticks spent idle. */
+	long long kernel_ticks;             /* # of ticks in kernel threads. */
+	long long user_ticks;               /* # of ticks in user programs. */
+	long long steal_cnt;                /* # of threads stolen. */
+};
+
+extern struct cpu cpus[NCPU_MAX];
+extern int cpu_cnt;
+
+void cpu_init (void);
+void cpu_start_aps (void);
+struct cpu *cpu_current (void);
+bool cpu_has_lapic (void);
+
+#endif /* threads/cpu.h */
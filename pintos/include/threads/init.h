@@ -12,6 +12,9 @@ extern size_t ram_pages;
 /* Page map level 4 with kernel mappings only. */
 extern uint64_t *base_pml4;
 
+/* Does the kernel map memory with 2 MB pages where it can? */
+extern bool kernel_large_pages;
+
 /* -q: Power off when kernel tasks complete? */
 extern bool power_off_when_done;
 
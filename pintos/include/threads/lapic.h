@@ -0,0 +1,22 @@
+#ifndef THREADS_LAPIC_H
+#define THREADS_LAPIC_H
+
+#include <stdint.h>
+
+/* Interrupt vectors delivered by the local APIC.  The 8259A PICs
+   keep 0x20...0x2f; these sit above everything else. */
+#define LAPIC_TIMER_VEC 0xf0        /* Per-CPU timer tick. */
+#define LAPIC_RESCHED_VEC 0xf1      /* "Run your ready queue" IPI. */
+#define LAPIC_SHOOTDOWN_VEC 0xf2    /* TLB shootdown IPI; see mmu.c. */
+#define LAPIC_SPURIOUS_VEC 0xff     /* Spurious interrupts. */
+
+void lapic_map (uint64_t paddr);
+void lapic_init (void);
+uint32_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint32_t lapic_id, uint8_t vec);
+void lapic_start_ap (uint32_t lapic_id, uint64_t paddr);
+void lapic_calibrate_timer (void);
+void lapic_timer_start (void);
+
+#endif /* threads/lapic.h */
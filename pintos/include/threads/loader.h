@@ -20,6 +20,11 @@
 #define E820_MAP MULTIBOOT_INFO + 52
 #define E820_MAP4 MULTIBOOT_INFO + 56
 
+/* Physical page that application processors start executing
+   in; see threads/ap-start.S.  Must be below 1 MB and 4 kB
+   aligned for the STARTUP IPI. */
+#define AP_TRAMPOLINE 0x8000
+
 /* Important loader physical addresses. */
 #define LOADER_SIG (LOADER_END - LOADER_SIG_LEN)   /* 0xaa55 BIOS signature. */
 #define LOADER_ARGS (LOADER_SIG - LOADER_ARGS_LEN)     /* Command-line args. */
@@ -12,15 +12,28 @@ uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
+void pml4_init_pcid (void);
+void pml4_init_ap (void);
+void pml4_init_shootdown (void);
+void pml4_print_stats (void);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_set_large_page (uint64_t *pml4, uint64_t va, uint64_t pa,
+		uint64_t flags);
 void pml4_clear_page (uint64_t *pml4, void *upage);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
+void pml4_set_writable (uint64_t *pml4, const void *upage, bool writable);
+void pml4_set_kernel_page (void *vpage, void *kpage);
+void *pml4_clear_kernel_page (void *vpage);
+
+/* Tag TLB entries with PCIDs if the CPU can? */
+extern bool pml4_pcids;
 
 #define is_writable(pte) (*(pte) & PTE_W)
+#define is_large_pte(pte) (*(pte) & PTE_PS)
 #define is_user_pte(pte) (*(pte) & PTE_U)
 #define is_kern_pte(pte) (!is_user_pte (pte))
 
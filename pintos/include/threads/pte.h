@@ -26,7 +26,7 @@
 #define PDPE(la) ((((uint64_t) (la)) >> PDPESHIFT) & 0x1FF)
 #define PDX(la)  ((((uint64_t) (la)) >> PDXSHIFT) & 0x1FF)
 #define PTX(la)  ((((uint64_t) (la)) >> PTXSHIFT) & 0x1FF)
-#define PTE_ADDR(pte) ((uint64_t) (pte) & ~0xFFF)
+#define PTE_ADDR(pte) ((uint64_t) (pte) & 0x000ffffffffff000UL)
 
 /* The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
@@ -39,7 +39,23 @@
 #define PTE_P 0x1                        /* 1=present, 0=not present. */
 #define PTE_W 0x2                        /* 1=read/write, 0=read-only. */
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
+#define PTE_PWT 0x8                      /* 1=write-through caching. */
+#define PTE_PCD 0x10                     /* 1=caching disabled. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=maps a large page (PDEs only). */
+
+/* A page directory entry with PTE_PS set maps a 2 MB large page
+   directly, without a page table. */
+#define LARGE_PGSIZE (1UL << PDXSHIFT)
+#define LARGE_PTE_ADDR(pde) (PTE_ADDR (pde) & ~(LARGE_PGSIZE - 1))
+
+/* Bits 52 to 59 of an entry that points to a table, which the CPU
+   ignores, record which eighths of that table have ever had
+   entries made, so that walks over the whole table can skip the
+   rest. */
+#define PTE_LIVE_SPAN 64                 /* Entries per bit. */
+#define PTE_LIVE(idx) (1UL << (52 + (idx) / PTE_LIVE_SPAN))
+#define PTE_LIVE_ALL (0xffUL << 52)
 
 #endif /* threads/pte.h */
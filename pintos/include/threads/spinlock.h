@@ -0,0 +1,33 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+
+/* A spinlock.  Protects short critical sections that must be
+   atomic with respect to other CPUs as well as to interrupt
+   handlers on the same CPU.
+
+   Interrupts must be disabled while a spinlock is held;
+   otherwise an interrupt handler that takes the same lock on
+   the same CPU would spin forever.  The usual pattern is
+
+        old_level = intr_disable ();
+        spin_lock (&lock);
+        ...
+        spin_unlock (&lock);
+        intr_set_level (old_level);
+
+   A thread must not block while holding a spinlock. */
+struct spinlock {
+	volatile int locked;        /* Nonzero while held. */
+	struct cpu *cpu;            /* CPU holding the lock (for debugging). */
+	const char *name;           /* Name (for debugging). */
+};
+
+void spin_init (struct spinlock *, const char *name);
+void spin_lock (struct spinlock *);
+bool spin_try_lock (struct spinlock *);
+void spin_unlock (struct spinlock *);
+bool spin_held_by_current_cpu (const struct spinlock *);
+
+#endif /* threads/spinlock.h */
@@ -3,9 +3,11 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include "threads/spinlock.h"
 
 /* A counting semaphore. */
 struct semaphore {
+	struct spinlock lock;       /* Protects the members below. */
 	unsigned value;             /* Current value. */
 	struct list waiters;        /* List of waiting threads. */
 };
@@ -38,6 +40,22 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock {
+	struct lock lock;           /* Protects the fields below. */
+	struct condition readers;   /* Signaled when readers may proceed. */
+	struct condition writers;   /* Signaled when a writer may proceed. */
+	int reader_cnt;             /* Number of readers holding the lock. */
+	bool writer;                /* True if a writer holds the lock. */
+	int waiting_writers;        /* Number of writers waiting. */
+};
+
+void rw_init (struct rwlock *);
+void rw_read_acquire (struct rwlock *);
+void rw_read_release (struct rwlock *);
+void rw_write_acquire (struct rwlock *);
+void rw_write_release (struct rwlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
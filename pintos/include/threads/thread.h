@@ -83,10 +83,11 @@ typedef int tid_t;
  * value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
  * the run queue (thread.c), or it can be an element in a
- * semaphore wait list (synch.c).  It can be used these two ways
- * only because they are mutually exclusive: only a thread in the
- * ready state is on the run queue, whereas only a thread in the
- * blocked state is on a semaphore wait list. */
+ * semaphore wait list (synch.c) or the timer's sleep list
+ * (devices/timer.c).  It can be used these ways only because
+ * they are mutually exclusive: only a thread in the ready state
+ * is on the run queue, whereas only a thread in the blocked
+ * state is on a semaphore wait list or the sleep list. */
 
 /** project2-System Call */
 #define FDT_PAGES     3                     // test `multi-oom` 테스트용
@@ -98,14 +99,21 @@ struct thread {
 	enum thread_status status;          /* Thread state. */
 	char name[16];                      /* Name (for debugging purposes). */
 	int priority;                       /* Priority. */
+	struct cpu *cpu;                    /* CPU last run on, or queued on. */
+	struct cpu *running_cpu;            /* CPU running it, while it runs. */
+	volatile bool on_cpu;               /* Context not yet saved by a CPU? */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
 	int exit_status;   
 
+	/* Owned by devices/timer.c. */
+	int64_t wakeup_tick;                /* Tick to leave timer_sleep(). */
+
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint64_t *pml4;                     /* Page map level 4 */
+	uint64_t exec_start;                /* rdtsc() at exec, until the first system call. */
 
  	// 파일 관리
     struct file **fdt;       // 파일 디스크립터 테이블
@@ -125,6 +133,8 @@ struct thread {
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	void *user_rsp;                     /* User RSP at system call entry. */
+	void *last_load_va;                 /* Page of the last lazy load. */
 #endif
 
 	/* Owned by thread.c. */
@@ -139,15 +149,20 @@ extern bool thread_mlfqs;
 
 void thread_init (void);
 void thread_start (void);
+struct thread *thread_create_idle (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
 
 void thread_tick (void);
 void thread_print_stats (void);
+void thread_get_stats (long long *idle, long long *kernel, long long *user);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
+void thread_block_unlock (struct spinlock *);
 void thread_unblock (struct thread *);
+void thread_preempt (void);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -158,6 +173,7 @@ void thread_yield (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_change_priority (struct thread *, int);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
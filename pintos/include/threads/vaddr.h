@@ -43,6 +43,16 @@
 /* Returns true if VADDR is a kernel virtual address. */
 #define is_kernel_vaddr(vaddr) ((uint64_t)(vaddr) >= KERN_BASE)
 
+/* Kernel virtual addresses where threads/vmalloc.c maps pages
+ * of the kernel pool one by one, past the direct map of physical
+ * memory.  They are not ptov() of anything. */
+#define VMALLOC_START 0xc000000000
+#define VMALLOC_END (VMALLOC_START + 0x10000000)
+
+/* Returns true if VADDR lies in the vmalloc region. */
+#define is_vmalloc_vaddr(vaddr) \
+	((uint64_t) (vaddr) >= VMALLOC_START && (uint64_t) (vaddr) < VMALLOC_END)
+
 // FIXME: add checking
 /* Returns kernel virtual address at which physical address PADDR
  *  is mapped. */
@@ -53,6 +63,7 @@
 #define vtop(vaddr) \
 ({ \
 	ASSERT(is_kernel_vaddr(vaddr)); \
+	ASSERT(!is_vmalloc_vaddr(vaddr)); \
 	((uint64_t) (vaddr) - (uint64_t) KERN_BASE);\
 })
 
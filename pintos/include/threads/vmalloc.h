@@ -0,0 +1,13 @@
+#ifndef THREADS_VMALLOC_H
+#define THREADS_VMALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void vmalloc_init (void);
+void *vmalloc (size_t page_cnt);
+bool vmalloc_grow (void *, size_t old_cnt, size_t new_cnt);
+void vfree (void *, size_t page_cnt);
+void vmalloc_print_stats (void);
+
+#endif /* threads/vmalloc.h */
@@ -19,5 +19,7 @@ int process_exec (void *f_name);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (struct thread *next);
+void process_print_stats (void);
+void process_note_syscall (void);
 
 #endif
\ No newline at end of file
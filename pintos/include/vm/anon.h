@@ -1,13 +1,22 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
 #include "vm/vm.h"
+#include "vm/zswap.h"
 struct page;
 enum vm_type;
 
+/* Most pages anon_swap_out_batch() writes at once. */
+#define ANON_BATCH_MAX 8
+
 struct anon_page {
+	size_t slot;            /* Swap slot holding the page, or BITMAP_ERROR. */
+	struct zswap_entry *zswap;  /* Compressed copy, or NULL. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+bool anon_swap_out_batch (struct page *pages[], size_t cnt);
+bool anon_on_zero_page (struct page *page);
+void anon_print_stats (void);
 
 #endif
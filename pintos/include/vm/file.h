@@ -6,11 +6,39 @@
 struct page;
 enum vm_type;
 
+/* A mapping made by one do_mmap() call.  Its pages read and
+ * write FILE, the mapping's own reopening of the file, and each
+ * hold a reference to it. */
+struct mmap_file {
+	struct file *file;
+	int ref_cnt;
+};
+
+/* A page of a mapping.  Pages that are not yet loaded keep a
+ * malloc'd copy of this as their uninit AUX. */
 struct file_page {
+	struct mmap_file *map;  /* Mapping the page belongs to. */
+	off_t ofs;              /* Offset of the page in the file. */
+	size_t read_bytes;      /* Bytes backed by the file; the rest are
+	                           zeros that are never written back. */
+};
+
+/* How to fill a lazily loaded page: READ_BYTES bytes read from
+ * FILE at OFS, followed by ZERO_BYTES zeros.  A null FILE means
+ * the running executable, so that the page can still be loaded
+ * in a forked child after the parent closes its copy. */
+struct lazy_load {
+	struct file *file;
+	off_t ofs;
+	size_t read_bytes;
+	size_t zero_bytes;
 };
 
 void vm_file_init (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
+void *file_backed_copy_aux (const void *aux);
+void file_backed_free_aux (void *aux);
+void file_backed_fork (struct page *page);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
@@ -1,8 +1,9 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
+#include <list.h>
 #include "threads/palloc.h"
-#include "hash.h"
 
 enum vm_type {
 	/* page not initialized */
@@ -46,8 +47,9 @@ struct page {
 	void *va;              /* Address in terms of user space */
 	struct frame *frame;   /* Back reference for frame */
 
-	struct hash_elem hash_elem;  // 해시 테이블에 넣기 위한 element
-
+	bool writable;         /* May the owner write to the page? */
+	uint64_t *pml4;        /* Page table the page is mapped into. */
+	struct list_elem frame_elem;  /* Element in the frame's PAGES. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -64,7 +66,25 @@ struct page {
 /* The representation of "frame" */
 struct frame {
 	void *kva;
-	struct page *page;
+	struct page *page;     /* One of PAGES, or NULL if none. */
+	struct list pages;     /* Pages mapping the frame. */
+	int ref_cnt;           /* Number of PAGES. */
+	int pin_cnt;           /* Nonzero while the frame must stay. */
+	bool evicting;         /* Being written out by eviction. */
+	struct list_elem elem; /* Element in the frame table. */
+
+	/* A frame holding part of a mapped file is shared by every
+	 * mapping of that part, and found through these. */
+	struct inode *inode;   /* File held, or NULL if not a file frame. */
+	off_t ofs;             /* Offset in INODE. */
+	bool dirty;            /* Written through a mapping since read. */
+	struct hash_elem file_elem;  /* Element in the file frame index. */
+
+	/* Same-page merging, done by the daemon in vm.c. */
+	uint64_t checksum;     /* Hash of the contents when last scanned. */
+	bool merged;           /* Shared by merging identical frames. */
+	bool ksm_listed;       /* In the merge candidates under CHECKSUM. */
+	struct hash_elem ksm_elem;   /* Element in the merge candidates. */
 };
 
 /* The function table for page operations.
@@ -84,13 +104,37 @@ struct page_operations {
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ * A radix tree indexed by virtual page number, shaped like the
+ * hardware page table: each of the SPT_LEVELS levels is a page of
+ * SPT_FANOUT pointers indexed by SPT_BITS bits of the page number,
+ * and the last level points to the struct pages.  Subtrees with no
+ * pages are null, so lookups need no hashing and iteration visits
+ * pages in address order.  Three levels cover the low 512 GB,
+ * SPT_LIMIT, which is all of user space but the 64 MB below
+ * KERN_BASE; no page may be put there. */
+#define SPT_LEVELS 3
+#define SPT_BITS 9
+#define SPT_FANOUT (1 << SPT_BITS)
+#define SPT_LIMIT ((uint64_t) PGSIZE << (SPT_LEVELS * SPT_BITS))
+
 struct supplemental_page_table {
-	struct hash pages;  // 해시 테이블
+	void **root;           /* Top-level node, or NULL if empty. */
+	size_t page_cnt;       /* Number of pages in the table. */
 };
 
+/* Called by spt_for_each() on each page in a range.  Returning
+ * false stops the iteration. */
+typedef bool spt_action_func (struct page *page, void *aux);
+
 #include "threads/thread.h"
+
+/* If true, each process reports its memory use as it exits. */
+extern bool vm_process_stats;
+
+/* Frames the same-page merging daemon scans per timer tick, or 0
+ * to not run it. */
+extern unsigned ksm_pages_per_tick;
+
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
 		struct supplemental_page_table *src);
@@ -99,6 +143,11 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+bool spt_for_each (struct supplemental_page_table *spt, void *start,
+		void *end, spt_action_func *action, void *aux);
+bool spt_range_empty (struct supplemental_page_table *spt, void *start,
+		void *end);
+void spt_prune (struct supplemental_page_table *spt, void *start, void *end);
 
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
@@ -110,6 +159,13 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+void *vm_begin_claim (struct page *page);
+bool vm_finish_claim (struct page *page, bool success);
+void vm_release_frame (struct page *page);
+void vm_pin_buffer (const void *buffer, size_t size, bool write);
+void vm_unpin_buffer (const void *buffer, size_t size);
+void vm_print_stats (void);
+void vm_report_process (void);
 enum vm_type page_get_type (struct page *page);
 
 #endif  /* VM_VM_H */
@@ -0,0 +1,28 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct page;
+
+/* A page held compressed in the pool. */
+struct zswap_entry {
+	struct page *page;          /* Page stored. */
+	size_t chunk;               /* First pool chunk holding it. */
+	size_t size;                /* Compressed size in bytes. */
+	struct list_elem elem;      /* Element in the pool's LRU list. */
+};
+
+/* Pool size in pages, set by the -zswap kernel option. */
+extern size_t zswap_pool_pages;
+
+bool zswap_init (void);
+size_t zswap_compress (const void *kva);
+struct zswap_entry *zswap_store (struct page *page, size_t size);
+void zswap_load (const struct zswap_entry *, void *kva);
+void zswap_free (struct zswap_entry *);
+struct zswap_entry *zswap_oldest (void);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */
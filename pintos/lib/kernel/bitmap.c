@@ -55,6 +55,38 @@ byte_cnt (size_t bit_cnt) {
 	return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns a mask of the bits, in the element that contains the
+   bit numbered START, that represent bits START through END,
+   exclusive.  END may lie beyond that element. */
+static inline elem_type
+range_mask (size_t start, size_t end) {
+	elem_type mask = (elem_type) -1 << (start % ELEM_BITS);
+	size_t elem_end = (elem_idx (start) + 1) * ELEM_BITS;
+
+	if (end < elem_end)
+		mask &= ((elem_type) 1 << (end % ELEM_BITS)) - 1;
+	return mask;
+}
+
+/* Returns element IDX of B with its bits inverted unless VALUE
+   is true, so that the bits set to VALUE read as 1s. */
+static inline elem_type
+elem_for (const struct bitmap *b, size_t idx, bool value) {
+	return value ? b->bits[idx] : ~b->bits[idx];
+}
+
+/* Returns the number of 1 bits in X, by summing the bits in
+   parallel within ever wider fields.  The kernel is built
+   without POPCNT and without libgcc, so __builtin_popcountl()
+   is not available. */
+static inline size_t
+count_ones (elem_type x) {
+	x = x - ((x >> 1) & 0x5555555555555555UL);
+	x = (x & 0x3333333333333333UL) + ((x >> 2) & 0x3333333333333333UL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (x * 0x0101010101010101UL) >> 56;
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -194,33 +226,47 @@ bitmap_set_all (struct bitmap *b, bool value) {
 	bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE, a whole
+   element at a time where it can.  Each element is updated
+   atomically. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	while (start < end) {
+		size_t idx = elem_idx (start);
+		elem_type mask = range_mask (start, end);
+
+		if (value)
+			asm ("lock orq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+		else
+			asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+		start = (idx + 1) * ELEM_BITS;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t end = start + cnt;
+	size_t value_cnt = 0;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
+	while (start < end) {
+		size_t idx = elem_idx (start);
+
+		value_cnt += count_ones (elem_for (b, idx, value)
+				& range_mask (start, end));
+		start = (idx + 1) * ELEM_BITS;
+	}
 	return value_cnt;
 }
 
@@ -228,15 +274,19 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
+	while (start < end) {
+		size_t idx = elem_idx (start);
+
+		if ((elem_for (b, idx, value) & range_mask (start, end)) != 0)
 			return true;
+		start = (idx + 1) * ELEM_BITS;
+	}
 	return false;
 }
 
@@ -263,6 +313,55 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 
 /* Finding set or unset bits. */
 
+/* Returns the index of the first bit in B at or after START,
+   and before END, that is set to VALUE, or END if there is none.
+   Elements with no bit set to VALUE are skipped whole, and the
+   bit is found in its element with a single BSF. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value) {
+	size_t idx, last_idx;
+	elem_type bits;
+
+	if (start >= end)
+		return end;
+
+	idx = elem_idx (start);
+	last_idx = elem_idx (end - 1);
+	bits = elem_for (b, idx, value) & ((elem_type) -1 << (start % ELEM_BITS));
+	while (bits == 0) {
+		if (++idx > last_idx)
+			return end;
+		bits = elem_for (b, idx, value);
+	}
+	start = idx * ELEM_BITS + __builtin_ctzl (bits);
+	return start < end ? start : end;
+}
+
+/* Returns the starting index of the first group of CNT
+   consecutive bits in B, at or after START and ending at or
+   before END, that are all set to VALUE, or BITMAP_ERROR if
+   there is none.  Jumps from each bit set to VALUE to the end
+   of its run, so that it reads each element about once. */
+static size_t
+scan_range (const struct bitmap *b, size_t start, size_t end, size_t cnt,
+		bool value) {
+	if (cnt == 0)
+		return start;
+
+	while (end - start >= cnt) {
+		size_t run_end;
+
+		start = find_next (b, start, end, value);
+		if (end - start < cnt)
+			break;
+		run_end = find_next (b, start, start + cnt, !value);
+		if (run_end == start + cnt)
+			return start;
+		start = run_end;
+	}
+	return BITMAP_ERROR;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -272,14 +371,38 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
-	if (cnt <= b->bit_cnt) {
-		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
-				return i;
+	if (cnt > b->bit_cnt)
+		return BITMAP_ERROR;
+	return scan_range (b, start, b->bit_cnt, cnt, value);
+}
+
+/* Like bitmap_scan(), but starts at *CURSOR and wraps around to
+   the beginning of B if it finds no group before the end, so
+   that an allocator that keeps *CURSOR between calls resumes
+   where it left off instead of rescanning the bits it filled.
+   Advances *CURSOR past the group found. */
+size_t
+bitmap_scan_next (const struct bitmap *b, size_t *cursor, size_t cnt,
+		bool value) {
+	size_t start, idx;
+
+	ASSERT (b != NULL);
+	ASSERT (cursor != NULL);
+
+	if (cnt > b->bit_cnt)
+		return BITMAP_ERROR;
+
+	start = *cursor < b->bit_cnt ? *cursor : 0;
+	idx = scan_range (b, start, b->bit_cnt, cnt, value);
+	if (idx == BITMAP_ERROR && start > 0) {
+		/* Groups that begin before START may run past it. */
+		size_t end = start + cnt - 1 < b->bit_cnt ? start + cnt - 1
+			: b->bit_cnt;
+		idx = scan_range (b, 0, end, cnt, value);
 	}
-	return BITMAP_ERROR;
+	if (idx != BITMAP_ERROR)
+		*cursor = idx + cnt;
+	return idx;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -296,6 +419,17 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value) {
 		bitmap_set_multiple (b, idx, cnt, !value);
 	return idx;
 }
+
+/* Like bitmap_scan_and_flip(), but finds the group as
+   bitmap_scan_next() does, starting at *CURSOR. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t *cursor, size_t cnt,
+		bool value) {
+	size_t idx = bitmap_scan_next (b, cursor, cnt, value);
+	if (idx != BITMAP_ERROR)
+		bitmap_set_multiple (b, idx, cnt, !value);
+	return idx;
+}
 
 /* File input and output. */
 
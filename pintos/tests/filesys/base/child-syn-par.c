@@ -0,0 +1,49 @@
+/* Child process for syn-par-read test.
+   Reads the file named after its child index in 512-byte chunks,
+   PASS_CNT times over, and checks every chunk. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-par.h"
+
+static char buf[BUF_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  test_name = "child-syn-par";
+
+  char file_name[16];
+  int child_idx;
+  int pass;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, "data%d", child_idx);
+
+  random_init (child_idx);
+  random_bytes (buf, sizeof buf);
+
+  for (pass = 0; pass < PASS_CNT; pass++) 
+    {
+      size_t ofs;
+      int fd;
+
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      for (ofs = 0; ofs < sizeof buf; ofs += CHUNK_SIZE) 
+        {
+          char chunk[CHUNK_SIZE];
+          CHECK (read (fd, chunk, CHUNK_SIZE) == CHUNK_SIZE,
+                 "read \"%s\"", file_name);
+          compare_bytes (chunk, buf + ofs, CHUNK_SIZE, ofs, file_name);
+        }
+      close (fd);
+    }
+
+  return child_idx;
+}
@@ -0,0 +1,25 @@
+/* Grows a file from empty to 1 MB by appending one 4 kB block
+   at a time, then reads it back to verify that it was written
+   properly.  The run's total tick count measures append
+   throughput. */
+
+#define TEST_SIZE (1024 * 1024)
+#define BLOCK_SIZE 4096
+#include "tests/filesys/seq-test.h"
+#include "tests/main.h"
+
+static char buf[TEST_SIZE];
+
+static size_t
+return_block_size (void) 
+{
+  return BLOCK_SIZE;
+}
+
+void
+test_main (void) 
+{
+  seq_test ("append",
+            buf, sizeof buf, 0,
+            return_block_size, NULL);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-append) begin
+(lg-append) create "append"
+(lg-append) open "append"
+(lg-append) writing "append"
+(lg-append) close "append"
+(lg-append) open "append" for verification
+(lg-append) verified contents of "append"
+(lg-append) close "append"
+(lg-append) end
+EOF
+pass;
@@ -0,0 +1,74 @@
+/* Runs 10,000 create/write/remove cycles on small files of
+   random size while a long-lived file grows alongside them,
+   scattering free space across the disk.  Then verifies that a
+   large file can still be created and written, and that the
+   long-lived file is intact. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CYCLES 10000
+#define SMALL_MAX 2048
+#define ANCHOR_CHUNK 64
+#define LARGE_SIZE (512 * 1024)
+
+static char anchor[CYCLES / 16 * ANCHOR_CHUNK];
+static char small[SMALL_MAX];
+static char large[LARGE_SIZE];
+
+void
+test_main (void) 
+{
+  size_t anchor_ofs = 0;
+  int anchor_fd, fd;
+  int i;
+
+  random_init (0);
+  random_bytes (anchor, sizeof anchor);
+  random_bytes (small, sizeof small);
+  random_bytes (large, sizeof large);
+
+  CHECK (create ("anchor", 0), "create \"anchor\"");
+  CHECK ((anchor_fd = open ("anchor")) > 1, "open \"anchor\"");
+
+  msg ("running %d create/remove cycles", CYCLES);
+  for (i = 0; i < CYCLES; i++) 
+    {
+      char name[16];
+      size_t size = random_ulong () % SMALL_MAX;
+
+      snprintf (name, sizeof name, "churn%d", i % 8);
+      if (!create (name, 0))
+        fail ("create \"%s\" in cycle %d", name, i);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\" in cycle %d", name, i);
+      if (write (fd, small, size) != (int) size)
+        fail ("write %zu bytes to \"%s\" in cycle %d", size, name, i);
+      close (fd);
+      if (!remove (name))
+        fail ("remove \"%s\" in cycle %d", name, i);
+
+      if (i % 16 == 0)
+        {
+          if (write (anchor_fd, anchor + anchor_ofs, ANCHOR_CHUNK)
+              != ANCHOR_CHUNK)
+            fail ("append to \"anchor\" in cycle %d", i);
+          anchor_ofs += ANCHOR_CHUNK;
+        }
+    }
+  msg ("close \"anchor\"");
+  close (anchor_fd);
+
+  CHECK (create ("large", 0), "create \"large\"");
+  CHECK ((fd = open ("large")) > 1, "open \"large\"");
+  CHECK (write (fd, large, sizeof large) == (int) sizeof large,
+         "write \"large\"");
+  msg ("close \"large\"");
+  close (fd);
+
+  check_file ("anchor", anchor, anchor_ofs);
+  check_file ("large", large, sizeof large);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-churn) begin
+(lg-churn) create "anchor"
+(lg-churn) open "anchor"
+(lg-churn) running 10000 create/remove cycles
+(lg-churn) close "anchor"
+(lg-churn) create "large"
+(lg-churn) open "large"
+(lg-churn) write "large"
+(lg-churn) close "large"
+(lg-churn) open "anchor" for verification
+(lg-churn) verified contents of "anchor"
+(lg-churn) close "anchor"
+(lg-churn) open "large" for verification
+(lg-churn) verified contents of "large"
+(lg-churn) close "large"
+(lg-churn) end
+EOF
+pass;
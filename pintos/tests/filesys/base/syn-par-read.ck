@@ -0,0 +1,57 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-par-read) begin
+(syn-par-read) create "data0"
+(syn-par-read) open "data0"
+(syn-par-read) write "data0"
+(syn-par-read) close "data0"
+(syn-par-read) create "data1"
+(syn-par-read) open "data1"
+(syn-par-read) write "data1"
+(syn-par-read) close "data1"
+(syn-par-read) create "data2"
+(syn-par-read) open "data2"
+(syn-par-read) write "data2"
+(syn-par-read) close "data2"
+(syn-par-read) create "data3"
+(syn-par-read) open "data3"
+(syn-par-read) write "data3"
+(syn-par-read) close "data3"
+(syn-par-read) create "data4"
+(syn-par-read) open "data4"
+(syn-par-read) write "data4"
+(syn-par-read) close "data4"
+(syn-par-read) create "data5"
+(syn-par-read) open "data5"
+(syn-par-read) write "data5"
+(syn-par-read) close "data5"
+(syn-par-read) create "data6"
+(syn-par-read) open "data6"
+(syn-par-read) write "data6"
+(syn-par-read) close "data6"
+(syn-par-read) create "data7"
+(syn-par-read) open "data7"
+(syn-par-read) write "data7"
+(syn-par-read) close "data7"
+(syn-par-read) exec child 1 of 8: "child-syn-par 0"
+(syn-par-read) exec child 2 of 8: "child-syn-par 1"
+(syn-par-read) exec child 3 of 8: "child-syn-par 2"
+(syn-par-read) exec child 4 of 8: "child-syn-par 3"
+(syn-par-read) exec child 5 of 8: "child-syn-par 4"
+(syn-par-read) exec child 6 of 8: "child-syn-par 5"
+(syn-par-read) exec child 7 of 8: "child-syn-par 6"
+(syn-par-read) exec child 8 of 8: "child-syn-par 7"
+(syn-par-read) wait for child 1 of 8 returned 0 (expected 0)
+(syn-par-read) wait for child 2 of 8 returned 1 (expected 1)
+(syn-par-read) wait for child 3 of 8 returned 2 (expected 2)
+(syn-par-read) wait for child 4 of 8 returned 3 (expected 3)
+(syn-par-read) wait for child 5 of 8 returned 4 (expected 4)
+(syn-par-read) wait for child 6 of 8 returned 5 (expected 5)
+(syn-par-read) wait for child 7 of 8 returned 6 (expected 6)
+(syn-par-read) wait for child 8 of 8 returned 7 (expected 7)
+(syn-par-read) end
+EOF
+pass;
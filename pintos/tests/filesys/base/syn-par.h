@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_BASE_SYN_PAR_H
+#define TESTS_FILESYS_BASE_SYN_PAR_H
+
+#define CHILD_CNT 8
+#define BUF_SIZE (16 * 1024)
+#define CHUNK_SIZE 512
+#define PASS_CNT 4
+
+#endif /* tests/filesys/base/syn-par.h */
@@ -76,6 +76,17 @@ shuffle (void *buf_, size_t cnt, size_t size)
     }
 }
 
+/* Returns the processor's time-stamp counter, for timing
+   benchmarks in cycles. */
+uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
 void
 exec_children (const char *child_name, pid_t pids[], size_t child_cnt) 
 {
@@ -0,0 +1,71 @@
+/* Creates 500 threads that each sleep a staggered duration
+   several times, then reports how the elapsed ticks were split
+   between the idle thread and kernel threads.  With a blocking
+   timer_sleep() almost all of the time should be idle. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEPER_CNT 500
+#define ITERATIONS 5
+
+/* Shared between the test and its sleepers. */
+struct bench
+  {
+    struct semaphore done;      /* Upped once by each sleeper. */
+  };
+
+static void sleeper (void *);
+
+void
+test_alarm_bench (void)
+{
+  struct bench bench;
+  long long idle0, kernel0, user0, idle1, kernel1, user1;
+  int64_t start, elapsed;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Creating %d threads to sleep %d times each.",
+       SLEEPER_CNT, ITERATIONS);
+
+  sema_init (&bench.done, 0);
+  thread_get_stats (&idle0, &kernel0, &user0);
+  start = timer_ticks ();
+  for (i = 0; i < SLEEPER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT, sleeper, &bench) == TID_ERROR)
+        fail ("thread_create failed at sleeper %d", i);
+    }
+  for (i = 0; i < SLEEPER_CNT; i++)
+    sema_down (&bench.done);
+  elapsed = timer_elapsed (start);
+  thread_get_stats (&idle1, &kernel1, &user1);
+
+  msg ("%lld ticks elapsed: %lld idle ticks, %lld kernel ticks.",
+       (long long) elapsed, idle1 - idle0, kernel1 - kernel0);
+  pass ();
+}
+
+/* Sleeper thread.  Sleeps 10 to 19 ticks, depending on its
+   name, ITERATIONS times. */
+static void
+sleeper (void *bench_)
+{
+  struct bench *bench = bench_;
+  int duration = 10 + (int) (thread_tid () % 10);
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    timer_sleep (duration);
+  sema_up (&bench->done);
+}
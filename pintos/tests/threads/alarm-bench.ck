@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(alarm-bench) PASS', @output);
+
+# Sleepers block until they are due, so most of the elapsed ticks
+# should be idle.  Sleepers that spun on thread_yield() left next to
+# none idle.
+my ($line) = grep (/ticks elapsed:/, @output);
+fail "missing tick counts in output\n" if !defined $line;
+my ($idle, $kernel) = $line =~ /(\d+) idle ticks, (\d+) kernel ticks/
+  or fail "malformed tick counts: $line\n";
+fail "only $idle of " . ($idle + $kernel) . " ticks were idle\n"
+  if $idle <= $kernel;
+
+pass;
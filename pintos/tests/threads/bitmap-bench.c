@@ -0,0 +1,272 @@
+/* Compares the bitmap scanning, counting and testing functions,
+   which work on whole elements, against bit-at-a-time loops like
+   the ones they replaced, on maps of 1M bits, and reports TSC
+   cycles per call.  Also times filling a map one bit at a time
+   with a search from the start each time and with a cursor.
+   First checks the functions against the loops on small random
+   maps. */
+
+#include <bitmap.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "intrinsic.h"
+
+/* Bits in the benchmark maps. */
+#define BIG_BITS (1024 * 1024)
+
+/* Bits allocated one at a time by the sequential benchmark. */
+#define FILL_BITS 4096
+
+static uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+static void check (void);
+static void bench_scan (struct bitmap *);
+static void bench_count (struct bitmap *);
+static void bench_fill (struct bitmap *);
+
+void
+test_bitmap_bench (void)
+{
+  struct bitmap *b;
+
+  check ();
+
+  b = bitmap_create (BIG_BITS);
+  if (b == NULL)
+    fail ("bitmap_create failed");
+  bench_scan (b);
+  bench_count (b);
+  bench_fill (b);
+  bitmap_destroy (b);
+  pass ();
+}
+
+/* Returns a pseudo-random number, by xorshift64. */
+static uint64_t
+next_random (void)
+{
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+/* The bit-at-a-time functions. */
+
+static bool
+ref_contains (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      return true;
+  return false;
+}
+
+static size_t
+ref_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+static size_t
+ref_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  if (cnt <= bitmap_size (b))
+    {
+      size_t last = bitmap_size (b) - cnt;
+      size_t i;
+
+      for (i = start; i <= last; i++)
+        if (!ref_contains (b, i, cnt, !value))
+          return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Checks the bitmap functions against the reference loops on
+   random maps of various sizes and densities. */
+static void
+check (void)
+{
+  size_t round;
+
+  for (round = 0; round < 200; round++)
+    {
+      size_t bit_cnt = next_random () % 300 + 1;
+      unsigned density = next_random () % 101;
+      struct bitmap *b = bitmap_create (bit_cnt);
+      size_t i;
+
+      if (b == NULL)
+        fail ("bitmap_create failed");
+      for (i = 0; i < bit_cnt; i++)
+        bitmap_set (b, i, next_random () % 100 < density);
+
+      for (i = 0; i < 20; i++)
+        {
+          size_t start = next_random () % (bit_cnt + 1);
+          size_t cnt = next_random () % (bit_cnt - start + 1);
+          size_t run = next_random () % 10;
+          bool value = next_random () % 2;
+          size_t cursor, expect, found;
+
+          if (bitmap_count (b, start, cnt, value)
+              != ref_count (b, start, cnt, value))
+            fail ("bitmap_count wrong for %zu bits at %zu", cnt, start);
+          if (bitmap_contains (b, start, cnt, value)
+              != ref_contains (b, start, cnt, value))
+            fail ("bitmap_contains wrong for %zu bits at %zu", cnt, start);
+          if (bitmap_scan (b, start, run, value)
+              != ref_scan (b, start, run, value))
+            fail ("bitmap_scan wrong for %zu bits from %zu", run, start);
+
+          /* With a cursor, the search wraps around.  A cursor at
+             the end is at the start. */
+          cursor = start;
+          expect = ref_scan (b, start < bit_cnt ? start : 0, run, value);
+          if (expect == BITMAP_ERROR)
+            expect = ref_scan (b, 0, run, value);
+          found = bitmap_scan_next (b, &cursor, run, value);
+          if (found != expect)
+            fail ("bitmap_scan_next wrong for %zu bits from %zu", run, start);
+          if (found != BITMAP_ERROR && cursor != found + run)
+            fail ("bitmap_scan_next left cursor at %zu", cursor);
+        }
+
+      /* Setting ranges. */
+      for (i = 0; i < 20; i++)
+        {
+          size_t start = next_random () % (bit_cnt + 1);
+          size_t cnt = next_random () % (bit_cnt - start + 1);
+          bool value = next_random () % 2;
+
+          bitmap_set_multiple (b, start, cnt, value);
+          if (ref_count (b, start, cnt, value) != cnt)
+            fail ("bitmap_set_multiple missed bits");
+        }
+      bitmap_destroy (b);
+    }
+}
+
+/* Prints CYCLES taken by CALLS calls to the function NAME. */
+static void
+report (const char *name, uint64_t cycles, size_t calls)
+{
+  msg ("%s: %llu cycles/call", name, (unsigned long long) (cycles / calls));
+}
+
+/* Times searches of B, nearly full, for 1 and 8 clear bits. */
+static void
+bench_scan (struct bitmap *b)
+{
+  uint64_t start;
+  size_t i;
+
+  /* Every 16th bit clear, and 8 clear bits at the end. */
+  bitmap_set_all (b, true);
+  for (i = 5; i < BIG_BITS - 16; i += 16)
+    bitmap_reset (b, i);
+  bitmap_set_multiple (b, BIG_BITS - 8, 8, false);
+
+  start = rdtsc ();
+  if (ref_scan (b, 0, 8, false) != BIG_BITS - 8)
+    fail ("ref_scan did not find the run");
+  report ("scan for 8 bits, bit-at-a-time", rdtsc () - start, 1);
+
+  start = rdtsc ();
+  for (i = 0; i < 16; i++)
+    if (bitmap_scan (b, 0, 8, false) != BIG_BITS - 8)
+      fail ("bitmap_scan did not find the run");
+  report ("scan for 8 bits, word-at-a-time", rdtsc () - start, 16);
+
+  /* Only the last bit clear. */
+  bitmap_set_all (b, true);
+  bitmap_reset (b, BIG_BITS - 1);
+
+  start = rdtsc ();
+  if (ref_scan (b, 0, 1, false) != BIG_BITS - 1)
+    fail ("ref_scan did not find the bit");
+  report ("scan for 1 bit, bit-at-a-time", rdtsc () - start, 1);
+
+  start = rdtsc ();
+  for (i = 0; i < 16; i++)
+    if (bitmap_scan (b, 0, 1, false) != BIG_BITS - 1)
+      fail ("bitmap_scan did not find the bit");
+  report ("scan for 1 bit, word-at-a-time", rdtsc () - start, 16);
+}
+
+/* Times counting and testing all of B, half full at random. */
+static void
+bench_count (struct bitmap *b)
+{
+  uint64_t start;
+  size_t expect, i;
+
+  for (i = 0; i < BIG_BITS; i++)
+    bitmap_set (b, i, next_random () % 2);
+
+  start = rdtsc ();
+  expect = ref_count (b, 0, BIG_BITS, true);
+  report ("count, bit-at-a-time", rdtsc () - start, 1);
+
+  start = rdtsc ();
+  for (i = 0; i < 16; i++)
+    if (bitmap_count (b, 0, BIG_BITS, true) != expect)
+      fail ("bitmap_count disagrees");
+  report ("count, word-at-a-time", rdtsc () - start, 16);
+
+  bitmap_set_all (b, false);
+
+  start = rdtsc ();
+  if (ref_contains (b, 0, BIG_BITS, true))
+    fail ("ref_contains found a set bit");
+  report ("contains, bit-at-a-time", rdtsc () - start, 1);
+
+  start = rdtsc ();
+  for (i = 0; i < 16; i++)
+    if (bitmap_contains (b, 0, BIG_BITS, true))
+      fail ("bitmap_contains found a set bit");
+  report ("contains, word-at-a-time", rdtsc () - start, 16);
+}
+
+/* Times allocating FILL_BITS bits of B one at a time, as a
+   sequential allocator does, searching from the start each time
+   and searching from a cursor. */
+static void
+bench_fill (struct bitmap *b)
+{
+  uint64_t start;
+  size_t cursor = 0;
+  size_t i;
+
+  bitmap_set_all (b, false);
+  start = rdtsc ();
+  for (i = 0; i < FILL_BITS; i++)
+    if (ref_scan (b, 0, 1, false) != i)
+      fail ("ref_scan found the wrong bit");
+    else
+      bitmap_mark (b, i);
+  report ("fill, bit-at-a-time from start", rdtsc () - start, FILL_BITS);
+
+  bitmap_set_all (b, false);
+  start = rdtsc ();
+  for (i = 0; i < FILL_BITS; i++)
+    if (bitmap_scan_and_flip (b, 0, 1, false) != i)
+      fail ("bitmap_scan_and_flip found the wrong bit");
+  report ("fill, word-at-a-time from start", rdtsc () - start, FILL_BITS);
+
+  bitmap_set_all (b, false);
+  start = rdtsc ();
+  for (i = 0; i < FILL_BITS; i++)
+    if (bitmap_scan_and_flip_next (b, &cursor, 1, false) != i)
+      fail ("bitmap_scan_and_flip_next found the wrong bit");
+  report ("fill, word-at-a-time from cursor", rdtsc () - start, FILL_BITS);
+}
@@ -0,0 +1,39 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(bitmap-bench) PASS', @output);
+
+# Each function working on whole elements should beat the
+# bit-at-a-time loop it replaced, and a search from a cursor
+# should beat a search from the start.
+my (%cycles) = map (/^\(bitmap-bench\) (.+): (\d+) cycles\/call$/, @output);
+my (@pairs) = (['scan for 8 bits, bit-at-a-time',
+                'scan for 8 bits, word-at-a-time'],
+               ['scan for 1 bit, bit-at-a-time',
+                'scan for 1 bit, word-at-a-time'],
+               ['count, bit-at-a-time', 'count, word-at-a-time'],
+               ['contains, bit-at-a-time', 'contains, word-at-a-time'],
+               ['fill, bit-at-a-time from start',
+                'fill, word-at-a-time from start'],
+               ['fill, word-at-a-time from start',
+                'fill, word-at-a-time from cursor']);
+for my $pair (@pairs) {
+    my ($old, $new) = @$pair;
+    for my $name ($old, $new) {
+        fail "missing timing for \"$name\"\n" if !defined $cycles{$name};
+    }
+    fail "\"$new\" took $cycles{$new} cycles/call, "
+      . "\"$old\" only $cycles{$old}\n"
+      if $cycles{$new} >= $cycles{$old};
+}
+
+pass;
@@ -0,0 +1,111 @@
+/* Measures sequential read throughput from the file system disk
+   three ways: one disk_read() per sector, disk_read_multiple()
+   over the whole range, and one queued single-sector request
+   per sector, submitted in descending order so that the request
+   queue must sort them and merge them back into large commands.
+   Checks that all three read the same data.  Only meaningful in
+   kernels built with a file system; elsewhere it just passes. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#include "intrinsic.h"
+#ifdef FILESYS
+#include "devices/disk.h"
+#endif
+
+#ifdef FILESYS
+#define SECTOR_CNT 256
+#define PASS_CNT 8
+#define BUF_PAGES (SECTOR_CNT * DISK_SECTOR_SIZE / PGSIZE)
+
+static void report (const char *how, uint64_t cycles, int64_t ticks);
+
+void
+test_disk_bench (void)
+{
+  struct disk *d = disk_get (0, 1);
+  struct disk_request *requests;
+  uint8_t *expected, *actual;
+  uint64_t start;
+  int64_t start_ticks;
+  int p, i;
+
+  if (d == NULL || disk_size (d) < SECTOR_CNT)
+    {
+      msg ("no file system disk large enough; skipped.");
+      pass ();
+      return;
+    }
+
+  expected = palloc_get_multiple (PAL_ASSERT, BUF_PAGES);
+  actual = palloc_get_multiple (PAL_ASSERT, BUF_PAGES);
+  requests = malloc (SECTOR_CNT * sizeof *requests);
+  if (requests == NULL)
+    fail ("out of memory");
+
+  /* One sector per call. */
+  start_ticks = timer_ticks ();
+  start = rdtsc ();
+  for (p = 0; p < PASS_CNT; p++)
+    for (i = 0; i < SECTOR_CNT; i++)
+      disk_read (d, i, expected + i * DISK_SECTOR_SIZE);
+  report ("disk_read", rdtsc () - start, timer_elapsed (start_ticks));
+
+  /* The whole range per call. */
+  start_ticks = timer_ticks ();
+  start = rdtsc ();
+  for (p = 0; p < PASS_CNT; p++)
+    disk_read_multiple (d, 0, actual, SECTOR_CNT);
+  report ("disk_read_multiple", rdtsc () - start,
+          timer_elapsed (start_ticks));
+  if (memcmp (expected, actual, SECTOR_CNT * DISK_SECTOR_SIZE))
+    fail ("disk_read_multiple read different data");
+
+  /* Queued requests, submitted backward. */
+  memset (actual, 0, SECTOR_CNT * DISK_SECTOR_SIZE);
+  start_ticks = timer_ticks ();
+  start = rdtsc ();
+  for (p = 0; p < PASS_CNT; p++)
+    {
+      for (i = SECTOR_CNT - 1; i >= 0; i--)
+        disk_submit (&requests[i], d, i, actual + i * DISK_SECTOR_SIZE, 1,
+                     false);
+      for (i = 0; i < SECTOR_CNT; i++)
+        disk_wait (&requests[i]);
+    }
+  report ("disk_submit", rdtsc () - start, timer_elapsed (start_ticks));
+  if (memcmp (expected, actual, SECTOR_CNT * DISK_SECTOR_SIZE))
+    fail ("queued requests read different data");
+
+  free (requests);
+  palloc_free_multiple (actual, BUF_PAGES);
+  palloc_free_multiple (expected, BUF_PAGES);
+  pass ();
+}
+
+/* Prints the cost of reading PASS_CNT * SECTOR_CNT sectors
+   HOW, given that it took CYCLES cycles and TICKS timer
+   ticks. */
+static void
+report (const char *how, uint64_t cycles, int64_t ticks)
+{
+  long long kb = PASS_CNT * SECTOR_CNT * DISK_SECTOR_SIZE / 1024;
+
+  msg ("%-18s %6llu cycles/sector, %lld kB in %lld ticks (%lld kB/s).",
+       how, (unsigned long long) (cycles / (PASS_CNT * SECTOR_CNT)),
+       kb, (long long) ticks,
+       ticks > 0 ? kb * TIMER_FREQ / ticks : 0);
+}
+#else /* !FILESYS */
+void
+test_disk_bench (void)
+{
+  msg ("kernel built without a file system disk; skipped.");
+  pass ();
+}
+#endif /* FILESYS */
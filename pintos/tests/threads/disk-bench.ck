@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(disk-bench) PASS', @output);
+pass if grep (/skipped\.$/, @output);
+
+# Reading many sectors per command, whether asked for at once or
+# merged from queued requests, should beat a command per sector.
+my (%cycles) = map (/^\(disk-bench\) (\S+)\s+(\d+) cycles\/sector/, @output);
+for my $how ('disk_read', 'disk_read_multiple', 'disk_submit') {
+    fail "missing timing for $how\n" if !defined $cycles{$how};
+}
+for my $how ('disk_read_multiple', 'disk_submit') {
+    fail "$how took $cycles{$how} cycles/sector, "
+      . "disk_read only $cycles{disk_read}\n"
+      if $cycles{$how} >= $cycles{disk_read};
+}
+
+pass;
@@ -0,0 +1,165 @@
+/* Checks that malloc() still hands out 64 kB buffers once the
+   kernel pool is fragmented.  The test allocates every free page
+   of the kernel pool, frees half of them at random, so that no
+   long run of free pages is likely to remain, and then allocates
+   BUF_CNT buffers of 64 kB, fills each with its own pattern and
+   checks the patterns.  Each buffer must come from the vmalloc
+   region.  It then frees every other buffer and allocates it
+   again, and finally grows a buffer with realloc(), which must
+   not move it, since the pages after the last block are free. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Buffers allocated. */
+#define BUF_CNT 16
+
+/* Size of each buffer. */
+#define BUF_SIZE (64 * 1024)
+
+static uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+static void **fragment (size_t *kept_cnt, size_t *freed_cnt);
+static void *alloc_buffer (size_t idx);
+static void check_buffer (const void *buf, size_t size, size_t idx);
+
+void
+test_malloc_frag (void)
+{
+  void *bufs[BUF_CNT];
+  void **list;
+  size_t kept_cnt, freed_cnt;
+  uint8_t *grown;
+  uintptr_t big;
+  void *run;
+  size_t i;
+
+  list = fragment (&kept_cnt, &freed_cnt);
+  msg ("kernel pool: %zu pages kept, %zu freed at random",
+       kept_cnt, freed_cnt);
+
+  run = palloc_get_multiple (0, BUF_SIZE / PGSIZE + 1);
+  msg ("contiguous run of %d pages: %s", BUF_SIZE / PGSIZE + 1,
+       run != NULL ? "found" : "none");
+  if (run != NULL)
+    palloc_free_multiple (run, BUF_SIZE / PGSIZE + 1);
+
+  for (i = 0; i < BUF_CNT; i++)
+    bufs[i] = alloc_buffer (i);
+  for (i = 0; i < BUF_CNT; i++)
+    check_buffer (bufs[i], BUF_SIZE, i);
+  msg ("allocated and checked %d buffers of %d bytes", BUF_CNT, BUF_SIZE);
+
+  for (i = 0; i < BUF_CNT; i += 2)
+    free (bufs[i]);
+  for (i = 0; i < BUF_CNT; i += 2)
+    bufs[i] = alloc_buffer (i);
+  for (i = 0; i < BUF_CNT; i++)
+    check_buffer (bufs[i], BUF_SIZE, i);
+  msg ("freed and allocated again every other buffer");
+
+  grown = alloc_buffer (BUF_CNT);
+  big = (uintptr_t) grown;
+  grown = realloc (grown, 2 * BUF_SIZE);
+  if (grown == NULL)
+    fail ("realloc() to %d bytes failed", 2 * BUF_SIZE);
+  if ((uintptr_t) grown != big)
+    fail ("realloc() moved the last block from %p to %p",
+          (void *) big, grown);
+  check_buffer (grown, BUF_SIZE, BUF_CNT);
+  memset (grown + BUF_SIZE, 0x5a, BUF_SIZE);
+  msg ("grew the last buffer in place to %d bytes", 2 * BUF_SIZE);
+  free (grown);
+
+  for (i = 0; i < BUF_CNT; i++)
+    free (bufs[i]);
+  while (list != NULL)
+    {
+      void **page = list;
+      list = *page;
+      palloc_free_page (page);
+    }
+  pass ();
+}
+
+/* Returns a pseudo-random number, by xorshift64. */
+static uint64_t
+next_random (void)
+{
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+/* Allocates every free page of the kernel pool, then frees about
+   half of them at random.  Returns the pages still allocated as a
+   list linked through their first words, their number in
+   *KEPT_CNT and the number freed in *FREED_CNT. */
+static void **
+fragment (size_t *kept_cnt, size_t *freed_cnt)
+{
+  void **list = NULL, **kept = NULL;
+  void **page;
+
+  while ((page = palloc_get_page (0)) != NULL)
+    {
+      *page = list;
+      list = page;
+    }
+
+  *kept_cnt = *freed_cnt = 0;
+  while (list != NULL)
+    {
+      page = list;
+      list = *page;
+      if (next_random () % 2 == 0)
+        {
+          *page = kept;
+          kept = page;
+          ++*kept_cnt;
+        }
+      else
+        {
+          palloc_free_page (page);
+          ++*freed_cnt;
+        }
+    }
+  return kept;
+}
+
+/* Allocates a BUF_SIZE-byte buffer, fills it with the pattern for
+   IDX and returns it, failing the test if malloc() fails or the
+   buffer is not in the vmalloc region. */
+static void *
+alloc_buffer (size_t idx)
+{
+  uint8_t *buf = malloc (BUF_SIZE);
+  size_t i;
+
+  if (buf == NULL)
+    fail ("malloc() of buffer %zu failed", idx);
+  if (!is_vmalloc_vaddr (buf))
+    fail ("buffer %zu at %p is not in the vmalloc region", idx, buf);
+  for (i = 0; i < BUF_SIZE; i++)
+    buf[i] = (uint8_t) (i * 7 + idx);
+  return buf;
+}
+
+/* Checks that the first SIZE bytes of BUF hold the pattern for
+   IDX. */
+static void
+check_buffer (const void *buf_, size_t size, size_t idx)
+{
+  const uint8_t *buf = buf_;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != (uint8_t) (i * 7 + idx))
+      fail ("buffer %zu: byte %zu is %02x, expected %02x",
+            idx, i, buf[i], (uint8_t) (i * 7 + idx));
+}
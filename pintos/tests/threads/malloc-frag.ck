@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@core) = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(malloc-frag) PASS', @core);
+for my $line ('allocated and checked 16 buffers of 65536 bytes',
+              'freed and allocated again every other buffer',
+              'grew the last buffer in place to 131072 bytes') {
+    fail "missing \"$line\" in output"
+      unless grep ($_ eq "(malloc-frag) $line", @core);
+}
+
+# The big blocks came from the vmalloc region, and the kernel's
+# statistics at shutdown count the block that grew in place.
+my ($stats) = grep (/^Vmalloc:/, @output);
+fail "missing vmalloc statistics in output\n" if !defined $stats;
+my ($blocks, $grown) = $stats =~ /(\d+) blocks, .* (\d+) grown in place/
+  or fail "malformed vmalloc statistics: $stats\n";
+fail "only $blocks blocks allocated from the vmalloc region\n"
+  if $blocks < 16;
+fail "no block grew in place\n" if $grown < 1;
+
+pass;
@@ -0,0 +1,150 @@
+/* Times palloc_get_multiple() and palloc_free_multiple() on the
+   user pool filled to 10%, 50% and 95% of its pages.  Each fill
+   allocates every page and then frees pages at random, so that
+   the free pages are scattered as they are after a long run.
+   Requests of 1 and 8 pages are timed at each fill, in batches
+   allocated together and then freed together, and the test
+   reports the average TSC cycles per call and how many of the
+   8-page requests found no free run. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Requests allocated before any is freed. */
+#define BATCH 16
+
+/* Batches timed per request size and fill. */
+#define ROUNDS 256
+
+static uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+static void **fill (unsigned percent, size_t *page_cnt);
+static size_t count_free (void);
+static void measure (unsigned percent, size_t page_cnt);
+static void drain (void **list);
+
+void
+test_palloc_bench (void)
+{
+  static const unsigned percents[] = {10, 50, 95};
+  size_t i;
+
+  for (i = 0; i < sizeof percents / sizeof *percents; i++)
+    {
+      size_t used;
+      void **list = fill (percents[i], &used);
+
+      msg ("%u%% full: %zu of %zu pages in use",
+           percents[i], used, used + count_free ());
+      measure (percents[i], 1);
+      measure (percents[i], 8);
+      drain (list);
+    }
+  pass ();
+}
+
+/* Returns a pseudo-random number, by xorshift64. */
+static uint64_t
+next_random (void)
+{
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+/* Allocates every free page of the user pool, then frees pages
+   at random until about PERCENT percent of them stay allocated.
+   Returns the pages still allocated as a list linked through
+   their first words, and their number in *PAGE_CNT. */
+static void **
+fill (unsigned percent, size_t *page_cnt)
+{
+  void **list = NULL, **kept = NULL;
+  void **page;
+
+  while ((page = palloc_get_page (PAL_USER)) != NULL)
+    {
+      *page = list;
+      list = page;
+    }
+
+  *page_cnt = 0;
+  while (list != NULL)
+    {
+      page = list;
+      list = *page;
+      if (next_random () % 100 < percent)
+        {
+          *page = kept;
+          kept = page;
+          ++*page_cnt;
+        }
+      else
+        palloc_free_page (page);
+    }
+  return kept;
+}
+
+/* Returns the number of free pages in the user pool. */
+static size_t
+count_free (void)
+{
+  size_t page_cnt;
+
+  drain (fill (100, &page_cnt));
+  return page_cnt;
+}
+
+/* Frees every page in LIST, as returned by fill(). */
+static void
+drain (void **list)
+{
+  while (list != NULL)
+    {
+      void **page = list;
+      list = *page;
+      palloc_free_page (page);
+    }
+}
+
+/* Times ROUNDS batches of BATCH requests for PAGE_CNT pages from
+   the user pool, filled to PERCENT percent. */
+static void
+measure (unsigned percent, size_t page_cnt)
+{
+  uint64_t alloc_cycles = 0, free_cycles = 0;
+  size_t alloc_cnt = 0, fail_cnt = 0;
+  void *pages[BATCH];
+  size_t round, i;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (i = 0; i < BATCH; i++)
+        {
+          uint64_t start = rdtsc ();
+          pages[i] = palloc_get_multiple (PAL_USER, page_cnt);
+          alloc_cycles += rdtsc () - start;
+          if (pages[i] == NULL)
+            fail_cnt++;
+        }
+      for (i = 0; i < BATCH; i++)
+        if (pages[i] != NULL)
+          {
+            uint64_t start = rdtsc ();
+            palloc_free_multiple (pages[i], page_cnt);
+            free_cycles += rdtsc () - start;
+            alloc_cnt++;
+          }
+    }
+
+  msg ("%u%% full, %zu page(s): %llu cycles/alloc, %llu cycles/free, "
+       "%zu of %d failed",
+       percent, page_cnt,
+       (unsigned long long) (alloc_cycles / (ROUNDS * BATCH)),
+       (unsigned long long) (alloc_cnt ? free_cycles / alloc_cnt : 0),
+       fail_cnt, ROUNDS * BATCH);
+}
@@ -0,0 +1,41 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(palloc-bench) PASS', @output);
+
+my (%alloc, %failed);
+for (@output) {
+    my ($percent, $pages, $cycles, $fails)
+      = /^\(palloc-bench\) (\d+)% full, (\d+) page\(s\): (\d+) cycles\/alloc, \d+ cycles\/free, (\d+) of \d+ failed$/
+      or next;
+    $alloc{"$percent/$pages"} = $cycles;
+    $failed{"$percent/$pages"} = $fails;
+}
+for my $percent (10, 50, 95) {
+    for my $pages (1, 8) {
+        fail "missing timing for $pages page(s) at $percent% full\n"
+          if !defined $alloc{"$percent/$pages"};
+    }
+}
+
+# A page should cost about as much to allocate from a nearly full
+# pool as from a nearly empty one.  Allow a factor of 4 for noise; a
+# scan of the free map grows by far more than that.
+fail "1-page allocations took $alloc{'95/1'} cycles at 95% full "
+  . "but $alloc{'10/1'} at 10% full\n"
+  if $alloc{'95/1'} > 4 * $alloc{'10/1'};
+
+# At 10% full, free 8-page blocks are plentiful.
+fail "$failed{'10/8'} 8-page allocations failed at 10% full\n"
+  if $failed{'10/8'} > 0;
+
+pass;
@@ -0,0 +1,70 @@
+/* Measures the cost of a scheduling decision as the number of
+   runnable threads grows.  The test thread runs at a higher
+   priority than N ready threads and yields repeatedly, so each
+   yield requeues it and picks it again with all N threads still
+   waiting.  With per-priority run queues the cycles per yield
+   should stay flat from 10 to 1000 threads. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+#define YIELD_CNT 10000
+
+static void waiter (void *);
+static void measure (int thread_cnt);
+
+void
+test_sched_bench (void)
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  measure (10);
+  measure (100);
+  measure (1000);
+  pass ();
+}
+
+/* Runs YIELD_CNT yields with THREAD_CNT lower-priority threads
+   ready to run, then lets them finish. */
+static void
+measure (int thread_cnt)
+{
+  struct semaphore done;
+  uint64_t start, cycles;
+  int i;
+
+  sema_init (&done, 0);
+  for (i = 0; i < thread_cnt; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "wait %d", i);
+      if (thread_create (name, PRI_DEFAULT - 1, waiter, &done) == TID_ERROR)
+        fail ("thread_create failed at waiter %d", i);
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < YIELD_CNT; i++)
+    thread_yield ();
+  cycles = rdtsc () - start;
+
+  /* Block so the waiters can run and exit. */
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done);
+
+  msg ("%4d ready threads: %llu cycles per yield.",
+       thread_cnt, (unsigned long long) (cycles / YIELD_CNT));
+}
+
+/* Waiter thread.  Only runs once the test thread blocks. */
+static void
+waiter (void *done_)
+{
+  struct semaphore *done = done_;
+
+  sema_up (done);
+}
@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(sched-bench) PASS', @output);
+
+# Picking the next thread should cost the same with 1000 ready
+# threads as with 10.  Allow a factor of 3 for noise; a scan of the
+# ready threads grows by far more than that.
+my (%cycles) = map (/^\(sched-bench\)\s+(\d+) ready threads: (\d+) cycles/,
+                    @output);
+for my $n (10, 100, 1000) {
+    fail "missing timing for $n ready threads\n" if !defined $cycles{$n};
+}
+fail "a yield took $cycles{1000} cycles with 1000 ready threads "
+  . "but $cycles{10} with 10\n"
+  if $cycles{1000} > 3 * $cycles{10};
+
+pass;
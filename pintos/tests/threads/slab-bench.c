@@ -0,0 +1,115 @@
+/* Allocates 4096 objects of 200 bytes, aligned to 8 bytes, from
+   an object cache with a constructor, and checks that they are
+   aligned, distinct and constructed once per slab rather than
+   once per allocation, and prints the caches' statistics.  Then
+   times allocating and freeing the objects next to malloc() and
+   free(), which round each to 256 bytes. */
+
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Objects allocated at once. */
+#define OBJ_CNT 4096
+
+/* Object size and alignment. */
+#define OBJ_SIZE 200
+#define OBJ_ALIGN 8
+
+/* Value the constructor leaves in each object's first word. */
+#define CTOR_MAGIC 0x0b1ec7
+
+static size_t ctor_cnt;
+
+static void
+ctor (void *obj)
+{
+  *(unsigned *) obj = CTOR_MAGIC;
+  ctor_cnt++;
+}
+
+void
+test_slab_bench (void)
+{
+  struct kmem_cache *c;
+  uint8_t **objs;
+  uint64_t start, cycles;
+  size_t i, round;
+
+  objs = palloc_get_multiple (PAL_ASSERT,
+                              DIV_ROUND_UP (OBJ_CNT * sizeof *objs, PGSIZE));
+  c = kmem_cache_create ("slab-bench", OBJ_SIZE, OBJ_ALIGN, ctor);
+  if (c == NULL)
+    fail ("kmem_cache_create failed");
+
+  for (i = 0; i < OBJ_CNT; i++)
+    {
+      objs[i] = kmem_cache_alloc (c);
+      if (objs[i] == NULL)
+        fail ("kmem_cache_alloc failed");
+      if ((uintptr_t) objs[i] % OBJ_ALIGN != 0)
+        fail ("object %p is not aligned", objs[i]);
+      if (*(unsigned *) objs[i] != CTOR_MAGIC)
+        fail ("object %p was not constructed", objs[i]);
+      memset (objs[i] + sizeof (unsigned), i, OBJ_SIZE - sizeof (unsigned));
+    }
+  for (i = 0; i < OBJ_CNT; i++)
+    {
+      size_t j;
+
+      for (j = sizeof (unsigned); j < OBJ_SIZE; j++)
+        if (objs[i][j] != (uint8_t) i)
+          fail ("object %zu overlaps another", i);
+    }
+  msg ("constructor ran %zu times for %d objects", ctor_cnt, OBJ_CNT);
+
+  /* Freed objects come back constructed, without another call. */
+  for (i = 0; i < OBJ_CNT; i++)
+    kmem_cache_free (c, objs[i]);
+  ctor_cnt = 0;
+  for (i = 0; i < OBJ_CNT; i++)
+    {
+      objs[i] = kmem_cache_alloc (c);
+      if (objs[i] == NULL || *(unsigned *) objs[i] != CTOR_MAGIC)
+        fail ("reused object was not constructed");
+    }
+  if (ctor_cnt != 0)
+    fail ("constructor ran again for reused objects");
+  kmem_print_stats ();
+  for (i = 0; i < OBJ_CNT; i++)
+    kmem_cache_free (c, objs[i]);
+
+  /* Time both allocators. */
+  start = rdtsc ();
+  for (round = 0; round < 4; round++)
+    {
+      for (i = 0; i < OBJ_CNT; i++)
+        objs[i] = kmem_cache_alloc (c);
+      for (i = 0; i < OBJ_CNT; i++)
+        kmem_cache_free (c, objs[i]);
+    }
+  cycles = rdtsc () - start;
+  msg ("kmem_cache_alloc and free: %llu cycles/object",
+       (unsigned long long) (cycles / (4 * OBJ_CNT)));
+
+  start = rdtsc ();
+  for (round = 0; round < 4; round++)
+    {
+      for (i = 0; i < OBJ_CNT; i++)
+        objs[i] = malloc (OBJ_SIZE);
+      for (i = 0; i < OBJ_CNT; i++)
+        free (objs[i]);
+    }
+  cycles = rdtsc () - start;
+  msg ("malloc and free: %llu cycles/object",
+       (unsigned long long) (cycles / (4 * OBJ_CNT)));
+
+  palloc_free_multiple (objs, DIV_ROUND_UP (OBJ_CNT * sizeof *objs, PGSIZE));
+  pass ();
+}
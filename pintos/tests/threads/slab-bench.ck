@@ -0,0 +1,44 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(slab-bench) PASS', @output);
+
+my ($ctor_line) = grep (/constructor ran/, @output);
+fail "missing constructor count in output\n" if !defined $ctor_line;
+my ($ctor_cnt, $obj_cnt) = $ctor_line =~ /ran (\d+) times for (\d+) objects/
+  or fail "malformed constructor count: $ctor_line\n";
+
+my ($size_line) = grep (/^Cache slab-bench: \d+-byte objects/, @output);
+fail "missing statistics for the slab-bench cache\n" if !defined $size_line;
+my ($obj_size, $per_slab) = $size_line =~ /(\d+)-byte objects, (\d+) per slab/
+  or fail "malformed cache statistics: $size_line\n";
+
+# Objects are constructed a slab at a time, when the slab is made,
+# so the constructor runs for at most one slab's worth of objects
+# beyond those allocated.
+fail "constructor ran $ctor_cnt times for $obj_cnt objects "
+  . "in slabs of $per_slab\n"
+  if $ctor_cnt < $obj_cnt || $ctor_cnt >= $obj_cnt + $per_slab;
+
+# The slabs should take less memory than malloc(), which rounds
+# each object up to a power of two.
+my ($bytes_line) = grep (/^Cache slab-bench: \d+ bytes requested/, @output);
+fail "missing memory use of the slab-bench cache\n" if !defined $bytes_line;
+my ($slab_bytes) = $bytes_line =~ /requested in (\d+) bytes of slabs/
+  or fail "malformed cache statistics: $bytes_line\n";
+my ($rounded) = 1;
+$rounded *= 2 while $rounded < $obj_size;
+fail "$obj_cnt objects took $slab_bytes bytes of slabs, "
+  . "more than the " . $obj_cnt * $rounded . " malloc() would use\n"
+  if $slab_bytes >= $obj_cnt * $rounded;
+
+pass;
@@ -0,0 +1,71 @@
+/* Runs a fixed amount of CPU-bound work split evenly across a
+   number of worker threads and reports throughput in work units
+   per tick, along with how many CPUs were online.  Run it under
+   `pintos --smp=N' for N = 1, 2, 4 to compare scaling. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define WORKER_CNT 8
+#define UNITS_PER_WORKER 32
+#define LOOPS_PER_UNIT 100000
+
+/* Shared between the test and its workers. */
+struct bench
+  {
+    struct semaphore done;      /* Upped once by each worker. */
+  };
+
+static void worker (void *);
+
+void
+test_smp_bench (void)
+{
+  struct bench bench;
+  int64_t start, elapsed;
+  int i;
+
+  sema_init (&bench.done, 0);
+  start = timer_ticks ();
+  for (i = 0; i < WORKER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "worker %d", i);
+      if (thread_create (name, PRI_DEFAULT, worker, &bench) == TID_ERROR)
+        fail ("thread_create failed at worker %d", i);
+    }
+  for (i = 0; i < WORKER_CNT; i++)
+    sema_down (&bench.done);
+  elapsed = timer_elapsed (start);
+  if (elapsed == 0)
+    elapsed = 1;
+
+  msg ("%d CPU(s) online, %d workers, %d units in %lld ticks.",
+       cpu_cnt, WORKER_CNT, WORKER_CNT * UNITS_PER_WORKER,
+       (long long) elapsed);
+  msg ("Throughput: %lld units per 100 ticks.",
+       WORKER_CNT * UNITS_PER_WORKER * 100LL / elapsed);
+  pass ();
+}
+
+/* Worker thread.  Spins through UNITS_PER_WORKER units of
+   work. */
+static void
+worker (void *bench_)
+{
+  struct bench *bench = bench_;
+  int unit;
+
+  for (unit = 0; unit < UNITS_PER_WORKER; unit++)
+    {
+      volatile int loops;
+      for (loops = 0; loops < LOOPS_PER_UNIT; loops++)
+        continue;
+    }
+  sema_up (&bench->done);
+}
@@ -0,0 +1,35 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@core) = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(smp-bench) PASS', @core);
+
+my ($line) = grep (/CPU\(s\) online/, @core);
+fail "missing CPU count in output\n" if !defined $line;
+my ($cpu_cnt, $units) = $line =~ /(\d+) CPU\(s\) online, \d+ workers, (\d+) units/
+  or fail "malformed CPU count: $line\n";
+fail "no CPU online\n" if $cpu_cnt < 1;
+fail "missing throughput in output\n"
+  unless grep (/Throughput: \d+ units per 100 ticks\./, @core);
+
+# With more than one CPU online, the kernel prints each CPU's
+# ticks at shutdown.  Work stealing should have kept every one of
+# them busy for part of the run.
+if ($cpu_cnt > 1) {
+    for my $cpu (0...$cpu_cnt - 1) {
+        my ($stats) = grep (/^CPU $cpu: /, @output);
+        fail "missing statistics for CPU $cpu\n" if !defined $stats;
+        my ($kernel) = $stats =~ /(\d+) kernel ticks/;
+        fail "CPU $cpu never ran a thread\n" if !$kernel;
+    }
+}
+
+pass;
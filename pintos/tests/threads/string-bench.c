@@ -0,0 +1,167 @@
+/* Measures memcpy, memmove, memset and memcmp throughput on 64
+   byte, 512 byte and 4 kB blocks, next to a byte-at-a-time copy
+   loop like the one they replaced, and reports each in GB/s.
+   The TSC rate is calibrated against the timer first.  Also
+   checks the results of each function, including overlapping
+   memmove in both directions and unaligned blocks. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#include "intrinsic.h"
+
+/* Bytes processed per measurement. */
+#define TOTAL_BYTES (8 * 1024 * 1024)
+
+static uint64_t tsc_hz;
+
+static void calibrate (void);
+static void check (uint8_t *a, uint8_t *b);
+static void measure (size_t size, uint8_t *dst, uint8_t *src);
+static void report (const char *name, size_t size, uint64_t cycles);
+
+void
+test_string_bench (void)
+{
+  uint8_t *dst = palloc_get_page (PAL_ASSERT);
+  uint8_t *src = palloc_get_page (PAL_ASSERT);
+
+  check (dst, src);
+  calibrate ();
+  measure (64, dst, src);
+  measure (512, dst, src);
+  measure (4096, dst, src);
+
+  palloc_free_page (src);
+  palloc_free_page (dst);
+  pass ();
+}
+
+/* Copies SIZE bytes from SRC to DST one byte at a time, as
+   memcpy() used to. */
+static void
+byte_copy (uint8_t *dst, const uint8_t *src, size_t size)
+{
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+/* Checks the block functions against byte_copy() on pages A and
+   B, across a spread of sizes and alignments. */
+static void
+check (uint8_t *a, uint8_t *b)
+{
+  static uint8_t expect[PGSIZE];
+  size_t size, ofs, i;
+
+  for (size = 0; size <= 1100; size += size < 20 ? 1 : 97)
+    for (ofs = 0; ofs < 8; ofs++)
+      {
+        for (i = 0; i < PGSIZE; i++)
+          b[i] = i * 7 + 3;
+
+        memset (a, 0, PGSIZE);
+        memcpy (a + ofs, b + 3, size);
+        if (memcmp (a + ofs, b + 3, size) != 0)
+          fail ("memcpy of %zu bytes at offset %zu wrong", size, ofs);
+        if (size > 0)
+          {
+            a[ofs + size - 1]++;
+            if (memcmp (a + ofs, b + 3, size) == 0)
+              fail ("memcmp of %zu bytes missed last byte", size);
+          }
+
+        /* Overlapping moves, up and down. */
+        memcpy (expect, b, PGSIZE);
+        for (i = size; i-- > 0; )
+          expect[ofs + 5 + i] = expect[ofs + i];
+        memmove (b + ofs + 5, b + ofs, size);
+        if (memcmp (b, expect, PGSIZE) != 0)
+          fail ("memmove up of %zu bytes at offset %zu wrong", size, ofs);
+        for (i = 0; i < size; i++)
+          expect[ofs + i] = expect[ofs + 5 + i];
+        memmove (b + ofs, b + ofs + 5, size);
+        if (memcmp (b, expect, PGSIZE) != 0)
+          fail ("memmove down of %zu bytes at offset %zu wrong", size, ofs);
+
+        memset (a, 0x5a, PGSIZE);
+        memset (a + ofs, 0xa5, size);
+        for (i = 0; i < PGSIZE; i++)
+          if (a[i] != (i >= ofs && i < ofs + size ? 0xa5 : 0x5a))
+            fail ("memset of %zu bytes at offset %zu wrong", size, ofs);
+      }
+  msg ("block functions agree with byte loops.");
+}
+
+/* Sets tsc_hz to the TSC rate, measured over 10 timer ticks. */
+static void
+calibrate (void)
+{
+  int64_t start_ticks;
+  uint64_t start;
+
+  start_ticks = timer_ticks ();
+  while (timer_ticks () == start_ticks)
+    continue;
+  start_ticks = timer_ticks ();
+  start = rdtsc ();
+  timer_sleep (10);
+  tsc_hz = (rdtsc () - start) * TIMER_FREQ / timer_elapsed (start_ticks);
+}
+
+/* Times each function on SIZE-byte blocks between DST and
+   SRC. */
+static void
+measure (size_t size, uint8_t *dst, uint8_t *src)
+{
+  size_t reps = TOTAL_BYTES / size;
+  volatile int sink = 0;
+  uint64_t start;
+  size_t i;
+
+  memset (src, 0x11, PGSIZE);
+
+  start = rdtsc ();
+  for (i = 0; i < reps; i++)
+    byte_copy (dst, src, size);
+  report ("byte loop", size, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < reps; i++)
+    memcpy (dst, src, size);
+  report ("memcpy", size, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < reps; i++)
+    memmove (dst, src, size);
+  report ("memmove", size, rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = 0; i < reps; i++)
+    memset (dst, i, size);
+  report ("memset", size, rdtsc () - start);
+
+  memcpy (dst, src, size);
+  start = rdtsc ();
+  for (i = 0; i < reps; i++)
+    sink += memcmp (dst, src, size);
+  report ("memcmp", size, rdtsc () - start);
+}
+
+/* Reports the throughput of NAME, which processed TOTAL_BYTES
+   in SIZE-byte blocks in CYCLES TSC cycles. */
+static void
+report (const char *name, size_t size, uint64_t cycles)
+{
+  /* Hundredths of a GB/s. */
+  uint64_t centi_gbps = cycles > 0
+    ? (uint64_t) TOTAL_BYTES * tsc_hz / cycles / 10000000
+    : 0;
+
+  msg ("%-9s %4zu B: %llu.%02llu GB/s", name, size,
+       (unsigned long long) (centi_gbps / 100),
+       (unsigned long long) (centi_gbps % 100));
+}
@@ -0,0 +1,37 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(string-bench) PASS', @output);
+fail "missing check of results in output"
+  unless grep ($_ eq '(string-bench) block functions agree with byte loops.',
+               @output);
+
+# Each block function, working a word or more at a time, should
+# beat the byte loop on blocks of 512 bytes and up.
+my (%gbps);
+for (@output) {
+    my ($name, $size, $rate) = /^\(string-bench\) (.+?)\s+(\d+) B: (\d+\.\d+) GB\/s$/
+      or next;
+    $gbps{"$name/$size"} = $rate;
+}
+for my $size (512, 4096) {
+    my ($loop) = $gbps{"byte loop/$size"};
+    fail "missing byte loop rate for $size B\n" if !defined $loop;
+    for my $name ('memcpy', 'memmove', 'memset', 'memcmp') {
+        my ($rate) = $gbps{"$name/$size"};
+        fail "missing $name rate for $size B\n" if !defined $rate;
+        fail "$name ran at $rate GB/s on $size B, the byte loop at $loop\n"
+          if $rate <= $loop;
+    }
+}
+
+pass;
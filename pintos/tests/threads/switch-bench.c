@@ -0,0 +1,60 @@
+/* Measures a context switch between two kernel threads that hand
+   control back and forth with a pair of semaphores.  Neither
+   thread has an address space of its own, so the switch no
+   longer reloads CR3 or flushes the TLB. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+#define ROUND_TRIPS 10000
+
+struct ping_pong
+  {
+    struct semaphore ping;
+    struct semaphore pong;
+  };
+
+static void ponger (void *);
+
+void
+test_switch_bench (void)
+{
+  struct ping_pong pp;
+  uint64_t start, cycles;
+  int i;
+
+  sema_init (&pp.ping, 0);
+  sema_init (&pp.pong, 0);
+  if (thread_create ("ponger", PRI_DEFAULT, ponger, &pp) == TID_ERROR)
+    fail ("thread_create failed");
+
+  start = rdtsc ();
+  for (i = 0; i < ROUND_TRIPS; i++)
+    {
+      sema_up (&pp.ping);
+      sema_down (&pp.pong);
+    }
+  cycles = rdtsc () - start;
+
+  msg ("%d round trips: %llu cycles per switch.", ROUND_TRIPS,
+       (unsigned long long) (cycles / (2 * ROUND_TRIPS)));
+  pass ();
+}
+
+/* Answers each ping with a pong. */
+static void
+ponger (void *pp_)
+{
+  struct ping_pong *pp = pp_;
+  int i;
+
+  for (i = 0; i < ROUND_TRIPS; i++)
+    {
+      sema_down (&pp->ping);
+      sema_up (&pp->pong);
+    }
+}
@@ -0,0 +1,32 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@core) = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(switch-bench) PASS', @core);
+
+my ($line) = grep (/round trips:/, @core);
+fail "missing timing in output\n" if !defined $line;
+my ($trips) = $line =~ /(\d+) round trips: \d+ cycles per switch/
+  or fail "malformed timing: $line\n";
+
+# Kernels with user programs print their page map loads at
+# shutdown.  Every switch between the two threads, which share the
+# kernel's page map, should have skipped the reload.
+my ($maps) = grep (/^Page maps:/, @output);
+if (defined $maps) {
+    my ($skipped) = $maps =~ /(\d+) switches skipped/
+      or fail "malformed page map statistics: $maps\n";
+    fail "only $skipped page map loads skipped for "
+      . 2 * $trips . " switches\n"
+      if $skipped < 2 * $trips;
+}
+
+pass;
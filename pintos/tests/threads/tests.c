@@ -17,6 +17,7 @@ static const struct test tests[] =
     {"alarm-priority", test_alarm_priority},
     {"alarm-zero", test_alarm_zero},
     {"alarm-negative", test_alarm_negative},
+    {"alarm-bench", test_alarm_bench},
     {"priority-change", test_priority_change},
     {"priority-donate-one", test_priority_donate_one},
     {"priority-donate-multiple", test_priority_donate_multiple},
@@ -29,6 +30,17 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"sched-bench", test_sched_bench},
+    {"smp-bench", test_smp_bench},
+    {"disk-bench", test_disk_bench},
+    {"string-bench", test_string_bench},
+    {"tlb-bench", test_tlb_bench},
+    {"tlb-bench-4k", test_tlb_bench},
+    {"switch-bench", test_switch_bench},
+    {"palloc-bench", test_palloc_bench},
+    {"bitmap-bench", test_bitmap_bench},
+    {"slab-bench", test_slab_bench},
+    {"malloc-frag", test_malloc_frag},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
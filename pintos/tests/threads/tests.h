@@ -11,6 +11,7 @@ extern test_func test_alarm_simultaneous;
 extern test_func test_alarm_priority;
 extern test_func test_alarm_zero;
 extern test_func test_alarm_negative;
+extern test_func test_alarm_bench;
 extern test_func test_priority_change;
 extern test_func test_priority_donate_one;
 extern test_func test_priority_donate_multiple;
@@ -23,6 +24,16 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_sched_bench;
+extern test_func test_smp_bench;
+extern test_func test_disk_bench;
+extern test_func test_string_bench;
+extern test_func test_tlb_bench;
+extern test_func test_switch_bench;
+extern test_func test_palloc_bench;
+extern test_func test_bitmap_bench;
+extern test_func test_slab_bench;
+extern test_func test_malloc_frag;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
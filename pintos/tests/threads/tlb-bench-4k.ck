@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(tlb-bench-4k) PASS', @output);
+
+# The kernel maps its memory with 4 kB pages with -no-large-pages.
+fail "kernel memory not mapped with 4 kB pages"
+  unless grep ($_ eq '(tlb-bench-4k) kernel memory mapped with 4 kB pages', @output);
+fail "missing timings in output"
+  unless grep (/random reads over\s+\d+ MB: \d+\.\d+ cycles each/, @output) == 2;
+
+pass;
@@ -0,0 +1,74 @@
+/* Times random word reads spread over 64 MB of the kernel's
+   direct map of physical memory, where nearly every read needs a
+   TLB entry the TLB does not hold, next to the same reads
+   confined to 2 MB.  The direct map uses 2 MB pages unless the
+   kernel runs with -no-large-pages, as tlb-bench-4k does, so the
+   outputs of the two tests compare the mappings. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Bytes of memory read at random. */
+#define SPAN (64 * 1024 * 1024)
+
+/* Reads per measurement. */
+#define READS (1024 * 1024)
+
+static uint64_t measure (size_t span);
+static void report (size_t span, uint64_t cycles);
+
+void
+test_tlb_bench (void)
+{
+  size_t span = SPAN;
+
+  /* Stay within memory, in a power of two. */
+  while (span > LARGE_PGSIZE && span > ram_pages * PGSIZE)
+    span /= 2;
+
+  msg ("kernel memory mapped with %s pages",
+       kernel_large_pages ? "2 MB" : "4 kB");
+  measure (span);
+  report (LARGE_PGSIZE, measure (LARGE_PGSIZE));
+  report (span, measure (span));
+  pass ();
+}
+
+/* Returns the TSC cycles taken by READS reads of words at
+   random in the first SPAN bytes of physical memory.  SPAN must
+   be a power of two. */
+static uint64_t
+measure (size_t span)
+{
+  const uint8_t *base = ptov (0);
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  volatile uint64_t sink = 0;
+  uint64_t start;
+  size_t i;
+
+  start = rdtsc ();
+  for (i = 0; i < READS; i++)
+    {
+      /* xorshift64, cheap next to a TLB miss. */
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      sink += *(const uint64_t *) (base + (state & (span - 1) & ~7ULL));
+    }
+  return rdtsc () - start;
+}
+
+/* Reports CYCLES, taken by READS reads over SPAN bytes. */
+static void
+report (size_t span, uint64_t cycles)
+{
+  uint64_t centi = cycles * 100 / READS;
+
+  msg ("random reads over %2zu MB: %llu.%02llu cycles each",
+       span / (1024 * 1024), (unsigned long long) (centi / 100),
+       (unsigned long long) (centi % 100));
+}
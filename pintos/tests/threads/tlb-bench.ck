@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(tlb-bench) PASS', @output);
+
+# The kernel maps its memory with 2 MB pages by default.
+fail "kernel memory not mapped with 2 MB pages"
+  unless grep ($_ eq '(tlb-bench) kernel memory mapped with 2 MB pages', @output);
+fail "missing timings in output"
+  unless grep (/random reads over\s+\d+ MB: \d+\.\d+ cycles each/, @output) == 2;
+
+pass;
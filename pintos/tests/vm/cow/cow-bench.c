@@ -0,0 +1,70 @@
+/* Measures fork() latency against the size of the parent.
+
+   The parent dirties a growing prefix of a large array, forks a
+   child that exits at once, and reports the cycles fork() took.
+   It then reports the cycles it spends writing the same pages
+   again, each of which takes a write-protect fault now that the
+   child is gone.  With copy-on-write, fork() copies page table
+   entries rather than pages, so its cost should grow far more
+   slowly than the size of the process. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define MAX_PAGES 1024
+#define REPEAT 4
+
+static char buf[MAX_PAGES * PAGE_SIZE];
+
+/* Writes VALUE to each of the first PAGES pages of BUF. */
+static void
+touch (size_t pages, char value)
+{
+  size_t i;
+
+  for (i = 0; i < pages; i++)
+    buf[i * PAGE_SIZE] = value;
+}
+
+void
+test_main (void)
+{
+  static const size_t sizes[] = {0, 16, 64, 256, 1024};
+  size_t i;
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      uint64_t best_fork = UINT64_MAX, best_write = UINT64_MAX;
+      int r;
+
+      for (r = 0; r < REPEAT; r++)
+        {
+          uint64_t start, cycles;
+          pid_t child;
+
+          touch (sizes[i], 1);
+
+          start = rdtsc ();
+          child = fork ("child");
+          if (child == 0)
+            exit (0);
+          cycles = rdtsc () - start;
+          if (cycles < best_fork)
+            best_fork = cycles;
+          if (child < 0 || wait (child) != 0)
+            fail ("fork of %zu pages failed", sizes[i]);
+
+          start = rdtsc ();
+          touch (sizes[i], 2);
+          cycles = rdtsc () - start;
+          if (cycles < best_write)
+            best_write = cycles;
+        }
+      msg ("%4zu pages: fork %llu cycles, rewrite %llu cycles",
+           sizes[i], (unsigned long long) best_fork,
+           (unsigned long long) best_write);
+    }
+}
@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing end in output"
+  unless grep ($_ eq '(cow-bench) end', @output);
+
+my (%fork);
+for (@output) {
+    my ($pages, $cycles) = /^\(cow-bench\)\s+(\d+) pages: fork (\d+) cycles, rewrite \d+ cycles$/
+      or next;
+    $fork{$pages} = $cycles;
+}
+for my $pages (0, 16, 64, 256, 1024) {
+    fail "missing timing for $pages pages\n" if !defined $fork{$pages};
+}
+
+# fork() copies page table entries rather than pages, so a process
+# 64 times as large should fork in far less than 64 times as long.
+fail "fork took $fork{1024} cycles at 1024 pages "
+  . "but $fork{16} at 16 pages\n"
+  if $fork{1024} > 16 * $fork{16};
+
+pass;
@@ -0,0 +1,66 @@
+/* Forks children that write to 0, 64 and 1024 pages of a BSS
+   array and exit at once, and reports, for each size, the cycles
+   from fork() to the end of wait() and the latency of the exit
+   alone: from the child's call to exit() until wait() returns in
+   the parent, which covers tearing down the child's address space
+   and switching back.  The child passes the time of its exit
+   through its exit status.  The kernel's "Page maps:" line at
+   shutdown shows how many address-space switches reloaded CR3
+   and flushed the TLB. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ARRAY_PAGES 1024
+#define ROUNDS 8
+
+/* The exit time is passed in units of 1 << TIME_SHIFT cycles, so
+   that it fits an exit status. */
+#define TIME_SHIFT 4
+#define TIME_MASK 0x7fffffff
+
+static char array[ARRAY_PAGES * PAGE_SIZE];
+
+static void
+measure (size_t page_cnt)
+{
+  uint64_t total = 0, exit_total = 0;
+  int round;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      uint64_t start = rdtsc ();
+      pid_t pid = fork ("child");
+      int status;
+
+      if (pid == 0)
+        {
+          size_t i;
+
+          for (i = 0; i < page_cnt; i++)
+            array[i * PAGE_SIZE] = 1;
+          exit ((rdtsc () >> TIME_SHIFT) & TIME_MASK);
+        }
+      if (pid < 0)
+        fail ("fork failed");
+      status = wait (pid);
+      exit_total += ((((rdtsc () >> TIME_SHIFT) - status) & TIME_MASK)
+                     << TIME_SHIFT);
+      total += rdtsc () - start;
+    }
+
+  msg ("%4zu pages: fork to wait %llu cycles, exit %llu cycles", page_cnt,
+       (unsigned long long) (total / ROUNDS),
+       (unsigned long long) (exit_total / ROUNDS));
+}
+
+void
+test_main (void)
+{
+  measure (0);
+  measure (64);
+  measure (ARRAY_PAGES);
+}
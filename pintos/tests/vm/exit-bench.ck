@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@core) = get_core_output ("run", @output);
+fail "missing end in output"
+  unless grep ($_ eq '(exit-bench) end', @core);
+for my $pages (0, 64, 1024) {
+    fail "missing timing for $pages pages\n"
+      unless grep (/^\(exit-bench\)\s+$pages pages: fork to wait \d+ cycles, exit \d+ cycles$/, @core);
+}
+
+# With PCIDs, switching back to an address space keeps its TLB
+# entries, so fewer loads of a page map flush the TLB than not.
+my ($maps) = grep (/^Page maps:/, @output);
+fail "missing page map statistics in output\n" if !defined $maps;
+my ($loads, $flushes, $pcids)
+  = $maps =~ /(\d+) loads, (\d+) of them flushing the TLB, .*PCIDs (on|off)/
+  or fail "malformed page map statistics: $maps\n";
+fail "all $loads page map loads flushed the TLB\n"
+  if $pcids eq 'on' && $flushes >= $loads;
+
+pass;
@@ -0,0 +1,84 @@
+/* Measures mmap() read latency when 8 processes map the same
+   4 MB file.
+
+   The parent writes the file, maps it and reads every page, each
+   of which has to come from the file.  Seven children in turn
+   then map the file again and read it while the parent's mapping
+   keeps it in memory.  With frames shared by (inode, offset), the
+   children's faults only map frames that are already there, and
+   the kernel's "Mapped files" statistics at shutdown show the
+   file taking about 1,024 frames rather than one set per
+   process. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define FILE_PAGES 1024
+#define CHILD_CNT 7
+
+static char page[PAGE_SIZE];
+
+/* Maps the file open as HANDLE at ADDR, reads a byte of every
+   page, checks it, and returns the cycles per page the reads
+   took. */
+static uint64_t
+map_and_read (int handle, char *addr)
+{
+  uint64_t start, cycles;
+  int sum = 0;
+  size_t i;
+
+  if (mmap (addr, FILE_PAGES * PAGE_SIZE, 0, handle, 0) != addr)
+    fail ("mmap of \"data\" failed");
+  start = rdtsc ();
+  for (i = 0; i < FILE_PAGES; i++)
+    sum += addr[i * PAGE_SIZE];
+  cycles = rdtsc () - start;
+
+  for (i = 0; i < FILE_PAGES; i++)
+    if (addr[i * PAGE_SIZE] != (char) i)
+      fail ("page %zu of mapping has wrong contents", i);
+  (void) sum;
+  return cycles / FILE_PAGES;
+}
+
+void
+test_main (void)
+{
+  char *parent_map = (char *) 0x10000000;
+  char *child_map = (char *) 0x20000000;
+  int handle;
+  size_t i;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  for (i = 0; i < FILE_PAGES; i++)
+    {
+      memset (page, (char) i, PAGE_SIZE);
+      if (write (handle, page, PAGE_SIZE) != PAGE_SIZE)
+        fail ("write of page %zu failed", i);
+    }
+
+  msg ("process 0: %llu cycles/page",
+       (unsigned long long) map_and_read (handle, parent_map));
+
+  for (i = 1; i <= CHILD_CNT; i++)
+    {
+      pid_t child = fork ("child");
+
+      if (child == 0)
+        {
+          msg ("process %zu: %llu cycles/page", i,
+               (unsigned long long) map_and_read (handle, child_map));
+          munmap (child_map);
+          exit (0);
+        }
+      if (child < 0 || wait (child) != 0)
+        fail ("child %zu failed", i);
+    }
+  munmap (parent_map);
+}
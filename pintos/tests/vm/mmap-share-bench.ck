@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@core) = get_core_output ("run", @output);
+fail "missing end in output"
+  unless grep ($_ eq '(mmap-share-bench) end', @core);
+for my $i (0...7) {
+    fail "missing timing for process $i\n"
+      unless grep (/^\(mmap-share-bench\) process $i: \d+ cycles\/page$/, @core);
+}
+
+# Eight processes map the same 1,024-page file.  With frames
+# shared by inode and offset, the file takes about 1,024 frames,
+# not 8,192, and the children's faults map frames already there.
+my ($stats) = grep (/^Mapped files:/, @output);
+fail "missing mapped file statistics in output\n" if !defined $stats;
+my ($read, $shared, $peak)
+  = $stats =~ /(\d+) pages read, (\d+) faults served by shared frames, (\d+) frames at peak/
+  or fail "malformed mapped file statistics: $stats\n";
+fail "the file took $peak frames at peak\n" if $peak > 1024;
+fail "$read pages read from the file\n" if $read > 2 * 1024;
+fail "only $shared faults served by shared frames\n" if $shared < 1024;
+
+pass;
@@ -0,0 +1,56 @@
+/* Measures the cost of a page fault in a process with 100,000
+   pages mapped.
+
+   The uninitialized data segment below gives the process 100,000
+   lazily allocated pages, so every fault looks its page up in a
+   supplemental page table of that size.  The test touches a
+   sample of the pages spread across the whole segment, each of
+   which faults, and then touches them again, which does not, and
+   reports the cycles per page of each pass.  The difference is
+   the cost of handling one fault. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define MAPPED_PAGES 100000
+#define TOUCHED_PAGES 4096
+#define STRIDE (MAPPED_PAGES / TOUCHED_PAGES)
+
+static char buf[MAPPED_PAGES * PAGE_SIZE];
+
+/* Writes VALUE to every STRIDE'th page of BUF and returns the
+   cycles taken. */
+static uint64_t
+touch (char value)
+{
+  uint64_t start = rdtsc ();
+  size_t i;
+
+  for (i = 0; i < TOUCHED_PAGES; i++)
+    buf[i * STRIDE * PAGE_SIZE] = value;
+  return rdtsc () - start;
+}
+
+void
+test_main (void)
+{
+  uint64_t fault_cycles, hit_cycles;
+  size_t i;
+
+  fault_cycles = touch (1);
+  hit_cycles = touch (2);
+  for (i = 0; i < TOUCHED_PAGES; i++)
+    if (buf[i * STRIDE * PAGE_SIZE] != 2)
+      fail ("page %zu has wrong contents", i * STRIDE);
+
+  msg ("%d pages mapped, %d touched", MAPPED_PAGES, TOUCHED_PAGES);
+  msg ("first touch: %llu cycles/page",
+       (unsigned long long) (fault_cycles / TOUCHED_PAGES));
+  msg ("second touch: %llu cycles/page",
+       (unsigned long long) (hit_cycles / TOUCHED_PAGES));
+  msg ("fault handling: %llu cycles/fault",
+       (unsigned long long) ((fault_cycles - hit_cycles) / TOUCHED_PAGES));
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing end in output"
+  unless grep ($_ eq '(spt-bench) end', @output);
+fail "missing page counts in output"
+  unless grep ($_ eq '(spt-bench) 100000 pages mapped, 4096 touched', @output);
+
+# The first touch of each page faults and the second does not.
+my ($first) = map (/^\(spt-bench\) first touch: (\d+) cycles\/page$/, @output);
+my ($second) = map (/^\(spt-bench\) second touch: (\d+) cycles\/page$/, @output);
+fail "missing timings in output\n" if !defined $first || !defined $second;
+fail "first touch took $first cycles/page, second $second\n"
+  if $first <= $second;
+fail "missing fault cost in output\n"
+  unless grep (/^\(spt-bench\) fault handling: \d+ cycles\/fault$/, @output);
+
+pass;
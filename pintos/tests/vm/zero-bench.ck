@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing end in output"
+  unless grep ($_ eq '(zero-bench) end', @output);
+
+# Run with -vmstat, the kernel reports the process's pages as it
+# exits.  Of the 1,024 pages of the array, only the 16 written
+# should have frames; reads of the rest map the zero page.
+my ($line) = grep (/^zero-bench: \d+ pages mapped/, @output);
+fail "missing page counts in output\n" if !defined $line;
+my ($mapped, $resident, $zero)
+  = $line =~ /(\d+) pages mapped, (\d+) resident, (\d+) on the zero page/
+  or fail "malformed page counts: $line\n";
+fail "$resident of $mapped pages resident\n" if $resident * 4 > $mapped;
+fail "only $zero pages on the zero page\n" if $zero < 1024 - 16;
+
+pass;
@@ -0,0 +1,67 @@
+/* Pages through an array larger than user memory, with the
+   compressed swap pool enabled.
+
+   The array's pages are half zeros and half a short repeating
+   pattern, so they compress well.  The test writes every page,
+   then reads them all back twice, checking them, and reports the
+   cycles per page of each pass.  Evicted pages go to the
+   compressed pool first and spill to the swap disk from there;
+   the kernel's statistics at shutdown give the compression ratio
+   and the fault latency of each tier. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ARRAY_PAGES 2048
+
+static char array[ARRAY_PAGES * PAGE_SIZE];
+
+/* Fills page I of ARRAY with its pattern. */
+static void
+fill (size_t i)
+{
+  char *p = array + i * PAGE_SIZE;
+  size_t j;
+
+  for (j = 0; j < PAGE_SIZE / 2; j++)
+    p[j] = (char) (i + j % 16);
+}
+
+/* Checks page I of ARRAY against its pattern. */
+static void
+check (size_t i)
+{
+  const char *p = array + i * PAGE_SIZE;
+  size_t j;
+
+  for (j = 0; j < PAGE_SIZE; j++)
+    if (p[j] != (j < PAGE_SIZE / 2 ? (char) (i + j % 16) : 0))
+      fail ("byte %zu of page %zu is wrong", j, i);
+}
+
+void
+test_main (void)
+{
+  uint64_t start;
+  size_t i;
+  int pass;
+
+  start = rdtsc ();
+  for (i = 0; i < ARRAY_PAGES; i++)
+    fill (i);
+  msg ("write: %llu cycles/page",
+       (unsigned long long) ((rdtsc () - start) / ARRAY_PAGES));
+
+  for (pass = 1; pass <= 2; pass++)
+    {
+      start = rdtsc ();
+      for (i = 0; i < ARRAY_PAGES; i++)
+        check (i);
+      msg ("read pass %d: %llu cycles/page", pass,
+           (unsigned long long) ((rdtsc () - start) / ARRAY_PAGES));
+    }
+}
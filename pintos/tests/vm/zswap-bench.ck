@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@core) = get_core_output ("run", @output);
+fail "missing end in output"
+  unless grep ($_ eq '(zswap-bench) end', @core);
+
+# The array does not fit in memory, so its pages go through the
+# compressed pool.  They are half zeros and half a short pattern,
+# so they should compress to half their size or better, and faults
+# should find some of them there.
+my ($stored_line) = grep (/^Compressed swap: \d+ pages stored/, @output);
+fail "missing compressed swap statistics in output\n"
+  if !defined $stored_line;
+my ($stored, $ratio) = $stored_line =~ /(\d+) pages stored at (\d+\.\d+):1/
+  or fail "no pages compressed: $stored_line\n";
+fail "pages compressed only $ratio:1\n" if $ratio < 2;
+
+my ($in_line) = grep (/^Compressed swap: \d+ pages in/, @output);
+fail "missing compressed swap faults in output\n" if !defined $in_line;
+my ($in) = $in_line =~ /(\d+) pages in/;
+fail "no fault found its page in the compressed pool\n" if $in == 0;
+
+pass;
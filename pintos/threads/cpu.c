@@ -0,0 +1,330 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/lapic.h"
+#include "threads/loader.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/syscall.h"
+#include "userprog/tss.h"
+#endif
+
+/* CPUID.01H:EDX bit indicating an on-chip local APIC. */
+#define CPUID_EDX_APIC (1 << 9)
+
+/* Per-CPU state, indexed by logical CPU number.  CPU 0 is the
+   bootstrap processor (BSP). */
+struct cpu cpus[NCPU_MAX];
+
+/* Number of CPUs in cpus[] that have been brought up. */
+int cpu_cnt = 1;
+
+/* MultiProcessor Specification tables, through which the
+   firmware lists the processors.  See [MP] chapter 4. */
+struct mp_fp {                  /* Floating pointer structure. */
+	char signature[4];          /* "_MP_". */
+	uint32_t config;            /* Physical address of mp_config. */
+	uint8_t length;             /* In 16-byte units. */
+	uint8_t revision;
+	uint8_t checksum;           /* All bytes sum to 0. */
+	uint8_t type;               /* 0 if mp_config is present. */
+	uint8_t features[4];
+} __attribute__((packed));
+
+struct mp_config {              /* Configuration table header. */
+	char signature[4];          /* "PCMP". */
+	uint16_t length;            /* Bytes, including entries. */
+	uint8_t revision;
+	uint8_t checksum;           /* All bytes sum to 0. */
+	char product[20];
+	uint32_t oem_table;
+	uint16_t oem_length;
+	uint16_t entry_cnt;         /* Entries following the header. */
+	uint32_t lapic_addr;        /* Physical address of local APICs. */
+	uint16_t ext_length;
+	uint8_t ext_checksum;
+	uint8_t reserved;
+} __attribute__((packed));
+
+#define MP_PROC 0               /* Processor entry; others are 8 bytes. */
+struct mp_proc {                /* Processor entry. */
+	uint8_t type;               /* MP_PROC. */
+	uint8_t lapic_id;
+	uint8_t lapic_version;
+	uint8_t flags;              /* MP_PROC_* below. */
+	uint8_t signature[4];
+	uint32_t features;
+	uint8_t reserved[8];
+} __attribute__((packed));
+#define MP_PROC_ENABLED 0x01    /* Usable. */
+#define MP_PROC_BSP 0x02        /* The bootstrap processor. */
+
+/* Milliseconds to wait for an AP to come online. */
+#define AP_START_MS 100
+
+static void cpu_setup (struct cpu *, int id, uint32_t lapic_id);
+static uint32_t cpuid_lapic_id (void);
+static struct mp_config *mp_find (void);
+static intr_handler_func lapic_timer_interrupt;
+static intr_handler_func resched_interrupt;
+
+void ap_main (void) NO_RETURN;
+
+/* Initializes the per-CPU state of the BSP.  Must be called
+   before thread_init(), since the scheduler's run queues live
+   in struct cpu.  Application processors are started later, by
+   cpu_start_aps(). */
+void
+cpu_init (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	cpu_setup (&cpus[0], 0, cpu_has_lapic () ? cpuid_lapic_id () : 0);
+	cpus[0].online = true;
+	cpu_cnt = 1;
+}
+
+/* Starts the application processors listed in the firmware's MP
+   tables, one at a time, and waits for each to begin scheduling
+   threads.  Leaves the kernel running on the BSP alone if there
+   are none.  Must be called with interrupts on, once the timer
+   is calibrated. */
+void
+cpu_start_aps (void) {
+	extern char ap_start[], ap_end[], ap_cr3[], ap_stack[];
+	extern uint64_t boot_pml4e[];
+	uint32_t ap_ids[NCPU_MAX - 1];
+	struct mp_config *conf;
+	uint8_t *entry;
+	uint64_t *pml4;
+	uint8_t *tramp;
+	int ap_cnt = 0;
+	int i;
+
+	ASSERT (intr_get_level () == INTR_ON);
+	ASSERT (cpu_cnt == 1);
+
+	if (!cpu_has_lapic () || (conf = mp_find ()) == NULL)
+		return;
+	entry = (uint8_t *) (conf + 1);
+	for (i = 0; i < conf->entry_cnt; i++) {
+		struct mp_proc *proc = (struct mp_proc *) entry;
+
+		if (proc->type != MP_PROC) {
+			entry += 8;
+			continue;
+		}
+		if ((proc->flags & MP_PROC_ENABLED) && !(proc->flags & MP_PROC_BSP)
+				&& ap_cnt < NCPU_MAX - 1)
+			ap_ids[ap_cnt++] = proc->lapic_id;
+		entry += sizeof *proc;
+	}
+	if (ap_cnt == 0)
+		return;
+
+	lapic_map (conf->lapic_addr);
+	lapic_init ();
+	cpus[0].lapic_id = lapic_id ();
+	lapic_calibrate_timer ();
+	intr_register_ext (LAPIC_TIMER_VEC, lapic_timer_interrupt, "LAPIC Timer");
+	intr_register_ext (LAPIC_RESCHED_VEC, resched_interrupt, "Reschedule IPI");
+	pml4_init_shootdown ();
+
+	/* The APs turn on paging with the trampoline still in use, so
+	   they start on a copy of base_pml4 that also identity-maps
+	   low memory as start.S's page map does.  Its physical address
+	   must fit ap_cr3. */
+	pml4 = palloc_get_page (PAL_ASSERT);
+	memcpy (pml4, base_pml4, PGSIZE);
+	pml4[0] = boot_pml4e[0];
+	ASSERT (vtop (pml4) < 0x100000000ULL);
+
+	tramp = ptov (AP_TRAMPOLINE);
+	memcpy (tramp, ap_start, ap_end - ap_start);
+	*(uint32_t *) (tramp + (ap_cr3 - ap_start)) = vtop (pml4);
+
+	for (i = 0; i < ap_cnt; i++) {
+		struct cpu *c = &cpus[cpu_cnt];
+		struct thread *idle;
+		int ms;
+
+		cpu_setup (c, cpu_cnt, ap_ids[i]);
+		idle = thread_create_idle (c);
+		*(uint64_t *) (tramp + (ap_stack - ap_start)) =
+			(uint64_t) idle + PGSIZE;
+		cpu_cnt++;
+
+		lapic_start_ap (c->lapic_id, AP_TRAMPOLINE);
+		for (ms = 0; ms < AP_START_MS && !c->online; ms++) {
+			timer_msleep (1);
+			barrier ();
+		}
+		if (!c->online) {
+			/* It may yet start on the trampoline page map, so that
+			   is not freed. */
+			printf ("CPU %d (local APIC %u) did not start.\n",
+					c->id, c->lapic_id);
+			cpu_cnt--;
+			return;
+		}
+	}
+	palloc_free_page (pml4);
+	printf ("%d CPUs online.\n", cpu_cnt);
+}
+
+/* Entered from threads/ap-start.S on the idle thread's stack, with
+   the trampoline's page map and GDT.  Sets up the AP as the BSP
+   was set up in main(), then starts running threads. */
+void
+ap_main (void) {
+	pml4_init_ap ();
+#ifdef USERPROG
+	tss_init ();
+	gdt_init ();
+#endif
+	intr_init_ap ();
+#ifdef USERPROG
+	syscall_init ();
+#endif
+	lapic_init ();
+	lapic_timer_start ();
+	thread_start_ap ();
+}
+
+/* Returns the CPU that the caller is running on.  The caller
+   should have interrupts off, or it may migrate and the result
+   may be stale by the time it is used.
+
+   Called on every lock, allocation and interrupt, so it reads
+   the running thread's RUNNING_CPU, which schedule() sets as it
+   switches to the thread, rather than the local APIC.  The
+   thread is found from the stack pointer, like running_thread()
+   in thread.c, since thread_current() insists that the thread be
+   THREAD_RUNNING, which it is not inside schedule().  Until APs
+   are started, the only CPU is the BSP, whose first thread may
+   not be set up yet. */
+struct cpu *
+cpu_current (void) {
+	struct thread *t;
+
+	if (cpu_cnt == 1)
+		return &cpus[0];
+
+	t = pg_round_down (rrsp ());
+	ASSERT (t->running_cpu != NULL);
+	return t->running_cpu;
+}
+
+/* Returns true if the processor has a local APIC. */
+bool
+cpu_has_lapic (void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	return (edx & CPUID_EDX_APIC) != 0;
+}
+
+/* Initializes C as CPU number ID, with local APIC LAPIC_ID and
+   empty run queues. */
+static void
+cpu_setup (struct cpu *c, int id, uint32_t lapic_id) {
+	static const char *rq_names[NCPU_MAX] = {
+		"rq0", "rq1", "rq2", "rq3", "rq4", "rq5", "rq6", "rq7",
+	};
+	int i;
+
+	c->id = id;
+	c->lapic_id = lapic_id;
+	spin_init (&c->rq_lock, rq_names[id]);
+	for (i = 0; i < CPU_RQ_LEVELS; i++)
+		list_init (&c->ready_queues[i]);
+	c->ready_mask = 0;
+	c->ready_cnt = 0;
+	list_init (&c->destruction_req);
+}
+
+/* Returns the initial local APIC ID of the executing CPU, from
+   CPUID.01H:EBX[31:24]. */
+static uint32_t
+cpuid_lapic_id (void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	return ebx >> 24;
+}
+
+/* Returns true if the SIZE bytes at P sum to 0, modulo 256. */
+static bool
+checksum_ok (const void *p, size_t size) {
+	const uint8_t *bytes = p;
+	uint8_t sum = 0;
+
+	while (size-- > 0)
+		sum += *bytes++;
+	return sum == 0;
+}
+
+/* Looks for the MP floating pointer structure in the SIZE bytes
+   at physical address PADDR. */
+static struct mp_fp *
+mp_search (uint64_t paddr, size_t size) {
+	uint8_t *p = ptov (paddr);
+	uint8_t *end = p + size;
+
+	for (; p + sizeof (struct mp_fp) <= end; p += 16)
+		if (!memcmp (p, "_MP_", 4)
+				&& checksum_ok (p, ((struct mp_fp *) p)->length * 16))
+			return (struct mp_fp *) p;
+	return NULL;
+}
+
+/* Returns the MP configuration table, or a null pointer if the
+   firmware provides none.  The floating pointer is in the first
+   KB of the EBDA, the last KB of base memory, or the BIOS ROM.
+   See [MP] 4.1 "MP Floating Pointer Structure". */
+static struct mp_config *
+mp_find (void) {
+	uint16_t ebda = *(uint16_t *) ptov (0x40e);
+	uint16_t base_kb = *(uint16_t *) ptov (0x413);
+	struct mp_fp *fp = NULL;
+	struct mp_config *conf;
+
+	if (ebda != 0)
+		fp = mp_search ((uint64_t) ebda << 4, 1024);
+	if (fp == NULL && base_kb != 0)
+		fp = mp_search ((uint64_t) base_kb * 1024 - 1024, 1024);
+	if (fp == NULL)
+		fp = mp_search (0xf0000, 0x10000);
+	if (fp == NULL || fp->type != 0 || fp->config == 0)
+		return NULL;
+
+	conf = ptov (fp->config);
+	if (memcmp (conf->signature, "PCMP", 4)
+			|| !checksum_ok (conf, conf->length))
+		return NULL;
+	return conf;
+}
+
+/* Local APIC timer interrupt handler, which drives the scheduler
+   on the APs as the 8254 does on the BSP. */
+static void
+lapic_timer_interrupt (struct intr_frame *args UNUSED) {
+	thread_tick ();
+}
+
+/* Handler for the IPI that thread_unblock() sends to the CPU it
+   queued a thread on.  Interrupting hlt is enough to send the idle
+   thread back to the scheduler. */
+static void
+resched_interrupt (struct intr_frame *args UNUSED) {
+	thread_preempt ();
+}
@@ -13,6 +13,7 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -20,7 +21,9 @@
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/vmalloc.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -35,12 +38,20 @@
 #ifdef FILESYS
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/fsutil.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
 uint64_t *base_pml4;
 
+/* Physical memory size, in 4 kB pages. */
+size_t ram_pages;
+
+/* Map kernel memory with 2 MB pages where possible?  Cleared by
+   -no-large-pages. */
+bool kernel_large_pages = true;
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -84,8 +95,11 @@ main (void) {
 
 	/* Initialize memory system. */
 	mem_end = palloc_init ();
+	ram_pages = mem_end / PGSIZE;
 	malloc_init ();
+	kmem_init ();
 	paging_init (mem_end);
+	vmalloc_init ();
 
 #ifdef USERPROG
 	tss_init ();
@@ -105,6 +119,7 @@ main (void) {
 	thread_start ();
 	serial_init_queue ();
 	timer_calibrate ();
+	cpu_start_aps ();
 
 #ifdef FILESYS
 	/* Initialize file system. */
@@ -140,6 +155,14 @@ bss_init (void) {
 	memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* True if BOUNDARY falls inside the large page that starts at
+ * VA, so that the pages on either side of it need different
+ * rights. */
+static bool
+crosses_large_page (uint64_t va, uint64_t boundary) {
+	return va < boundary && boundary < va + LARGE_PGSIZE;
+}
+
 /* Populates the page table with the kernel virtual mapping,
  * and then sets up the CPU to use the new page directory.
  * Points base_pml4 to the pml4 it creates. */
@@ -152,19 +175,32 @@ paging_init (uint64_t mem_end) {
 	extern char start, _end_kernel_text;
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	// Each 2 MB that is all present and all text or all data is
+	// mapped as one large page, which saves its page table and
+	// covers it with a single TLB entry.
+	for (uint64_t pa = 0; pa < mem_end; ) {
 		uint64_t va = (uint64_t) ptov(pa);
 
 		perm = PTE_P | PTE_W;
 		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
 			perm &= ~PTE_W;
 
+		if (kernel_large_pages && pa % LARGE_PGSIZE == 0
+				&& mem_end - pa >= LARGE_PGSIZE
+				&& !crosses_large_page (va, (uint64_t) &start)
+				&& !crosses_large_page (va, (uint64_t) &_end_kernel_text)
+				&& pml4_set_large_page (pml4, va, pa, perm)) {
+			pa += LARGE_PGSIZE;
+			continue;
+		}
 		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
 			*pte = pa | perm;
+		pa += PGSIZE;
 	}
 
 	// reload cr3
 	pml4_activate(0);
+	pml4_init_pcid ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -216,16 +252,32 @@ parse_options (char **argv) {
 #ifdef FILESYS
 		else if (!strcmp (name, "-f"))
 			format_filesys = true;
+		else if (!strcmp (name, "-pio"))
+			disk_use_dma = false;
 #endif
 		else if (!strcmp (name, "-rs"))
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-no-large-pages"))
+			kernel_large_pages = false;
+		else if (!strcmp (name, "-no-pcid"))
+			pml4_pcids = false;
+		else if (!strcmp (name, "-no-magazines"))
+			palloc_magazines = false;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-vmstat"))
+			vm_process_stats = true;
+		else if (!strcmp (name, "-zswap"))
+			zswap_pool_pages = atoi (value);
+		else if (!strcmp (name, "-ksm"))
+			ksm_pages_per_tick = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -324,10 +376,19 @@ usage (void) {
 			"  -h                 Print this help message and power off.\n"
 			"  -q                 Power off VM after actions or on panic.\n"
 			"  -f                 Format file system disk during startup.\n"
+			"  -pio               Use PIO rather than DMA for disk transfers.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -no-large-pages    Map kernel memory with 4 kB pages only.\n"
+			"  -no-pcid           Flush the TLB on every address space switch.\n"
+			"  -no-magazines      Do not cache free pages per CPU.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -vmstat            Report each process's memory use at exit.\n"
+			"  -zswap=PAGES       Keep up to PAGES pages of compressed swap.\n"
+			"  -ksm=PAGES         Merge identical pages, scanning PAGES per tick.\n"
 #endif
 			);
 	power_off ();
@@ -354,12 +415,21 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	palloc_print_stats ();
+	kmem_print_stats ();
+	vmalloc_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	free_map_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
+	process_print_stats ();
+	pml4_print_stats ();
+#endif
+#ifdef VM
+	vm_print_stats ();
 #endif
 }
@@ -4,8 +4,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "threads/flags.h"
+#include "threads/cpu.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/lapic.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
@@ -94,14 +96,17 @@ static intr_handler_func *intr_handlers[INTR_CNT];
 static const char *intr_names[INTR_CNT];
 
 /* External interrupts are those generated by devices outside the
-   CPU, such as the timer.  External interrupts run with
-   interrupts turned off, so they never nest, nor are they ever
-   pre-empted.  Handlers for external interrupts also may not
-   sleep, although they may invoke intr_yield_on_return() to
-   request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   CPU, such as the timer, and by the local APIC: vectors
+   0x20...0x2f from the PICs and LAPIC_TIMER_VEC and up.  External
+   interrupts run with interrupts turned off, so they never nest,
+   nor are they ever pre-empted.  Handlers for external interrupts
+   also may not sleep, although they may invoke
+   intr_yield_on_return() to request that a new process be
+   scheduled just before the interrupt returns.  Whether a CPU is
+   in an external interrupt, and whether it should yield, is kept
+   in its struct cpu. */
+#define is_external(vec) \
+	(((vec) >= 0x20 && (vec) <= 0x2f) || (vec) >= LAPIC_TIMER_VEC)
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
@@ -182,6 +187,7 @@ intr_init (void) {
 	lidt(&idt_desc);
 
 	/* Initialize intr_names. */
+	intr_names[LAPIC_SPURIOUS_VEC] = "LAPIC Spurious";
 	intr_names[0] = "#DE Divide Error";
 	intr_names[1] = "#DB Debug Exception";
 	intr_names[2] = "NMI Interrupt";
@@ -203,6 +209,16 @@ intr_init (void) {
 	intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Loads the IDT that intr_init() built, and the TSS, on an
+   application processor. */
+void
+intr_init_ap (void) {
+#ifdef USERPROG
+	ltr (SEL_TSS);
+#endif
+	lidt (&idt_desc);
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
    privilege level DPL.  Names the interrupt NAME for debugging
    purposes.  The interrupt handler will be invoked with
@@ -227,7 +243,7 @@ register_handler (uint8_t vec_no, int dpl, enum intr_level level,
 void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
 		const char *name) {
-	ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+	ASSERT (is_external (vec_no));
 	register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -248,7 +264,7 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 		intr_handler_func *handler, const char *name)
 {
-	ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+	ASSERT (!is_external (vec_no));
 	register_handler (vec_no, dpl, level, handler, name);
 }
 
@@ -256,7 +272,11 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
    and false at all other times. */
 bool
 intr_context (void) {
-	return in_external_intr;
+	/* External interrupts run with interrupts off, so with them on
+	   we cannot be in one, and need not look up the CPU. */
+	if (intr_get_level () == INTR_ON)
+		return false;
+	return cpu_current ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -266,7 +286,7 @@ intr_context (void) {
 void
 intr_yield_on_return (void) {
 	ASSERT (intr_context ());
-	yield_on_return = true;
+	cpu_current ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -332,25 +352,29 @@ void
 intr_handler (struct intr_frame *frame) {
 	bool external;
 	intr_handler_func *handler;
+	struct cpu *c = NULL;
 
 	/* External interrupts are special.
 	   We only handle one at a time (so interrupts must be off)
-	   and they need to be acknowledged on the PIC (see below).
+	   and they need to be acknowledged on the PIC or the local
+	   APIC (see below).
 	   An external interrupt handler cannot sleep. */
-	external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+	external = is_external (frame->vec_no);
 	if (external) {
 		ASSERT (intr_get_level () == INTR_OFF);
 		ASSERT (!intr_context ());
 
-		in_external_intr = true;
-		yield_on_return = false;
+		c = cpu_current ();
+		c->in_external_intr = true;
+		c->yield_on_return = false;
 	}
 
 	/* Invoke the interrupt's handler. */
 	handler = intr_handlers[frame->vec_no];
 	if (handler != NULL)
 		handler (frame);
-	else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f) {
+	else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+			|| frame->vec_no == LAPIC_SPURIOUS_VEC) {
 		/* There is no handler, but this interrupt can trigger
 		   spuriously due to a hardware fault or hardware race
 		   condition.  Ignore it. */
@@ -366,10 +390,13 @@ intr_handler (struct intr_frame *frame) {
 		ASSERT (intr_get_level () == INTR_OFF);
 		ASSERT (intr_context ());
 
-		in_external_intr = false;
-		pic_end_of_interrupt (frame->vec_no);
+		c->in_external_intr = false;
+		if (frame->vec_no < 0x30)
+			pic_end_of_interrupt (frame->vec_no);
+		else if (frame->vec_no != LAPIC_SPURIOUS_VEC)
+			lapic_eoi ();
 
-		if (yield_on_return)
+		if (c->yield_on_return)
 			thread_yield ();
 	}
 }
@@ -0,0 +1,181 @@
+#include "threads/lapic.h"
+#include <debug.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/mmu.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Local APIC.  See [IA32-v3a] chapter 10 "Advanced Programmable
+   Interrupt Controller (APIC)".
+
+   Every CPU has its own local APIC at the same physical address,
+   so the one mapping in base_pml4 reaches the local APIC of
+   whichever CPU uses it. */
+
+/* Register offsets. */
+#define LAPIC_ID    0x020       /* Local APIC ID. */
+#define LAPIC_TPR   0x080       /* Task priority. */
+#define LAPIC_EOI   0x0b0       /* End of interrupt. */
+#define LAPIC_SVR   0x0f0       /* Spurious interrupt vector. */
+#define LAPIC_ESR   0x280       /* Error status. */
+#define LAPIC_ICRLO 0x300       /* Interrupt command, low half. */
+#define LAPIC_ICRHI 0x310       /* Interrupt command, high half. */
+#define LAPIC_TIMER 0x320       /* LVT timer. */
+#define LAPIC_TICR  0x380       /* Timer initial count. */
+#define LAPIC_TCCR  0x390       /* Timer current count. */
+#define LAPIC_TDCR  0x3e0       /* Timer divide configuration. */
+
+/* Register bits. */
+#define SVR_ENABLE     0x00100  /* APIC software enable. */
+#define ICR_INIT       0x00500  /* INIT delivery mode. */
+#define ICR_STARTUP    0x00600  /* STARTUP delivery mode. */
+#define ICR_PENDING    0x01000  /* Delivery status: send pending. */
+#define ICR_ASSERT     0x04000  /* Level assert. */
+#define ICR_LEVEL      0x08000  /* Level triggered. */
+#define TIMER_MASKED   0x10000  /* Timer interrupt masked. */
+#define TIMER_PERIODIC 0x20000  /* Periodic rather than one-shot. */
+#define TDCR_DIV16     0x3      /* Count at bus clock / 16. */
+
+/* PIT ticks to count the local APIC timer over. */
+#define CALIBRATE_TICKS 4
+
+/* Kernel virtual address of the local APIC registers. */
+static volatile uint32_t *lapic;
+
+/* Local APIC timer counts per PIT tick. */
+static uint32_t lapic_timer_count;
+
+static uint32_t
+lapic_read (int reg) {
+	return lapic[reg / sizeof *lapic];
+}
+
+static void
+lapic_write (int reg, uint32_t value) {
+	lapic[reg / sizeof *lapic] = value;
+	(void) lapic_read (LAPIC_ID);         /* Wait for the write. */
+}
+
+/* Sends the interrupt command LO to the local APIC whose ID is
+   LAPIC_ID, once the previous command has been sent. */
+static void
+lapic_icr (uint32_t lapic_id, uint32_t lo) {
+	while (lapic_read (LAPIC_ICRLO) & ICR_PENDING)
+		asm volatile ("pause");
+	lapic_write (LAPIC_ICRHI, lapic_id << 24);
+	lapic_write (LAPIC_ICRLO, lo);
+}
+
+/* Maps the local APIC registers at physical address PADDR,
+   uncached, into base_pml4 above the direct map of RAM. */
+void
+lapic_map (uint64_t paddr) {
+	uint64_t *pte;
+
+	ASSERT (paddr % PGSIZE == 0);
+	ASSERT (paddr >= ram_pages * PGSIZE);
+
+	pte = pml4e_walk (base_pml4, (uint64_t) ptov (paddr), 1);
+	if (pte == NULL)
+		PANIC ("out of memory mapping the local APIC");
+	*pte = paddr | PTE_P | PTE_W | PTE_PCD | PTE_PWT;
+	lapic = ptov (paddr);
+}
+
+/* Enables the executing CPU's local APIC and lets it accept
+   interrupts of every priority.  LINT0, where the 8259A PICs
+   are wired on the BSP, is left as the firmware set it. */
+void
+lapic_init (void) {
+	ASSERT (lapic != NULL);
+
+	lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+	lapic_write (LAPIC_TPR, 0);
+	lapic_write (LAPIC_ESR, 0);
+	lapic_write (LAPIC_ESR, 0);
+	lapic_write (LAPIC_EOI, 0);
+}
+
+/* Returns the local APIC ID of the executing CPU. */
+uint32_t
+lapic_id (void) {
+	return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Acknowledges the interrupt being handled on this CPU. */
+void
+lapic_eoi (void) {
+	lapic_write (LAPIC_EOI, 0);
+}
+
+/* Sends a fixed interrupt with vector VEC to the CPU whose local
+   APIC ID is LAPIC_ID. */
+void
+lapic_send_ipi (uint32_t lapic_id, uint8_t vec) {
+	enum intr_level old_level = intr_disable ();
+
+	lapic_icr (lapic_id, vec);
+	intr_set_level (old_level);
+}
+
+/* Sends the INIT-SIPI-SIPI sequence that starts the application
+   processor whose local APIC ID is LAPIC_ID executing in real
+   mode at physical address PADDR.  See [IA32-v3a] 8.4.4.1
+   "Typical BSP Initialization Sequence". */
+void
+lapic_start_ap (uint32_t lapic_id, uint64_t paddr) {
+	int i;
+
+	ASSERT (paddr % PGSIZE == 0 && paddr < 0x100000);
+
+	lapic_icr (lapic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+	timer_msleep (10);
+	lapic_icr (lapic_id, ICR_INIT | ICR_LEVEL);
+	timer_msleep (10);
+
+	for (i = 0; i < 2; i++) {
+		lapic_icr (lapic_id, ICR_STARTUP | (paddr >> 12));
+		timer_usleep (200);
+	}
+}
+
+/* Measures how far the local APIC timer counts in one PIT tick,
+   for lapic_timer_start().  Must be called with interrupts on,
+   on any CPU, since every local APIC counts at the bus clock. */
+void
+lapic_calibrate_timer (void) {
+	int64_t start;
+	uint32_t left;
+
+	ASSERT (intr_get_level () == INTR_ON);
+
+	start = timer_ticks ();
+	while (timer_ticks () == start)
+		asm volatile ("pause");
+
+	lapic_write (LAPIC_TDCR, TDCR_DIV16);
+	lapic_write (LAPIC_TIMER, TIMER_MASKED | LAPIC_TIMER_VEC);
+	lapic_write (LAPIC_TICR, UINT32_MAX);
+	start = timer_ticks ();
+	while (timer_ticks () - start < CALIBRATE_TICKS)
+		asm volatile ("pause");
+	left = lapic_read (LAPIC_TCCR);
+	lapic_write (LAPIC_TICR, 0);
+
+	lapic_timer_count = (UINT32_MAX - left) / CALIBRATE_TICKS;
+	ASSERT (lapic_timer_count > 0);
+}
+
+/* Starts the executing CPU's local APIC timer interrupting at
+   TIMER_FREQ, the rate of the PIT. */
+void
+lapic_timer_start (void) {
+	ASSERT (lapic_timer_count > 0);
+
+	lapic_write (LAPIC_TDCR, TDCR_DIV16);
+	lapic_write (LAPIC_TIMER, TIMER_PERIODIC | LAPIC_TIMER_VEC);
+	lapic_write (LAPIC_TICR, lapic_timer_count);
+}
@@ -8,6 +8,7 @@
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 
 /* A simple implementation of malloc().
 
@@ -30,9 +31,15 @@
 
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   descriptor.  We handle those by allocating whole pages and
+   sticking the allocation size at the beginning of the allocated
+   block's arena header.  The pages come from vmalloc(), which
+   maps scattered physical pages at contiguous virtual addresses,
+   so that a big block does not need contiguous free memory; only
+   before vmalloc_init(), or if its region is full, do we ask the
+   page allocator for contiguous pages.  realloc() grows a big
+   block from vmalloc() in place when the pages after it are
+   free. */
 
 /* Descriptor. */
 struct desc {
@@ -100,7 +107,9 @@ malloc (size_t size) {
 		/* SIZE is too big for any descriptor.
 		   Allocate enough pages to hold SIZE plus an arena. */
 		size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-		a = palloc_get_multiple (0, page_cnt);
+		a = vmalloc (page_cnt);
+		if (a == NULL)
+			a = palloc_get_multiple (0, page_cnt);
 		if (a == NULL)
 			return NULL;
 
@@ -173,6 +182,25 @@ block_size (void *block) {
 	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Tries to make BLOCK, a big block, hold NEW_SIZE bytes without
+   moving it, by mapping more pages after it.  Returns true if
+   successful. */
+static bool
+resize_in_place (void *block, size_t new_size) {
+	struct arena *a = block_to_arena (block);
+	size_t page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+
+	if (a->desc != NULL || !is_vmalloc_vaddr (a))
+		return false;
+	if (page_cnt == a->free_cnt)
+		return true;
+	if (page_cnt > a->free_cnt && vmalloc_grow (a, a->free_cnt, page_cnt)) {
+		a->free_cnt = page_cnt;
+		return true;
+	}
+	return false;
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
@@ -184,6 +212,8 @@ realloc (void *old_block, size_t new_size) {
 	if (new_size == 0) {
 		free (old_block);
 		return NULL;
+	} else if (old_block != NULL && resize_in_place (old_block, new_size)) {
+		return old_block;
 	} else {
 		void *new_block = malloc (new_size);
 		if (old_block != NULL && new_block != NULL) {
@@ -233,7 +263,10 @@ free (void *p) {
 			lock_release (&d->lock);
 		} else {
 			/* It's a big block.  Free its pages. */
-			palloc_free_multiple (a, a->free_cnt);
+			if (is_vmalloc_vaddr (a))
+				vfree (a, a->free_cnt);
+			else
+				palloc_free_multiple (a, a->free_cnt);
 			return;
 		}
 	}
@@ -1,19 +1,58 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/lapic.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/spinlock.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Replaces the large page mapped by *PDE with a page table that
+ * maps the same 2 MB with 4 kB pages and the same rights.  Returns
+ * false if no page table could be allocated.  The large page may
+ * linger in the TLB until the caller invalidates one of its pages,
+ * which drops the whole of it. */
+static bool
+pde_split (uint64_t *pde) {
+	uint64_t *pt = palloc_get_page (0);
+	uint64_t flags = *pde & PTE_FLAGS & ~(uint64_t) PTE_PS;
+
+	if (pt == NULL)
+		return false;
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (LARGE_PTE_ADDR (*pde) + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P | PTE_LIVE_ALL;
+	return true;
+}
+
+/* A page directory entry that maps a large page stands for the
+ * PTEs of all of its pages: without CREATE it is returned itself,
+ * and with CREATE it is split so that the page can be changed on
+ * its own.  4 kB PTEs never set bit 7 (PAT), so callers can tell
+ * the two apart with is_large_pte().
+ *
+ * PARENT is the entry that points to PDP.  With CREATE, the walk
+ * records the entries it is about to make as live in the entries
+ * above them. */
 static uint64_t *
-pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
+pgdir_walk (uint64_t *pdp, uint64_t *parent, const uint64_t va,
+		int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
-		if (!((uint64_t) pte & PTE_P)) {
+		if (((uint64_t) pte & PTE_P) && ((uint64_t) pte & PTE_PS)) {
+			if (!create)
+				return &pdp[idx];
+			if (!pde_split (&pdp[idx]))
+				return NULL;
+		}
+		if (!((uint64_t) pdp[idx] & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
 				if (new_page)
@@ -23,13 +62,18 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
+		if (create) {
+			*parent |= PTE_LIVE (idx);
+			pdp[idx] |= PTE_LIVE (PTX (va));
+		}
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
 }
 
 static uint64_t *
-pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
+pdpe_walk (uint64_t *pdpe, uint64_t *parent, const uint64_t va,
+		int create) {
 	uint64_t *pte = NULL;
 	int idx = PDPE (va);
 	int allocated = 0;
@@ -46,7 +90,9 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
-		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create);
+		if (create)
+			*parent |= PTE_LIVE (idx);
+		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), &pdpe[idx], va, create);
 	}
 	if (pte == NULL && allocated) {
 		palloc_free_page ((void *) ptov (PTE_ADDR (pdpe[idx])));
@@ -79,7 +125,8 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
-		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), va, create);
+		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), &pml4e[idx], va,
+				create);
 	}
 	if (pte == NULL && allocated) {
 		palloc_free_page ((void *) ptov (PTE_ADDR (pml4e[idx])));
@@ -100,11 +147,25 @@ pml4_create (void) {
 	return pml4;
 }
 
+/* True if entry I of a table may have been made, according to
+ * LIVE, the entry that points to the table.  Walks over a table
+ * test the first entry of each PTE_LIVE_SPAN and skip the span if
+ * it is dead. */
 static bool
-pt_for_each (uint64_t *pt, pte_for_each_func *func, void *aux,
-		unsigned pml4_index, unsigned pdp_index, unsigned pdx_index) {
+entry_live (uint64_t live, unsigned i) {
+	return (live & PTE_LIVE (i)) != 0;
+}
+
+static bool
+pt_for_each (uint64_t *pt, uint64_t live, pte_for_each_func *func,
+		void *aux, unsigned pml4_index, unsigned pdp_index,
+		unsigned pdx_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = &pt[i];
+		if (!entry_live (live, i)) {
+			i += PTE_LIVE_SPAN - 1;
+			continue;
+		}
 		if (((uint64_t) *pte) & PTE_P) {
 			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
 								 ((uint64_t) pdp_index << PDPESHIFT) |
@@ -118,25 +179,42 @@ pt_for_each (uint64_t *pt, pte_for_each_func *func, void *aux,
 }
 
 static bool
-pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
-		unsigned pml4_index, unsigned pdp_index) {
+pgdir_for_each (uint64_t *pdp, uint64_t live, pte_for_each_func *func,
+		void *aux, unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
-					pml4_index, pdp_index, i))
+		if (!entry_live (live, i)) {
+			i += PTE_LIVE_SPAN - 1;
+			continue;
+		}
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		if (((uint64_t) pte) & PTE_PS) {
+			/* FUNC gets a large page's entry once, with the
+			 * address of its first byte. */
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
 				return false;
+		} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), pdp[i], func,
+					aux, pml4_index, pdp_index, i))
+			return false;
 	}
 	return true;
 }
 
 static bool
-pdp_for_each (uint64_t *pdp,
+pdp_for_each (uint64_t *pdp, uint64_t live,
 		pte_for_each_func *func, void *aux, unsigned pml4_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pde = ptov((uint64_t *) pdp[i]);
+		if (!entry_live (live, i)) {
+			i += PTE_LIVE_SPAN - 1;
+			continue;
+		}
 		if (((uint64_t) pde) & PTE_P)
-			if (!pgdir_for_each ((uint64_t *) PTE_ADDR (pde), func,
+			if (!pgdir_for_each ((uint64_t *) PTE_ADDR (pde), pdp[i], func,
 					 aux, pml4_index, i))
 				return false;
 	}
@@ -149,16 +227,24 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pdpe = ptov((uint64_t *) pml4[i]);
 		if (((uint64_t) pdpe) & PTE_P)
-			if (!pdp_for_each ((uint64_t *) PTE_ADDR (pdpe), func, aux, i))
+			if (!pdp_for_each ((uint64_t *) PTE_ADDR (pdpe), pml4[i], func,
+					aux, i))
 				return false;
 	}
 	return true;
 }
 
+/* The destroy functions free each table along with the pages its
+ * present entries map, visiting only the live spans of the
+ * table that LIVE, the entry pointing to it, records. */
 static void
-pt_destroy (uint64_t *pt) {
+pt_destroy (uint64_t *pt, uint64_t live) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pt[i]);
+		if (!entry_live (live, i)) {
+			i += PTE_LIVE_SPAN - 1;
+			continue;
+		}
 		if (((uint64_t) pte) & PTE_P)
 			palloc_free_page ((void *) PTE_ADDR (pte));
 	}
@@ -166,25 +252,352 @@ pt_destroy (uint64_t *pt) {
 }
 
 static void
-pgdir_destroy (uint64_t *pdp) {
+pgdir_destroy (uint64_t *pdp, uint64_t live) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			pt_destroy (PTE_ADDR (pte));
+		if (!entry_live (live, i)) {
+			i += PTE_LIVE_SPAN - 1;
+			continue;
+		}
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		if (((uint64_t) pte) & PTE_PS)
+			palloc_free_multiple ((void *) LARGE_PTE_ADDR (pte),
+					LARGE_PGSIZE / PGSIZE);
+		else
+			pt_destroy ((uint64_t *) PTE_ADDR (pte), pdp[i]);
 	}
 	palloc_free_page ((void *) pdp);
 }
 
 static void
-pdpe_destroy (uint64_t *pdpe) {
+pdpe_destroy (uint64_t *pdpe, uint64_t live) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pde = ptov((uint64_t *) pdpe[i]);
+		if (!entry_live (live, i)) {
+			i += PTE_LIVE_SPAN - 1;
+			continue;
+		}
 		if (((uint64_t) pde) & PTE_P)
-			pgdir_destroy ((void *) PTE_ADDR (pde));
+			pgdir_destroy ((void *) PTE_ADDR (pde), pdpe[i]);
 	}
 	palloc_free_page ((void *) pdpe);
 }
 
+/* Address-space switches.  Each CPU's ACTIVE is the page map in
+ * its CR3, so that switching to the page map already there, as
+ * between kernel threads or back to the same process, costs
+ * nothing.
+ *
+ * Where the CPU has process-context identifiers (PCIDs), each page
+ * map a CPU used lately holds one of that CPU's PCID_CNT of them,
+ * and loading CR3 leaves the TLB entries of the others alone.  A
+ * change to a page map that is not loaded must then drop its stale
+ * entries some other way: INVPCID drops the one page, where the
+ * CPU has it, and otherwise the page map's PCID is marked STALE
+ * and flushed when the page map is next loaded.  PCID 0 belongs
+ * to base_pml4.
+ *
+ * A CPU's struct mmu_cpu is changed only by that CPU, with
+ * interrupts off.  A change to a page map that another CPU has
+ * loaded, or holds a PCID for, is passed to it as a TLB shootdown:
+ * see tlb_shootdown(). */
+#define PCID_CNT 64
+#define CR3_NOFLUSH (1UL << 63)
+#define CR4_PCIDE (1 << 17)
+#define CPUID_ECX_PCID (1 << 17)
+#define CPUID_EBX_INVPCID (1 << 10)
+
+struct pcid_slot {
+	uint64_t *pml4;             /* Page map holding the PCID, or NULL. */
+	bool stale;                 /* TLB may hold PML4's old entries. */
+};
+
+struct mmu_cpu {
+	uint64_t *active;           /* Page map in CR3. */
+	struct pcid_slot pcids[PCID_CNT];
+	unsigned pcid_hand;         /* Next slot to take from its page map. */
+	volatile bool shootdown;    /* Asked to carry out the shootdown? */
+
+	/* Statistics. */
+	long long cr3_load_cnt;     /* CR3 loads. */
+	long long cr3_flush_cnt;    /* CR3 loads that flushed the TLB. */
+	long long cr3_skip_cnt;     /* Switches to the loaded page map. */
+};
+
+static struct mmu_cpu mmu_cpus[NCPU_MAX];
+static bool use_pcids, have_invpcid;
+
+/* Tag TLB entries with PCIDs if the CPU can?  Cleared by -no-pcid. */
+bool pml4_pcids = true;
+
+/* TLB shootdowns.  The sender holds shootdown_lock from posting
+ * the request until every CPU it asked has carried it out. */
+enum shootdown_op {
+	SHOOTDOWN_PAGE,             /* Drop VA under PML4. */
+	SHOOTDOWN_KERNEL,           /* Drop kernel address VA. */
+	SHOOTDOWN_FORGET            /* PML4 is going away: drop its PCID. */
+};
+
+static struct spinlock shootdown_lock = { .name = "shootdown" };
+static struct {
+	enum shootdown_op op;
+	uint64_t *pml4;
+	uint64_t va;
+	volatile int pending;       /* CPUs yet to carry it out. */
+} shootdown;
+
+static void shootdown_interrupt (struct intr_frame *);
+
+/* Returns the executing CPU's address-space state.  Interrupts
+ * must be off. */
+static struct mmu_cpu *
+mmu_cpu (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	return &mmu_cpus[cpu_current ()->id];
+}
+
+/* Turns PCIDs on, if pml4_pcids allows and the CPU has them.  Must
+ * be called on the BSP while base_pml4 is loaded with PCID 0. */
+void
+pml4_init_pcid (void) {
+	enum intr_level old_level = intr_disable ();
+	struct mmu_cpu *mc = mmu_cpu ();
+	uint32_t eax, ebx, ecx, edx;
+
+	ASSERT (mc->active == base_pml4);
+
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	if (pml4_pcids && (ecx & CPUID_ECX_PCID)) {
+		cpuid (0, &eax, &ebx, &ecx, &edx);
+		if (eax >= 7) {
+			cpuid (7, &eax, &ebx, &ecx, &edx);
+			have_invpcid = (ebx & CPUID_EBX_INVPCID) != 0;
+		}
+		mc->pcids[0].pml4 = base_pml4;
+		lcr4 (rcr4 () | CR4_PCIDE);
+		use_pcids = true;
+	}
+	intr_set_level (old_level);
+}
+
+/* Loads base_pml4 on an application processor, turning PCIDs on
+ * first if the BSP did.  Interrupts must be off. */
+void
+pml4_init_ap (void) {
+	struct mmu_cpu *mc = mmu_cpu ();
+
+	if (use_pcids) {
+		mc->pcids[0].pml4 = base_pml4;
+		lcr4 (rcr4 () | CR4_PCIDE);
+	}
+	mc->active = base_pml4;
+	lcr3 (vtop (base_pml4));
+}
+
+/* Registers the TLB shootdown IPI handler.  Must be called once,
+ * before any application processor starts. */
+void
+pml4_init_shootdown (void) {
+	intr_register_ext (LAPIC_SHOOTDOWN_VEC, shootdown_interrupt,
+			"TLB Shootdown");
+}
+
+/* Returns the slot of the PCID that PML4 holds on MC's CPU, or a
+ * null pointer if it holds none. */
+static struct pcid_slot *
+pcid_find (struct mmu_cpu *mc, uint64_t *pml4) {
+	for (unsigned i = 0; i < PCID_CNT; i++)
+		if (mc->pcids[i].pml4 == pml4)
+			return &mc->pcids[i];
+	return NULL;
+}
+
+/* Returns the slot of PML4's PCID on MC's CPU, first giving it one
+ * if it has none.  A PCID taken from another page map is stale,
+ * since its TLB entries are the other page map's. */
+static struct pcid_slot *
+pcid_get (struct mmu_cpu *mc, uint64_t *pml4) {
+	struct pcid_slot *slot = pcid_find (mc, pml4);
+
+	if (slot == NULL) {
+		do {
+			mc->pcid_hand = mc->pcid_hand % (PCID_CNT - 1) + 1;
+			slot = &mc->pcids[mc->pcid_hand];
+		} while (slot->pml4 == mc->active);
+		slot->pml4 = pml4;
+		slot->stale = true;
+	}
+	return slot;
+}
+
+/* Drops any entry for VA under PML4 from the TLB of MC's CPU,
+ * which must be the executing CPU.  Without PCIDs, a page map that
+ * is not loaded has no TLB entries, since loading another flushed
+ * them. */
+static void
+tlb_drop_page (struct mmu_cpu *mc, uint64_t *pml4, uint64_t va) {
+	struct pcid_slot *slot;
+
+	if (pml4 == mc->active) {
+		invlpg (va);
+		return;
+	}
+	if (!use_pcids)
+		return;
+
+	slot = pcid_find (mc, pml4);
+	if (slot != NULL && !slot->stale) {
+		if (have_invpcid)
+			invpcid (0, slot - mc->pcids, va);
+		else
+			slot->stale = true;
+	}
+}
+
+/* Drops any entry for kernel address VA from the TLB of MC's CPU,
+ * which must be the executing CPU.  Every page map shares the
+ * kernel's, so with PCIDs the entry may be cached under any of
+ * them. */
+static void
+tlb_drop_kernel (struct mmu_cpu *mc, uint64_t va) {
+	invlpg (va);
+	if (use_pcids)
+		for (unsigned i = 0; i < PCID_CNT; i++) {
+			struct pcid_slot *slot = &mc->pcids[i];
+
+			if (slot->pml4 == NULL || slot->pml4 == mc->active || slot->stale)
+				continue;
+			if (have_invpcid)
+				invpcid (0, i, va);
+			else
+				slot->stale = true;
+		}
+}
+
+/* Carries out shootdown OP on the executing CPU, whose state is
+ * MC. */
+static void
+shootdown_run (struct mmu_cpu *mc, enum shootdown_op op, uint64_t *pml4,
+		uint64_t va) {
+	struct pcid_slot *slot;
+
+	switch (op) {
+		case SHOOTDOWN_PAGE:
+			tlb_drop_page (mc, pml4, va);
+			break;
+		case SHOOTDOWN_KERNEL:
+			tlb_drop_kernel (mc, va);
+			break;
+		case SHOOTDOWN_FORGET:
+			/* A later page map at the same address must not inherit
+			 * the PCID's TLB entries. */
+			ASSERT (pml4 != mc->active);
+			slot = pcid_find (mc, pml4);
+			if (slot != NULL)
+				slot->pml4 = NULL;
+			break;
+	}
+}
+
+/* Carries out the posted shootdown on the executing CPU, whose
+ * state is MC, if its sender asked this CPU to. */
+static void
+shootdown_serve (struct mmu_cpu *mc) {
+	if (!mc->shootdown)
+		return;
+	mc->shootdown = false;
+	shootdown_run (mc, shootdown.op, shootdown.pml4, shootdown.va);
+	asm volatile ("lock decl %0" : "+m" (shootdown.pending) : : "memory");
+}
+
+/* TLB shootdown IPI handler. */
+static void
+shootdown_interrupt (struct intr_frame *f UNUSED) {
+	shootdown_serve (mmu_cpu ());
+}
+
+/* Returns true if a shootdown OP of PML4 concerns MC's CPU, that
+ * is, if its TLB may hold entries of PML4. */
+static bool
+shootdown_needed (struct mmu_cpu *mc, enum shootdown_op op,
+		uint64_t *pml4) {
+	if (op == SHOOTDOWN_KERNEL)
+		return true;
+	if (op == SHOOTDOWN_PAGE && mc->active == pml4)
+		return true;
+	return use_pcids && pcid_find (mc, pml4) != NULL;
+}
+
+/* Carries out OP, for address VA in page map PML4, on every CPU
+ * whose TLB it concerns, and returns once all have done so.  The
+ * change to the page map must already be made.
+ *
+ * Interrupts are off throughout, since the executing CPU must not
+ * change, so a CPU waiting for shootdown_lock serves the request
+ * of the CPU holding it without taking the IPI.  The caller must
+ * not hold a spinlock that another CPU may spin on. */
+static void
+tlb_shootdown (enum shootdown_op op, uint64_t *pml4, uint64_t va) {
+	enum intr_level old_level = intr_disable ();
+	struct mmu_cpu *self = mmu_cpu ();
+	bool targets[NCPU_MAX];
+	int target_cnt = 0;
+	int i;
+
+	if (cpu_cnt > 1) {
+		while (!spin_try_lock (&shootdown_lock))
+			while (shootdown_lock.locked) {
+				shootdown_serve (self);
+				asm volatile ("pause" : : : "memory");
+			}
+
+		/* A CPU that loads PML4 after this fence walks the new
+		 * entries; one that loaded it before shows up below. */
+		asm volatile ("mfence" : : : "memory");
+		for (i = 0; i < cpu_cnt; i++) {
+			struct mmu_cpu *mc = &mmu_cpus[i];
+
+			targets[i] = mc != self && cpus[i].online
+				&& shootdown_needed (mc, op, pml4);
+			if (targets[i])
+				target_cnt++;
+		}
+
+		if (target_cnt > 0) {
+			shootdown.op = op;
+			shootdown.pml4 = pml4;
+			shootdown.va = va;
+			shootdown.pending = target_cnt;
+			for (i = 0; i < cpu_cnt; i++)
+				if (targets[i]) {
+					mmu_cpus[i].shootdown = true;
+					lapic_send_ipi (cpus[i].lapic_id, LAPIC_SHOOTDOWN_VEC);
+				}
+			while (shootdown.pending > 0)
+				asm volatile ("pause" : : : "memory");
+		}
+		spin_unlock (&shootdown_lock);
+	}
+	shootdown_run (self, op, pml4, va);
+	intr_set_level (old_level);
+}
+
+/* Drops any TLB entry for VA under PML4, whose entry for VA just
+ * changed, on every CPU. */
+static void
+tlb_invalidate (uint64_t *pml4, uint64_t va) {
+	tlb_shootdown (SHOOTDOWN_PAGE, pml4, va);
+}
+
+/* Drops any TLB entry for kernel address VA, whose entry just
+ * changed, on every CPU. */
+static void
+tlb_invalidate_kernel (uint64_t va) {
+	tlb_shootdown (SHOOTDOWN_KERNEL, NULL, va);
+}
+
 /* Destroys pml4e, freeing all the pages it references. */
 void
 pml4_destroy (uint64_t *pml4) {
@@ -195,15 +608,68 @@ pml4_destroy (uint64_t *pml4) {
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
-		pdpe_destroy ((void *) PTE_ADDR (pdpe));
+		pdpe_destroy ((void *) PTE_ADDR (pdpe), pml4[0]);
+
+	if (use_pcids)
+		tlb_shootdown (SHOOTDOWN_FORGET, pml4, 0);
 	palloc_free_page ((void *) pml4);
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register, unless it is there already.  With PCIDs, the TLB
+ * entries of PD are kept unless they are stale. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+	struct mmu_cpu *mc;
+	uint64_t cr3;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+
+	old_level = intr_disable ();
+	mc = mmu_cpu ();
+	if (pml4 == mc->active) {
+		mc->cr3_skip_cnt++;
+		intr_set_level (old_level);
+		return;
+	}
+
+	cr3 = vtop (pml4);
+	if (use_pcids) {
+		struct pcid_slot *slot = pcid_get (mc, pml4);
+
+		cr3 |= slot - mc->pcids;
+		if (slot->stale) {
+			slot->stale = false;
+			mc->cr3_flush_cnt++;
+		} else
+			cr3 |= CR3_NOFLUSH;
+	} else
+		mc->cr3_flush_cnt++;
+
+	/* Set before the load, so that tlb_shootdown() on another CPU
+	 * cannot miss a TLB entry walked under PML4. */
+	mc->active = pml4;
+	lcr3 (cr3);
+	mc->cr3_load_cnt++;
+	intr_set_level (old_level);
+}
+
+/* Prints address-space switch statistics. */
+void
+pml4_print_stats (void) {
+	long long load_cnt = 0, flush_cnt = 0, skip_cnt = 0;
+	int i;
+
+	for (i = 0; i < cpu_cnt; i++) {
+		load_cnt += mmu_cpus[i].cr3_load_cnt;
+		flush_cnt += mmu_cpus[i].cr3_flush_cnt;
+		skip_cnt += mmu_cpus[i].cr3_skip_cnt;
+	}
+	printf ("Page maps: %lld loads, %lld of them flushing the TLB, "
+			"%lld switches skipped, PCIDs %s\n", load_cnt, flush_cnt,
+			skip_cnt, use_pcids ? "on" : "off");
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -216,9 +682,12 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
-	if (pte && (*pte & PTE_P))
-		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
-	return NULL;
+	if (pte == NULL || !(*pte & PTE_P))
+		return NULL;
+	if (is_large_pte (pte))
+		return ptov (LARGE_PTE_ADDR (*pte))
+			+ ((uint64_t) uaddr & (LARGE_PGSIZE - 1));
+	return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
 }
 
 /* Adds a mapping in page map level 4 PML4 from user virtual page
@@ -238,14 +707,57 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
-	if (pte)
+	if (pte) {
+		uint64_t old = *pte;
+
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		if (old & PTE_P)
+			tlb_invalidate (pml4, (uint64_t) upage);
+	}
 	return pte != NULL;
 }
 
+/* Returns the table that *ENTRY points to, first pointing it to a
+ * new, empty one if it points nowhere, and records entry IDX of
+ * that table as live.  Returns a null pointer if memory for the
+ * new table could not be had. */
+static uint64_t *
+next_table (uint64_t *entry, unsigned idx) {
+	if (!(*entry & PTE_P)) {
+		uint64_t *table = palloc_get_page (PAL_ZERO);
+		if (table == NULL)
+			return NULL;
+		*entry = vtop (table) | PTE_U | PTE_W | PTE_P;
+	}
+	*entry |= PTE_LIVE (idx);
+	return ptov (PTE_ADDR (*entry));
+}
+
+/* Maps the 2 MB of physical memory at PA at virtual address VA in
+ * PML4 as one large page, with the rights in FLAGS.  PA and VA
+ * must be aligned to LARGE_PGSIZE and nothing may be mapped in
+ * the range yet.  Returns false if memory for a table could not
+ * be had. */
+bool
+pml4_set_large_page (uint64_t *pml4, uint64_t va, uint64_t pa,
+		uint64_t flags) {
+	uint64_t *pdp, *pgdir;
+	ASSERT (va % LARGE_PGSIZE == 0);
+	ASSERT (pa % LARGE_PGSIZE == 0);
+
+	pdp = next_table (&pml4[PML4 (va)], PDPE (va));
+	pgdir = pdp != NULL ? next_table (&pdp[PDPE (va)], PDX (va)) : NULL;
+	if (pgdir == NULL)
+		return false;
+	ASSERT (!(pgdir[PDX (va)] & PTE_P));
+	pgdir[PDX (va)] = pa | (flags & PTE_FLAGS) | PTE_PS | PTE_P;
+	return true;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
- * bits in the page table entry are preserved.
+ * bits in the page table entry are preserved.  A large page
+ * holding UPAGE is split first, so that only UPAGE goes.
  * UPAGE need not be mapped. */
 void
 pml4_clear_page (uint64_t *pml4, void *upage) {
@@ -254,11 +766,12 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 	ASSERT (is_user_vaddr (upage));
 
 	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	if (pte != NULL && is_large_pte (pte))
+		pte = pml4e_walk (pml4, (uint64_t) upage, true);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_invalidate (pml4, (uint64_t) upage);
 	}
 }
 
@@ -281,10 +794,9 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		if (dirty)
 			*pte |= PTE_D;
 		else
-			*pte &= ~(uint32_t) PTE_D;
+			*pte &= ~(uint64_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
 	}
 }
 
@@ -307,9 +819,61 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		if (accessed)
 			*pte |= PTE_A;
 		else
-			*pte &= ~(uint32_t) PTE_A;
+			*pte &= ~(uint64_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
 	}
 }
+
+/* Sets write permission to WRITABLE in the PTE for virtual page
+ * VPAGE in PML4, keeping its other bits. */
+void
+pml4_set_writable (uint64_t *pml4, const void *vpage, bool writable) {
+	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	if (pte) {
+		if (writable)
+			*pte |= PTE_W;
+		else
+			*pte &= ~(uint64_t) PTE_W;
+
+		tlb_invalidate (pml4, (uint64_t) vpage);
+	}
+}
+
+/* Maps kernel virtual page VPAGE, which must lie outside the
+ * direct map of physical memory and be unmapped, to the physical
+ * page at kernel virtual address KPAGE, read/write.  The tables
+ * below base_pml4's kernel entry are shared by every page map, so
+ * the mapping appears in all of them.  vmalloc_init() made all of
+ * those tables, so this only writes VPAGE's own entry. */
+void
+pml4_set_kernel_page (void *vpage, void *kpage) {
+	uint64_t *pte;
+
+	ASSERT (pg_ofs (vpage) == 0);
+	ASSERT (pg_ofs (kpage) == 0);
+	ASSERT (is_vmalloc_vaddr (vpage));
+
+	pte = pml4e_walk (base_pml4, (uint64_t) vpage, false);
+	ASSERT (pte != NULL);
+	ASSERT (!(*pte & PTE_P));
+	*pte = vtop (kpage) | PTE_P | PTE_W;
+}
+
+/* Unmaps kernel virtual page VPAGE, mapped by
+ * pml4_set_kernel_page(), in every page map, and returns the
+ * kernel virtual address of the physical page it mapped. */
+void *
+pml4_clear_kernel_page (void *vpage) {
+	uint64_t *pte;
+	void *kpage;
+
+	ASSERT (is_vmalloc_vaddr (vpage));
+
+	pte = pml4e_walk (base_pml4, (uint64_t) vpage, false);
+	ASSERT (pte != NULL && (*pte & PTE_P));
+	kpage = ptov (PTE_ADDR (*pte));
+	*pte = 0;
+	tlb_invalidate_kernel ((uint64_t) vpage);
+	return kpage;
+}
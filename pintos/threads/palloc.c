@@ -2,12 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,13 +27,73 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Its free pages are kept
+   as blocks of 2**ORDER pages, aligned to their size relative to
+   the pool's base, on one free list per order.  An allocation
+   takes a block from the smallest order that has one, splitting
+   larger blocks in half as needed, and gives back any pages past
+   the number requested.  Freeing a block merges it with its
+   "buddy", the other half of the block of the next order, for as
+   long as the buddy is free too.  Both take O(MAX_ORDER) steps,
+   however full the pool.
+
+   The free lists are threaded through an array of struct
+   buddy_page, one per page of the pool, rather than through the
+   free pages themselves, because much of the user pool is not
+   mapped yet when the pools are populated.
+
+   Single pages, by far the most common request, mostly bypass
+   the pool and its lock.  Each CPU keeps a "magazine" of up to
+   MAG_SIZE free pages per pool, under a spinlock of its own that
+   only pool_shrink() ever contends for.  An empty magazine is refilled with MAG_BATCH
+   pages, and a full one drained of MAG_BATCH pages, under a
+   single acquisition of the pool's lock.  Pages in magazines are
+   allocated as far as the buddy allocator is concerned, so a
+   request the free lists cannot satisfy first returns every
+   magazine's pages to the pool ("shrinks" it) and tries again. */
+
+/* Largest block kept on a free list, as a power of two pages.
+   2**MAX_ORDER pages is 4 GB. */
+#define MAX_ORDER 20
+
+/* Buddy allocator state of one page. */
+struct buddy_page {
+	struct list_elem elem;          /* Element in a free list. */
+	int order;                      /* Order of the free block this page
+	                                   begins, or NOT_FREE. */
+};
+
+/* ORDER of a page that does not begin a free block. */
+#define NOT_FREE (-1)
+
+/* Most pages a magazine holds, and the number of pages moved
+   between a magazine and its pool at once. */
+#define MAG_SIZE 32
+#define MAG_BATCH 16
+
+/* A CPU's cache of free pages from one pool. */
+struct magazine {
+	struct spinlock lock;           /* Protects members below. */
+	size_t cnt;                     /* Number of PAGES. */
+	void *pages[MAG_SIZE];          /* Free pages, most recent last. */
+};
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
-	struct bitmap *used_map;        /* Bitmap of free pages. */
+	struct bitmap *used_map;        /* Bitmap of used pages. */
 	uint8_t *base;                  /* Base of pool. */
+	struct buddy_page *pages;       /* One per page of the pool. */
+	struct list free_lists[MAX_ORDER + 1];  /* Free blocks by order. */
+	struct magazine mags[NCPU_MAX]; /* Per-CPU caches of free pages. */
+
+	/* Statistics. */
+	uint64_t alloc_cnt;             /* Allocation requests. */
+	uint64_t free_cnt;              /* Free requests. */
+	uint64_t lock_cnt;              /* Acquisitions of LOCK. */
+	uint64_t shrink_cnt;            /* Magazine pages returned to the pool. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -38,10 +101,21 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+/* Cache single pages in per-CPU magazines?  Cleared by
+   -no-magazines. */
+bool palloc_magazines = true;
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_range (struct pool *, size_t page_cnt);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void *magazine_get (struct pool *);
+static void magazine_put (struct pool *, void *page);
+static void pool_shrink (struct pool *);
+static void pool_lock (struct pool *);
+static void count (uint64_t *cnt);
 
 /* multiboot info */
 struct multiboot_info {
@@ -224,11 +298,13 @@ split:
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				free_range (pool, page_idx, page_cnt);
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				free_range (pool, page_idx, page_cnt);
 			}
 		}
 	}
@@ -262,16 +338,25 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
-	void *pages;
-
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+	void *pages = NULL;
+
+	count (&pool->alloc_cnt);
+	if (page_cnt == 1 && palloc_magazines)
+		pages = magazine_get (pool);
+	else {
+		pool_lock (pool);
+		size_t page_idx = alloc_range (pool, page_cnt);
+		if (page_idx == BITMAP_ERROR) {
+			pool_shrink (pool);
+			page_idx = alloc_range (pool, page_cnt);
+		}
+		if (page_idx != BITMAP_ERROR) {
+			ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+			bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+			pages = pool->base + PGSIZE * page_idx;
+		}
+		lock_release (&pool->lock);
+	}
 
 	if (pages) {
 		if (flags & PAL_ZERO)
@@ -318,8 +403,17 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
+	count (&pool->free_cnt);
+	if (page_cnt == 1 && palloc_magazines) {
+		magazine_put (pool, pages);
+		return;
+	}
+
+	pool_lock (pool);
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	free_range (pool, page_idx, page_cnt);
+	lock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +422,25 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Prints statistics about POOL, called NAME. */
+static void
+print_pool_stats (const char *name, const struct pool *pool) {
+	uint64_t per_100 = pool->alloc_cnt ? pool->lock_cnt * 100 / pool->alloc_cnt : 0;
+
+	printf ("%s pool: %"PRIu64" allocs, %"PRIu64" frees, "
+			"%"PRIu64" lock acquisitions (%"PRIu64".%02"PRIu64" per alloc), "
+			"%"PRIu64" pages shrunk\n",
+			name, pool->alloc_cnt, pool->free_cnt, pool->lock_cnt,
+			per_100 / 100, per_100 % 100, pool->shrink_cnt);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	print_pool_stats ("Kernel", &kernel_pool);
+	print_pool_stats ("User", &user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -336,6 +449,8 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t buddy_pages = ROUND_UP (pgcnt * sizeof *p->pages, PGSIZE);
+	size_t i;
 
 	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
@@ -345,6 +460,20 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
 	bitmap_set_all(p->used_map, true);
 
 	*bm_base += bm_pages;
+
+	// Buddy state follows the bitmap.  No block is free yet.
+	p->pages = *bm_base;
+	for (i = 0; i < pgcnt; i++)
+		p->pages[i].order = NOT_FREE;
+	for (i = 0; i <= MAX_ORDER; i++)
+		list_init (&p->free_lists[i]);
+	for (i = 0; i < NCPU_MAX; i++) {
+		spin_init (&p->mags[i].lock, "magazine");
+		p->mags[i].cnt = 0;
+	}
+	p->alloc_cnt = p->free_cnt = p->lock_cnt = p->shrink_cnt = 0;
+
+	*bm_base += buddy_pages;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -356,3 +485,256 @@ page_from_pool (const struct pool *pool, void *page) {
 	size_t end_page = start_page + bitmap_size (pool->used_map);
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the number of pages in POOL. */
+static size_t
+pool_size (const struct pool *pool) {
+	return bitmap_size (pool->used_map);
+}
+
+/* Puts the free block of 2**ORDER pages at PAGE_IDX in POOL on
+   its free list. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order) {
+	pool->pages[page_idx].order = order;
+	list_push_front (&pool->free_lists[order], &pool->pages[page_idx].elem);
+}
+
+/* Takes the free block at PAGE_IDX in POOL off its free list. */
+static void
+remove_block (struct pool *pool, size_t page_idx) {
+	ASSERT (pool->pages[page_idx].order != NOT_FREE);
+	list_remove (&pool->pages[page_idx].elem);
+	pool->pages[page_idx].order = NOT_FREE;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy for as long as the buddy is a free block of
+   the same order. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) {
+	while (order < MAX_ORDER) {
+		size_t size = (size_t) 1 << order;
+		size_t buddy = page_idx ^ size;
+
+		if (buddy + size > pool_size (pool)
+				|| pool->pages[buddy].order != order)
+			break;
+		remove_block (pool, buddy);
+		page_idx &= ~size;
+		order++;
+	}
+	push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, as the
+   largest aligned blocks that the range holds. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	size_t end = page_idx + page_cnt;
+
+	while (page_idx < end) {
+		int order = 0;
+
+		while (order < MAX_ORDER && page_idx % ((size_t) 2 << order) == 0
+				&& page_idx + ((size_t) 2 << order) <= end)
+			order++;
+		free_block (pool, page_idx, order);
+		page_idx += (size_t) 1 << order;
+	}
+}
+
+/* Takes PAGE_CNT contiguous pages from POOL's free lists and
+   returns the index of the first, or BITMAP_ERROR if no free
+   block is large enough. */
+static size_t
+alloc_range (struct pool *pool, size_t page_cnt) {
+	int order = 0, k;
+	size_t page_idx;
+
+	if (page_cnt == 0)
+		return BITMAP_ERROR;
+	while (order <= MAX_ORDER && ((size_t) 1 << order) < page_cnt)
+		order++;
+	for (k = order; k <= MAX_ORDER; k++)
+		if (!list_empty (&pool->free_lists[k]))
+			break;
+	if (k > MAX_ORDER)
+		return BITMAP_ERROR;
+
+	page_idx = list_entry (list_front (&pool->free_lists[k]),
+			struct buddy_page, elem) - pool->pages;
+	remove_block (pool, page_idx);
+
+	// Split down to ORDER, freeing the upper halves.
+	while (k > order) {
+		k--;
+		push_block (pool, page_idx + ((size_t) 1 << k), k);
+	}
+
+	// Give back the pages past PAGE_CNT.
+	if (page_cnt < (size_t) 1 << order)
+		free_range (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+	return page_idx;
+}
+
+/* Adds one to *CNT, a statistic updated by every CPU, both with
+   interrupts off and with a pool's lock held. */
+static void
+count (uint64_t *cnt) {
+	asm volatile ("lock incq %0" : "+m" (*cnt));
+}
+
+/* Acquires POOL's lock, counting the acquisition. */
+static void
+pool_lock (struct pool *pool) {
+	lock_acquire (&pool->lock);
+	count (&pool->lock_cnt);
+}
+
+/* Takes up to CNT single pages from POOL's free lists into
+   PAGES and returns their number.  POOL's lock must be held. */
+static size_t
+take_pages (struct pool *pool, void **pages, size_t cnt) {
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&pool->lock));
+
+	for (i = 0; i < cnt; i++) {
+		size_t page_idx = alloc_range (pool, 1);
+
+		if (page_idx == BITMAP_ERROR)
+			break;
+		ASSERT (!bitmap_test (pool->used_map, page_idx));
+		bitmap_mark (pool->used_map, page_idx);
+		pages[i] = pool->base + PGSIZE * page_idx;
+	}
+	return i;
+}
+
+/* Returns the CNT single pages in PAGES to POOL's free lists.
+   POOL's lock must be held. */
+static void
+put_pages (struct pool *pool, void **pages, size_t cnt) {
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&pool->lock));
+
+	for (i = 0; i < cnt; i++) {
+		size_t page_idx = pg_no (pages[i]) - pg_no (pool->base);
+
+		ASSERT (bitmap_test (pool->used_map, page_idx));
+		bitmap_reset (pool->used_map, page_idx);
+		free_block (pool, page_idx, 0);
+	}
+}
+
+/* Returns a page from the running CPU's magazine for POOL,
+   refilling the magazine from POOL if it is empty, or a null
+   pointer if POOL has no free page at all. */
+static void *
+magazine_get (struct pool *pool) {
+	void *batch[MAG_BATCH];
+	struct magazine *mag;
+	enum intr_level old_level;
+	void *page = NULL;
+	size_t cnt, i;
+
+	old_level = intr_disable ();
+	mag = &pool->mags[cpu_current ()->id];
+	spin_lock (&mag->lock);
+	if (mag->cnt > 0)
+		page = mag->pages[--mag->cnt];
+	spin_unlock (&mag->lock);
+	intr_set_level (old_level);
+	if (page != NULL)
+		return page;
+
+	pool_lock (pool);
+	cnt = take_pages (pool, batch, MAG_BATCH);
+	if (cnt == 0) {
+		pool_shrink (pool);
+		cnt = take_pages (pool, batch, MAG_BATCH);
+	}
+	lock_release (&pool->lock);
+	if (cnt == 0)
+		return NULL;
+
+	/* Keep the first page and cache the rest, unless other
+	   threads filled the magazine while we were refilling it. */
+	old_level = intr_disable ();
+	mag = &pool->mags[cpu_current ()->id];
+	spin_lock (&mag->lock);
+	for (i = 1; i < cnt && mag->cnt < MAG_SIZE; i++)
+		mag->pages[mag->cnt++] = batch[i];
+	spin_unlock (&mag->lock);
+	intr_set_level (old_level);
+
+	if (i < cnt) {
+		pool_lock (pool);
+		put_pages (pool, batch + i, cnt - i);
+		lock_release (&pool->lock);
+	}
+	return batch[0];
+}
+
+/* Puts PAGE, a single page from POOL, in the running CPU's
+   magazine for POOL, first draining the magazine's MAG_BATCH
+   oldest pages to POOL if it is full. */
+static void
+magazine_put (struct pool *pool, void *page) {
+	void *batch[MAG_BATCH];
+	struct magazine *mag;
+	enum intr_level old_level;
+	size_t cnt = 0;
+
+	ASSERT (bitmap_test (pool->used_map, pg_no (page) - pg_no (pool->base)));
+
+	old_level = intr_disable ();
+	mag = &pool->mags[cpu_current ()->id];
+	spin_lock (&mag->lock);
+#ifndef NDEBUG
+	for (size_t i = 0; i < mag->cnt; i++)
+		ASSERT (mag->pages[i] != page);
+#endif
+	if (mag->cnt == MAG_SIZE) {
+		cnt = MAG_BATCH;
+		memcpy (batch, mag->pages, sizeof batch);
+		memmove (mag->pages, mag->pages + MAG_BATCH,
+				(MAG_SIZE - MAG_BATCH) * sizeof *mag->pages);
+		mag->cnt -= MAG_BATCH;
+	}
+	mag->pages[mag->cnt++] = page;
+	spin_unlock (&mag->lock);
+	intr_set_level (old_level);
+
+	if (cnt > 0) {
+		pool_lock (pool);
+		put_pages (pool, batch, cnt);
+		lock_release (&pool->lock);
+	}
+}
+
+/* Returns every page in every CPU's magazine for POOL to POOL's
+   free lists, where they can merge into larger blocks.  Called
+   when the free lists cannot satisfy a request.  POOL's lock
+   must be held. */
+static void
+pool_shrink (struct pool *pool) {
+	enum intr_level old_level;
+	int i;
+
+	ASSERT (lock_held_by_current_thread (&pool->lock));
+
+	old_level = intr_disable ();
+	for (i = 0; i < cpu_cnt; i++) {
+		struct magazine *mag = &pool->mags[i];
+
+		spin_lock (&mag->lock);
+		pool->shrink_cnt += mag->cnt;
+		put_pages (pool, mag->pages, mag->cnt);
+		mag->cnt = 0;
+		spin_unlock (&mag->lock);
+	}
+	intr_set_level (old_level);
+}
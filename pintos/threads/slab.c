@@ -0,0 +1,267 @@
+#include "threads/slab.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   malloc() rounds each request up to a power of 2, which wastes
+   up to half of every block for structures whose size is not
+   one.  An object cache instead hands out objects of one exact
+   size, for the kernel's most numerous structures.
+
+   A cache carves single pages, called "slabs", into as many
+   objects as fit after a header.  The header holds a bitmap with
+   one bit per object, set if the object is in use.  The cache
+   keeps its slabs on three lists, by whether they have free
+   objects and objects in use: partial, full and empty.  An
+   allocation takes an object from a partial slab if there is
+   one, and otherwise from an empty slab or a new one.  A cache
+   keeps at most one empty slab, returning any other to the page
+   allocator as soon as it empties.
+
+   A cache may have a constructor, which initializes each object
+   once, when its slab is created, rather than on every
+   allocation.  Objects must be freed in their constructed state,
+   e.g. with any locks they contain released. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* An object cache. */
+struct kmem_cache {
+	const char *name;           /* Name, for statistics. */
+	size_t size;                /* Size of each object requested. */
+	size_t obj_size;            /* SIZE rounded up to the alignment. */
+	size_t objs_ofs;            /* Offset of the first object in a slab. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	kmem_ctor_func *ctor;       /* Constructor, or null. */
+	struct list_elem elem;      /* Element in ALL_CACHES. */
+
+	struct lock lock;           /* Protects the members below. */
+	struct list partial;        /* Slabs with free and used objects. */
+	struct list full;           /* Slabs with no free objects. */
+	struct list empty;          /* Slabs with no used objects. */
+	size_t slab_cnt;            /* Number of slabs. */
+	size_t obj_cnt;             /* Number of objects in use. */
+	size_t peak_slab_cnt;       /* Most slabs at once. */
+	size_t peak_obj_cnt;        /* Most objects in use at once. */
+	uint64_t alloc_cnt;         /* Number of allocations. */
+};
+
+/* A slab: the header at the start of each page of objects. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in one of CACHE's lists. */
+	size_t used_cnt;            /* Number of objects in use. */
+	struct bitmap *used_map;    /* Objects in use, following the header. */
+};
+
+/* Every cache, for statistics. */
+static struct list all_caches;
+static struct lock all_caches_lock;
+
+/* Initializes the object cache allocator. */
+void
+kmem_init (void) {
+	list_init (&all_caches);
+	lock_init (&all_caches_lock);
+}
+
+/* Returns the offset of the first of OBJ_CNT objects aligned to
+   ALIGN in a slab. */
+static size_t
+objs_offset (size_t obj_cnt, size_t align) {
+	return ROUND_UP (sizeof (struct slab) + bitmap_buf_size (obj_cnt), align);
+}
+
+/* Creates and returns a cache of objects of SIZE bytes, aligned
+   to ALIGN bytes, a power of 2, or to the word size if ALIGN is
+   0.  If CTOR is nonnull, it initializes each object when its
+   slab is created.  NAME identifies the cache in statistics and
+   must stay valid.  Returns a null pointer if memory is not
+   available. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, size_t align,
+		kmem_ctor_func *ctor) {
+	struct kmem_cache *c;
+	size_t cnt;
+
+	if (align == 0)
+		align = sizeof (void *);
+	ASSERT (size > 0);
+	ASSERT ((align & (align - 1)) == 0);
+
+	c = malloc (sizeof *c);
+	if (c == NULL)
+		return NULL;
+	c->name = name;
+	c->size = size;
+	c->obj_size = ROUND_UP (size, align);
+	for (cnt = PGSIZE / c->obj_size; cnt > 0; cnt--)
+		if (objs_offset (cnt, align) + cnt * c->obj_size <= PGSIZE)
+			break;
+	ASSERT (cnt > 0);
+	c->objs_per_slab = cnt;
+	c->objs_ofs = objs_offset (cnt, align);
+	c->ctor = ctor;
+
+	lock_init (&c->lock);
+	list_init (&c->partial);
+	list_init (&c->full);
+	list_init (&c->empty);
+	c->slab_cnt = c->obj_cnt = 0;
+	c->peak_slab_cnt = c->peak_obj_cnt = 0;
+	c->alloc_cnt = 0;
+
+	lock_acquire (&all_caches_lock);
+	list_push_back (&all_caches, &c->elem);
+	lock_release (&all_caches_lock);
+	return c;
+}
+
+/* Returns object IDX of slab S. */
+static void *
+slab_obj (struct kmem_cache *c, struct slab *s, size_t idx) {
+	return (uint8_t *) s + c->objs_ofs + idx * c->obj_size;
+}
+
+/* Returns the slab that holds OBJ, an object of cache C. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	ASSERT (s->magic == SLAB_MAGIC);
+	ASSERT (s->cache == c);
+	ASSERT (pg_ofs (obj) >= c->objs_ofs);
+	ASSERT ((pg_ofs (obj) - c->objs_ofs) % c->obj_size == 0);
+	return s;
+}
+
+/* Allocates a page for a new slab of cache C, constructing its
+   objects, and returns it, or a null pointer if no page is
+   available.  C's lock must not be held, since the constructor
+   may take locks of its own. */
+static struct slab *
+slab_create (struct kmem_cache *c) {
+	struct slab *s = palloc_get_page (0);
+	size_t i;
+
+	if (s == NULL)
+		return NULL;
+	s->magic = SLAB_MAGIC;
+	s->cache = c;
+	s->used_cnt = 0;
+	s->used_map = bitmap_create_in_buf (c->objs_per_slab, s + 1,
+			bitmap_buf_size (c->objs_per_slab));
+	if (c->ctor != NULL)
+		for (i = 0; i < c->objs_per_slab; i++)
+			c->ctor (slab_obj (c, s, i));
+	return s;
+}
+
+/* Obtains and returns an object from cache C, or a null pointer
+   if memory is not available.  The object is in the state its
+   constructor or its last user left it in. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) {
+	struct slab *s;
+	size_t idx;
+
+	lock_acquire (&c->lock);
+	if (!list_empty (&c->partial))
+		s = list_entry (list_pop_front (&c->partial), struct slab, elem);
+	else if (!list_empty (&c->empty))
+		s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+	else {
+		lock_release (&c->lock);
+		s = slab_create (c);
+		if (s == NULL)
+			return NULL;
+		lock_acquire (&c->lock);
+		if (++c->slab_cnt > c->peak_slab_cnt)
+			c->peak_slab_cnt = c->slab_cnt;
+	}
+
+	idx = bitmap_scan_and_flip (s->used_map, 0, 1, false);
+	ASSERT (idx != BITMAP_ERROR);
+	if (++s->used_cnt < c->objs_per_slab)
+		list_push_front (&c->partial, &s->elem);
+	else
+		list_push_front (&c->full, &s->elem);
+
+	c->alloc_cnt++;
+	if (++c->obj_cnt > c->peak_obj_cnt)
+		c->peak_obj_cnt = c->obj_cnt;
+	lock_release (&c->lock);
+	return slab_obj (c, s, idx);
+}
+
+/* Returns OBJ, obtained from cache C, to C.  Does nothing if OBJ
+   is null. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) {
+	struct slab *s;
+	size_t idx;
+
+	if (obj == NULL)
+		return;
+	s = obj_to_slab (c, obj);
+	idx = (pg_ofs (obj) - c->objs_ofs) / c->obj_size;
+
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs, unless
+	   it must keep its constructed state. */
+	if (c->ctor == NULL)
+		memset (obj, 0xcc, c->size);
+#endif
+
+	lock_acquire (&c->lock);
+	ASSERT (bitmap_test (s->used_map, idx));
+	bitmap_reset (s->used_map, idx);
+	c->obj_cnt--;
+	list_remove (&s->elem);
+	if (--s->used_cnt > 0)
+		list_push_front (&c->partial, &s->elem);
+	else if (list_empty (&c->empty))
+		list_push_front (&c->empty, &s->elem);
+	else {
+		c->slab_cnt--;
+		s->magic = 0;
+		palloc_free_page (s);
+	}
+	lock_release (&c->lock);
+}
+
+/* Prints statistics for each cache: the bytes requested for its
+   objects, next to the bytes of the slabs that hold them, now
+   and at their peaks. */
+void
+kmem_print_stats (void) {
+	struct list_elem *e;
+
+	lock_acquire (&all_caches_lock);
+	for (e = list_begin (&all_caches); e != list_end (&all_caches);
+			e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+		printf ("Cache %s: %zu-byte objects, %zu per slab, "
+				"%"PRIu64" allocs\n", c->name, c->size, c->objs_per_slab,
+				c->alloc_cnt);
+		printf ("Cache %s: %zu bytes requested in %zu bytes of slabs, "
+				"peak %zu bytes requested in %zu bytes of slabs\n",
+				c->name, c->obj_cnt * c->size, c->slab_cnt * PGSIZE,
+				c->peak_obj_cnt * c->size, c->peak_slab_cnt * PGSIZE);
+	}
+	lock_release (&all_caches_lock);
+}
@@ -0,0 +1,72 @@
+#include "threads/spinlock.h"
+#include <debug.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+
+/* Initializes LOCK as unlocked.  NAME is used in debugging
+   output. */
+void
+spin_init (struct spinlock *lock, const char *name) {
+	ASSERT (lock != NULL);
+
+	lock->locked = 0;
+	lock->cpu = NULL;
+	lock->name = name;
+}
+
+/* Atomically sets LOCK's flag and returns its previous value. */
+static inline int
+test_and_set (struct spinlock *lock) {
+	int old = 1;
+
+	asm volatile ("xchgl %0, %1"
+			: "+r" (old), "+m" (lock->locked) : : "memory");
+	return old;
+}
+
+/* Acquires LOCK, spinning until it becomes available.
+   Interrupts must be off, and the current CPU must not already
+   hold LOCK. */
+void
+spin_lock (struct spinlock *lock) {
+	ASSERT (lock != NULL);
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (!spin_held_by_current_cpu (lock));
+
+	while (test_and_set (lock))
+		while (lock->locked)
+			asm volatile ("pause" : : : "memory");
+	lock->cpu = cpu_current ();
+}
+
+/* Tries to acquire LOCK without spinning.  Returns true if
+   successful, false if another CPU holds it.  Interrupts must
+   be off. */
+bool
+spin_try_lock (struct spinlock *lock) {
+	ASSERT (lock != NULL);
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (test_and_set (lock))
+		return false;
+	lock->cpu = cpu_current ();
+	return true;
+}
+
+/* Releases LOCK, which must be held by the current CPU. */
+void
+spin_unlock (struct spinlock *lock) {
+	ASSERT (lock != NULL);
+	ASSERT (spin_held_by_current_cpu (lock));
+
+	lock->cpu = NULL;
+	asm volatile ("movl $0, %0" : "+m" (lock->locked) : : "memory");
+}
+
+/* Returns true if the current CPU holds LOCK, false otherwise. */
+bool
+spin_held_by_current_cpu (const struct spinlock *lock) {
+	ASSERT (lock != NULL);
+
+	return lock->locked && lock->cpu == cpu_current ();
+}
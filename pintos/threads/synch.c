@@ -45,6 +45,7 @@ void
 sema_init (struct semaphore *sema, unsigned value) {
 	ASSERT (sema != NULL);
 
+	spin_init (&sema->lock, "sema");
 	sema->value = value;
 	list_init (&sema->waiters);
 }
@@ -65,11 +66,14 @@ sema_down (struct semaphore *sema) {
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
+	spin_lock (&sema->lock);
 	while (sema->value == 0) {
 		list_push_back (&sema->waiters, &thread_current ()->elem);
-		thread_block ();
+		thread_block_unlock (&sema->lock);
+		spin_lock (&sema->lock);
 	}
 	sema->value--;
+	spin_unlock (&sema->lock);
 	intr_set_level (old_level);
 }
 
@@ -86,6 +90,7 @@ sema_try_down (struct semaphore *sema) {
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
+	spin_lock (&sema->lock);
 	if (sema->value > 0)
 	{
 		sema->value--;
@@ -93,6 +98,7 @@ sema_try_down (struct semaphore *sema) {
 	}
 	else
 		success = false;
+	spin_unlock (&sema->lock);
 	intr_set_level (old_level);
 
 	return success;
@@ -109,11 +115,14 @@ sema_up (struct semaphore *sema) {
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
+	spin_lock (&sema->lock);
 	if (!list_empty (&sema->waiters))
 		thread_unblock (list_entry (list_pop_front (&sema->waiters),
 					struct thread, elem));
 	sema->value++;
+	spin_unlock (&sema->lock);
 	intr_set_level (old_level);
+	thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -321,3 +330,77 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 	while (!list_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
+
+/* Initializes RW as a readers-writer lock.  Any number of
+   readers may hold RW at once, or a single writer.  Waiting
+   writers take precedence over new readers, so a steady stream
+   of readers cannot starve a writer.  Like a lock, RW may not be
+   acquired recursively. */
+void
+rw_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	cond_init (&rw->readers);
+	cond_init (&rw->writers);
+	rw->reader_cnt = 0;
+	rw->writer = false;
+	rw->waiting_writers = 0;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it. */
+void
+rw_read_acquire (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->lock);
+	while (rw->writer || rw->waiting_writers > 0)
+		cond_wait (&rw->readers, &rw->lock);
+	rw->reader_cnt++;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rw_read_release (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_acquire (&rw->lock);
+	ASSERT (rw->reader_cnt > 0);
+	if (--rw->reader_cnt == 0)
+		cond_signal (&rw->writers, &rw->lock);
+	lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it. */
+void
+rw_write_acquire (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->lock);
+	rw->waiting_writers++;
+	while (rw->writer || rw->reader_cnt > 0)
+		cond_wait (&rw->writers, &rw->lock);
+	rw->waiting_writers--;
+	rw->writer = true;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rw_write_release (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_acquire (&rw->lock);
+	ASSERT (rw->writer);
+	rw->writer = false;
+	if (rw->waiting_writers > 0)
+		cond_signal (&rw->writers, &rw->lock);
+	else
+		cond_broadcast (&rw->readers, &rw->lock);
+	lock_release (&rw->lock);
+}
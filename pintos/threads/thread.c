@@ -4,9 +4,11 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/lapic.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,12 +26,15 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* Idle thread. */
-static struct thread *idle_thread;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, wait in the run queues
+   of a struct cpu (see threads/cpu.h).  There is one FIFO run
+   queue per priority level, and bit P of the CPU's ready_mask is
+   set exactly when its queue P is nonempty, so the highest ready
+   priority is found with a single bit scan. */
+#if PRI_MAX >= CPU_RQ_LEVELS
+#error ready_mask requires PRI_MAX < CPU_RQ_LEVELS
+#endif
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -37,17 +42,8 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
-/* Thread destruction requests */
-static struct list destruction_req;
-
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
-
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
@@ -57,10 +53,17 @@ bool thread_mlfqs;
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
+static void ready_queue_push (struct cpu *, struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max_priority (const struct cpu *);
+static struct thread *ready_queue_pop (struct cpu *);
+static struct thread *steal_thread (struct cpu *);
 static void do_schedule(int status);
 static void schedule (void);
+static void schedule_tail (void);
 static tid_t allocate_tid (void);
 
 /* Returns true if T appears to point to a valid thread. */
@@ -106,14 +109,16 @@ thread_init (void) {
 	lgdt (&gdt_ds);
 
 	/* Init the globla thread context */
+	cpu_init ();
 	lock_init (&tid_lock);
-	list_init (&ready_list);
-	list_init (&destruction_req);
 
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread ();
 	init_thread (initial_thread, "main", PRI_DEFAULT);
+	initial_thread->cpu = cpu_current ();
+	initial_thread->running_cpu = initial_thread->cpu;
 	initial_thread->status = THREAD_RUNNING;
+	initial_thread->on_cpu = true;
 	initial_thread->tid = allocate_tid ();
 }
 
@@ -129,36 +134,100 @@ thread_start (void) {
 	/* Start preemptive thread scheduling. */
 	intr_enable ();
 
-	/* Wait for the idle thread to initialize idle_thread. */
+	/* Wait for the idle thread to register itself with the CPU. */
 	sema_down (&idle_started);
 }
 
+/* Sets up the idle thread of application processor C, which
+   will run it first, on the stack at the top of its page, when
+   it calls thread_start_ap().  Called by the BSP, since C has no
+   thread to sleep in until then. */
+struct thread *
+thread_create_idle (struct cpu *c) {
+	struct thread *t;
+	char name[16];
+
+	t = palloc_get_page (PAL_ZERO | PAL_ASSERT);
+	snprintf (name, sizeof name, "idle%d", c->id);
+	init_thread (t, name, PRI_MIN);
+	t->tid = allocate_tid ();
+	t->cpu = c;
+	t->running_cpu = c;
+	t->status = THREAD_RUNNING;
+	t->on_cpu = true;
+	c->idle = t;
+	return t;
+}
+
+/* Starts scheduling threads on the executing application
+   processor, as its idle thread.  Interrupts must be off and
+   the CPU must be fully initialized. */
+void
+thread_start_ap (void) {
+	struct cpu *c = cpu_current ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (thread_current () == c->idle);
+
+	c->online = true;
+	intr_enable ();
+	idle_loop ();
+}
+
 /* Called by the timer interrupt handler at each timer tick.
    Thus, this function runs in an external interrupt context. */
 void
 thread_tick (void) {
 	struct thread *t = thread_current ();
+	struct cpu *c = cpu_current ();
 
 	/* Update statistics. */
-	if (t == idle_thread)
-		idle_ticks++;
+	if (t == c->idle)
+		c->idle_ticks++;
 #ifdef USERPROG
 	else if (t->pml4 != NULL)
-		user_ticks++;
+		c->user_ticks++;
 #endif
 	else
-		kernel_ticks++;
+		c->kernel_ticks++;
 
 	/* Enforce preemption. */
-	if (++thread_ticks >= TIME_SLICE)
+	if (++c->thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
 }
 
-/* Prints thread statistics. */
+/* Prints thread statistics, summed over all CPUs, followed by a
+   per-CPU breakdown when more than one CPU is online. */
 void
 thread_print_stats (void) {
+	long long idle, kernel, user;
+	int i;
+
+	thread_get_stats (&idle, &kernel, &user);
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-			idle_ticks, kernel_ticks, user_ticks);
+			idle, kernel, user);
+	if (cpu_cnt > 1)
+		for (i = 0; i < cpu_cnt; i++)
+			printf ("CPU %d: %lld idle ticks, %lld kernel ticks, "
+					"%lld user ticks, %lld threads stolen\n", i,
+					cpus[i].idle_ticks, cpus[i].kernel_ticks,
+					cpus[i].user_ticks, cpus[i].steal_cnt);
+}
+
+/* Stores the tick counters printed by thread_print_stats() into
+   IDLE, KERNEL and USER, so that callers can measure deltas. */
+void
+thread_get_stats (long long *idle, long long *kernel, long long *user) {
+	enum intr_level old_level = intr_disable ();
+	int i;
+
+	*idle = *kernel = *user = 0;
+	for (i = 0; i < cpu_cnt; i++) {
+		*idle += cpus[i].idle_ticks;
+		*kernel += cpus[i].kernel_ticks;
+		*user += cpus[i].user_ticks;
+	}
+	intr_set_level (old_level);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -173,9 +242,10 @@ thread_print_stats (void) {
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   The new thread is queued at PRIORITY on some CPU's run
+   queues.  If that is this CPU and PRIORITY is higher than the
+   running thread's, the running thread yields to it before
+   thread_create() returns. */
 tid_t
 thread_create (const char *name, int priority,
 		thread_func *function, void *aux) {
@@ -223,6 +293,7 @@ thread_create (const char *name, int priority,
 
 	/* Add to run queue. */
 	thread_unblock (t);
+	thread_preempt ();
 
 	return tid;
 }
@@ -241,6 +312,19 @@ thread_block (void) {
 	schedule ();
 }
 
+/* Releases LOCK and puts the current thread to sleep, as one
+   step: a thread_unblock() by another CPU that takes LOCK after
+   this thread has queued itself cannot come before the block.
+   Interrupts must be off. */
+void
+thread_block_unlock (struct spinlock *lock) {
+	ASSERT (!intr_context ());
+	ASSERT (intr_get_level () == INTR_OFF);
+	thread_current ()->status = THREAD_BLOCKED;
+	spin_unlock (lock);
+	schedule ();
+}
+
 /* Transitions a blocked thread T to the ready-to-run state.
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
@@ -248,18 +332,44 @@ thread_block (void) {
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Call thread_preempt() afterward once it
+   is safe to switch.  If T is queued on another CPU, that CPU is
+   sent an IPI to look at its run queues. */
 void
 thread_unblock (struct thread *t) {
 	enum intr_level old_level;
+	struct cpu *c;
 
 	ASSERT (is_thread (t));
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
-	list_push_back (&ready_list, &t->elem);
+	c = t->cpu != NULL ? t->cpu : cpu_current ();
+	spin_lock (&c->rq_lock);
+	ready_queue_push (c, t);
 	t->status = THREAD_READY;
+	spin_unlock (&c->rq_lock);
+	if (c != cpu_current ())
+		lapic_send_ipi (c->lapic_id, LAPIC_RESCHED_VEC);
+	intr_set_level (old_level);
+}
+
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  In an interrupt handler, the yield is
+   deferred until the handler returns. */
+void
+thread_preempt (void) {
+	enum intr_level old_level = intr_disable ();
+	bool higher = (ready_queue_max_priority (cpu_current ())
+			> thread_current ()->priority);
 	intr_set_level (old_level);
+
+	if (!higher)
+		return;
+	if (intr_context ())
+		intr_yield_on_return ();
+	else
+		thread_yield ();
 }
 
 /* Returns the name of the running thread. */
@@ -313,22 +423,59 @@ thread_exit (void) {
    may be scheduled again immediately at the scheduler's whim. */
 void
 thread_yield (void) {
-	struct thread *curr = thread_current ();
 	enum intr_level old_level;
 
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
-	if (curr != idle_thread)
-		list_push_back (&ready_list, &curr->elem);
 	do_schedule (THREAD_READY);
 	intr_set_level (old_level);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY, yielding
+   if it no longer has the highest priority. */
 void
 thread_set_priority (int new_priority) {
-	thread_current ()->priority = new_priority;
+	thread_change_priority (thread_current (), new_priority);
+	thread_preempt ();
+}
+
+/* Changes T's priority to PRIORITY.  If T is waiting in a run
+   queue, it moves to the tail of the queue for its new priority
+   in constant time.  Does not preempt; see thread_preempt().
+
+   A thread is in a run queue exactly when it is THREAD_READY
+   with a CPU, both set under that CPU's run queue lock, so the
+   check is repeated under the lock in case T was just taken
+   from the queue by a CPU that is about to run it. */
+void
+thread_change_priority (struct thread *t, int priority) {
+	enum intr_level old_level;
+
+	ASSERT (is_thread (t));
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	old_level = intr_disable ();
+	for (;;) {
+		struct cpu *c = t->cpu;
+
+		if (t->status != THREAD_READY || c == NULL) {
+			t->priority = priority;
+			break;
+		}
+		spin_lock (&c->rq_lock);
+		if (t->status == THREAD_READY && t->cpu == c) {
+			if (t->priority != priority) {
+				ready_queue_remove (t);
+				t->priority = priority;
+				ready_queue_push (c, t);
+			}
+			spin_unlock (&c->rq_lock);
+			break;
+		}
+		spin_unlock (&c->rq_lock);
+	}
+	intr_set_level (old_level);
 }
 
 /* Returns the current thread's priority. */
@@ -366,20 +513,29 @@ thread_get_recent_cpu (void) {
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
+   The BSP's idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   point it registers itself as its CPU's idle thread, "up"s the
+   semaphore passed to it to enable thread_start() to continue,
+   and immediately blocks.  After that, the idle thread never
+   appears in a run queue.  It is returned by
+   next_thread_to_run() as a special case when there is no
+   thread to run or steal.  Application processors start out
+   running theirs; see thread_create_idle(). */
 static void
 idle (void *idle_started_ UNUSED) {
 	struct semaphore *idle_started = idle_started_;
 
-	idle_thread = thread_current ();
+	intr_disable ();
+	cpu_current ()->idle = thread_current ();
+	intr_enable ();
 	sema_up (idle_started);
+	idle_loop ();
+}
 
+/* Body of every CPU's idle thread. */
+static void
+idle_loop (void) {
 	for (;;) {
 		/* Let someone else run. */
 		intr_disable ();
@@ -406,6 +562,7 @@ static void
 kernel_thread (thread_func *function, void *aux) {
 	ASSERT (function != NULL);
 
+	schedule_tail ();     /* Let go of the thread we switched from. */
 	intr_enable ();       /* The scheduler runs with interrupts off. */
 	function (aux);       /* Execute the thread function. */
 	thread_exit ();       /* If function() returns, kill the thread. */
@@ -546,17 +703,104 @@ init_thread (struct thread *t, const char *name, int priority) {
     sema_init(&t->wait_sema, 0);
 #endif
 }
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+/* Appends T to C's run queue for T's priority, and records C as
+   the CPU T is waiting on.  The caller must hold C's run queue
+   lock. */
+static void
+ready_queue_push (struct cpu *c, struct thread *t) {
+	ASSERT (spin_held_by_current_cpu (&c->rq_lock));
+
+	list_push_back (&c->ready_queues[t->priority], &t->elem);
+	c->ready_mask |= 1ULL << t->priority;
+	c->ready_cnt++;
+	t->cpu = c;
+}
+
+/* Removes T from the run queue it is waiting in.  The caller
+   must hold that CPU's run queue lock. */
+static void
+ready_queue_remove (struct thread *t) {
+	struct cpu *c = t->cpu;
+
+	ASSERT (spin_held_by_current_cpu (&c->rq_lock));
+
+	list_remove (&t->elem);
+	if (list_empty (&c->ready_queues[t->priority]))
+		c->ready_mask &= ~(1ULL << t->priority);
+	c->ready_cnt--;
+}
+
+/* Returns the highest priority with a thread ready on C, or -1
+   if all of C's run queues are empty.  This is a racy snapshot
+   unless the caller holds C's run queue lock. */
+static int
+ready_queue_max_priority (const struct cpu *c) {
+	uint64_t mask = c->ready_mask;
+
+	if (mask == 0)
+		return -1;
+	return 63 - __builtin_clzll (mask);
+}
+
+/* Removes and returns the first thread in C's highest-priority
+   nonempty run queue, or a null pointer if C has no ready
+   threads.  Takes C's run queue lock. */
+static struct thread *
+ready_queue_pop (struct cpu *c) {
+	struct thread *t = NULL;
+	int priority;
+
+	spin_lock (&c->rq_lock);
+	priority = ready_queue_max_priority (c);
+	if (priority >= 0) {
+		t = list_entry (list_front (&c->ready_queues[priority]),
+				struct thread, elem);
+		ready_queue_remove (t);
+		t->cpu = NULL;
+	}
+	spin_unlock (&c->rq_lock);
+	return t;
+}
+
+/* Steals a thread for SELF, whose run queues are empty, from
+   the online CPU with the most ready threads.  Returns the
+   stolen thread, or a null pointer if no other CPU has work. */
+static struct thread *
+steal_thread (struct cpu *self) {
+	struct cpu *victim = NULL;
+	struct thread *t;
+	int i;
+
+	for (i = 0; i < cpu_cnt; i++) {
+		struct cpu *c = &cpus[i];
+		if (c != self && c->online && c->ready_cnt > 0
+				&& (victim == NULL || c->ready_cnt > victim->ready_cnt))
+			victim = c;
+	}
+	if (victim == NULL)
+		return NULL;
+
+	t = ready_queue_pop (victim);
+	if (t != NULL)
+		self->steal_cnt++;
+	return t;
+}
+
+/* Chooses and returns the next thread to be scheduled on the
+   current CPU.  Should return a thread from the CPU's
+   highest-priority nonempty run queue, or failing that one
+   stolen from another CPU.  (If the running thread can continue
+   running, then it will be in a run queue.)  If there is nothing
+   to run, return the CPU's idle thread. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
-		return idle_thread;
-	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+	struct cpu *c = cpu_current ();
+	struct thread *t;
+
+	t = ready_queue_pop (c);
+	if (t == NULL)
+		t = steal_thread (c);
+	return t != NULL ? t : c->idle;
 }
 
 /* Use iretq to launch the thread */
@@ -658,34 +902,63 @@ thread_launch (struct thread *th) {
 
 /* Schedules a new process. At entry, interrupts must be off.
  * This function modify current thread's status to status and then
- * finds another thread to run and switches to it.
+ * finds another thread to run and switches to it.  A thread that
+ * stays ready goes back on this CPU's run queue, where another CPU
+ * may take it before it is switched out; see schedule().
  * It's not safe to call printf() in the schedule(). */
 static void
 do_schedule(int status) {
+	struct thread *curr = thread_current ();
+	struct cpu *c = cpu_current ();
+
 	ASSERT (intr_get_level () == INTR_OFF);
-	ASSERT (thread_current()->status == THREAD_RUNNING);
-	while (!list_empty (&destruction_req)) {
+	ASSERT (curr->status == THREAD_RUNNING);
+	struct list *destruction_req = &c->destruction_req;
+	while (!list_empty (destruction_req)) {
 		struct thread *victim =
-			list_entry (list_pop_front (&destruction_req), struct thread, elem);
+			list_entry (list_pop_front (destruction_req), struct thread, elem);
 		palloc_free_page(victim);
 	}
-	thread_current ()->status = status;
+	if (status == THREAD_READY && curr != c->idle) {
+		spin_lock (&c->rq_lock);
+		ready_queue_push (c, curr);
+		curr->status = THREAD_READY;
+		spin_unlock (&c->rq_lock);
+	} else
+		curr->status = status;
 	schedule ();
 }
 
+/* Switches from the running thread, whose status is already
+ * changed, to the next thread to run on this CPU.
+ *
+ * A thread that was just queued or woken may be picked by another
+ * CPU while this one is still running on its stack, so NEXT is not
+ * loaded until the CPU it last ran on clears its on_cpu, in
+ * schedule_tail(), after saving its context. */
 static void
 schedule (void) {
 	struct thread *curr = running_thread ();
 	struct thread *next = next_thread_to_run ();
+	struct cpu *c = cpu_current ();
 
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (curr->status != THREAD_RUNNING);
 	ASSERT (is_thread (next));
+	if (curr != next) {
+		while (next->on_cpu)
+			asm volatile ("pause" : : : "memory");
+		next->on_cpu = true;
+	}
+
 	/* Mark us as running. */
 	next->status = THREAD_RUNNING;
+	barrier ();
 
 	/* Start new time slice. */
-	thread_ticks = 0;
+	next->cpu = c;
+	next->running_cpu = c;
+	c->thread_ticks = 0;
 
 #ifdef USERPROG
 	/* Activate the new address space. */
@@ -702,12 +975,28 @@ schedule (void) {
 		   schedule(). */
 		if (curr && curr->status == THREAD_DYING && curr != initial_thread) {
 			ASSERT (curr != next);
-			list_push_back (&destruction_req, &curr->elem);
+			list_push_back (&c->destruction_req, &curr->elem);
 		}
 
 		/* Before switching the thread, we first save the information
 		 * of current running. */
+		c->prev = curr;
 		thread_launch (next);
+		schedule_tail ();
+	}
+}
+
+/* Finishes a switch on the thread switched to: the thread this CPU
+ * switched from has its context saved, so any CPU may now run it. */
+static void
+schedule_tail (void) {
+	struct cpu *c = cpu_current ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (c->prev != NULL) {
+		barrier ();
+		c->prev->on_cpu = false;
+		c->prev = NULL;
 	}
 }
 
@@ -0,0 +1,210 @@
+#include "threads/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Virtually contiguous kernel memory.
+
+   malloc() hands out blocks too big for its arenas as whole
+   pages.  Asking the page allocator for those pages contiguous
+   fails once the kernel pool is fragmented, long before it is
+   exhausted.  Such blocks come from here instead: a range of
+   kernel virtual addresses, VMALLOC_START to VMALLOC_END, past
+   the direct map of physical memory, in which each page of a
+   block is mapped to whatever free page of the kernel pool there
+   is.
+
+   A bitmap with one bit per page of the range records the pages
+   in use.  Each block is followed by an unmapped guard page, so
+   that running off its end faults instead of corrupting the next
+   block.  Blocks are placed by next fit, starting after the last
+   block placed, which tends to leave the pages after a new block
+   free, so that vmalloc_grow() can often extend it in place.
+
+   The page tables for the range hang off base_pml4's kernel
+   entry, which every page map shares, so the range looks the
+   same in every process.  All of them, 128 for the 256 MB range,
+   are made up front, so that mapping and unmapping pages only
+   ever writes the entries of pages in blocks the caller owns and
+   needs no lock.  Memory here is not physically
+   contiguous and vtop() does not apply to it; the disk driver
+   moves it by PIO rather than DMA. */
+
+/* Pages in the range. */
+#define VMALLOC_PAGES ((VMALLOC_END - VMALLOC_START) / PGSIZE)
+
+static struct bitmap *used_map; /* Pages of the range in use. */
+static size_t cursor;           /* Where the next search starts. */
+static struct lock vmalloc_lock; /* Protects the above. */
+
+/* Statistics, protected by VMALLOC_LOCK. */
+static size_t mapped_cnt;       /* Pages mapped now. */
+static size_t mapped_peak;      /* Most pages mapped at once. */
+static long long alloc_cnt;     /* Blocks allocated. */
+static long long grow_cnt;      /* Blocks grown in place. */
+static long long grow_fail_cnt; /* Blocks that could not grow in place. */
+
+/* Sets up the vmalloc region.  Until this is called, vmalloc()
+   returns a null pointer.  Must be called after paging_init()
+   and before the first process page map is created. */
+void
+vmalloc_init (void) {
+	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (VMALLOC_PAGES), PGSIZE);
+	void *bm = palloc_get_multiple (PAL_ASSERT, bm_pages);
+	uint64_t va;
+
+	ASSERT ((uint64_t) ptov (ram_pages * PGSIZE) <= VMALLOC_START);
+
+	lock_init (&vmalloc_lock);
+	cursor = 0;
+
+	/* Make every table for the range now, before any page map
+	   copies base_pml4 and before two threads could race to make
+	   the same one.  Walking one page of each PTE_LIVE_SPAN also
+	   marks every span live. */
+	for (va = VMALLOC_START; va < VMALLOC_END;
+			va += PTE_LIVE_SPAN * PGSIZE)
+		if (pml4e_walk (base_pml4, va, true) == NULL)
+			PANIC ("out of memory for vmalloc page tables");
+	used_map = bitmap_create_in_buf (VMALLOC_PAGES, bm, bm_pages * PGSIZE);
+}
+
+/* Unmaps the PAGE_CNT pages starting at VA and frees the pages
+   they mapped. */
+static void
+unmap_pages (uint8_t *va, size_t page_cnt) {
+	size_t i;
+
+	for (i = 0; i < page_cnt; i++)
+		palloc_free_page (pml4_clear_kernel_page (va + i * PGSIZE));
+}
+
+/* Maps each of the PAGE_CNT pages starting at VA to a new page
+   from the kernel pool.  Returns false, with none of them
+   mapped, if memory runs out. */
+static bool
+map_pages (uint8_t *va, size_t page_cnt) {
+	size_t i;
+
+	for (i = 0; i < page_cnt; i++) {
+		void *kpage = palloc_get_page (0);
+
+		if (kpage == NULL) {
+			unmap_pages (va, i);
+			return false;
+		}
+		pml4_set_kernel_page (va + i * PGSIZE, kpage);
+	}
+
+	lock_acquire (&vmalloc_lock);
+	mapped_cnt += page_cnt;
+	if (mapped_cnt > mapped_peak)
+		mapped_peak = mapped_cnt;
+	lock_release (&vmalloc_lock);
+	return true;
+}
+
+/* Returns the index within the range of page VA. */
+static size_t
+page_idx (const void *va) {
+	ASSERT (is_vmalloc_vaddr (va));
+	ASSERT (pg_ofs (va) == 0);
+	return pg_no (va) - pg_no (VMALLOC_START);
+}
+
+/* Obtains PAGE_CNT virtually contiguous pages of kernel memory
+   and returns the first, or a null pointer if the range or the
+   kernel pool runs out or the range is not set up yet. */
+void *
+vmalloc (size_t page_cnt) {
+	size_t idx;
+	uint8_t *va;
+
+	if (used_map == NULL || page_cnt == 0)
+		return NULL;
+
+	lock_acquire (&vmalloc_lock);
+	idx = bitmap_scan_and_flip_next (used_map, &cursor, page_cnt + 1, false);
+	lock_release (&vmalloc_lock);
+	if (idx == BITMAP_ERROR)
+		return NULL;
+
+	va = (uint8_t *) VMALLOC_START + idx * PGSIZE;
+	if (!map_pages (va, page_cnt)) {
+		lock_acquire (&vmalloc_lock);
+		bitmap_set_multiple (used_map, idx, page_cnt + 1, false);
+		lock_release (&vmalloc_lock);
+		return NULL;
+	}
+
+	lock_acquire (&vmalloc_lock);
+	alloc_cnt++;
+	lock_release (&vmalloc_lock);
+	return va;
+}
+
+/* Extends the block of OLD_CNT pages at VA, obtained from
+   vmalloc(), to NEW_CNT pages without moving it.  Returns false,
+   leaving the block as it was, if the pages after it are in use
+   or memory runs out. */
+bool
+vmalloc_grow (void *va, size_t old_cnt, size_t new_cnt) {
+	size_t idx = page_idx (va);
+	size_t add = new_cnt - old_cnt;
+	bool ok;
+
+	ASSERT (new_cnt > old_cnt);
+
+	/* The old guard page becomes part of the block, and the
+	   page after the new end becomes the guard. */
+	lock_acquire (&vmalloc_lock);
+	ok = idx + new_cnt + 1 <= VMALLOC_PAGES
+		&& bitmap_none (used_map, idx + old_cnt + 1, add);
+	if (ok)
+		bitmap_set_multiple (used_map, idx + old_cnt + 1, add, true);
+	lock_release (&vmalloc_lock);
+
+	if (ok && !map_pages ((uint8_t *) va + old_cnt * PGSIZE, add)) {
+		lock_acquire (&vmalloc_lock);
+		bitmap_set_multiple (used_map, idx + old_cnt + 1, add, false);
+		lock_release (&vmalloc_lock);
+		ok = false;
+	}
+
+	lock_acquire (&vmalloc_lock);
+	if (ok)
+		grow_cnt++;
+	else
+		grow_fail_cnt++;
+	lock_release (&vmalloc_lock);
+	return ok;
+}
+
+/* Frees the PAGE_CNT pages at VA, obtained from vmalloc(). */
+void
+vfree (void *va, size_t page_cnt) {
+	size_t idx = page_idx (va);
+
+	unmap_pages (va, page_cnt);
+
+	lock_acquire (&vmalloc_lock);
+	mapped_cnt -= page_cnt;
+	ASSERT (bitmap_all (used_map, idx, page_cnt + 1));
+	bitmap_set_multiple (used_map, idx, page_cnt + 1, false);
+	lock_release (&vmalloc_lock);
+}
+
+/* Prints vmalloc statistics. */
+void
+vmalloc_print_stats (void) {
+	printf ("Vmalloc: %lld blocks, %zu pages mapped, %zu at peak, "
+			"%lld grown in place, %lld could not grow\n",
+			alloc_cnt, mapped_cnt, mapped_peak, grow_cnt, grow_fail_cnt);
+}
@@ -13,6 +13,7 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
@@ -28,6 +29,43 @@ static void initd(void *f_name);
 static void __do_fork(void *);
 static bool argument_stack(struct intr_frame *if_, char *argv[], int argc);
 
+/* Successful execs and the CPU cycles from entering process_exec()
+   to jumping to the program's first instruction. */
+static long long exec_cnt;
+static uint64_t exec_cycles;
+
+/* Execs whose program went on to make a system call, and the CPU
+   cycles from entering process_exec() to that call.  These take in
+   the page faults that load the program lazily, which the cycles to
+   the first instruction leave out. */
+static long long first_syscall_cnt;
+static uint64_t first_syscall_cycles;
+
+/* Prints exec statistics. */
+void process_print_stats(void)
+{
+	if (exec_cnt > 0)
+		printf("Exec: %lld programs started, %"PRIu64" cycles mean to first instruction\n",
+			   exec_cnt, exec_cycles / exec_cnt);
+	if (first_syscall_cnt > 0)
+		printf("Exec: %lld programs reached a system call, %"PRIu64" cycles mean to the first\n",
+			   first_syscall_cnt, first_syscall_cycles / first_syscall_cnt);
+}
+
+/* Called on every system call: the first one since the running
+   process's exec stops that exec's clock. */
+void process_note_syscall(void)
+{
+	struct thread *t = thread_current();
+
+	if (t->exec_start != 0)
+	{
+		first_syscall_cycles += rdtsc() - t->exec_start;
+		first_syscall_cnt++;
+		t->exec_start = 0;
+	}
+}
+
 static struct thread *get_child_process(int pid)
 {
 	struct thread *curr = thread_current();
@@ -339,6 +377,7 @@ int process_exec(void *f_name)
 {
 	char *file_name = f_name;
 	bool success = false;
+	uint64_t start = rdtsc();
 
 	/* 
 	 * 새 프로그램의 초기 interrupt frame을 설정함
@@ -443,6 +482,10 @@ int process_exec(void *f_name)
 
 	/* 임시 메모리 해제 */
 	palloc_free_page(file_name);
+
+	exec_cycles += rdtsc() - start;
+	exec_cnt++;
+	thread_current()->exec_start = start;
 	
 	/* 
 	 * 새 프로그램으로 점프함
@@ -674,6 +717,7 @@ process_cleanup(void)
 
 #ifdef VM
 	/* 가상 메모리 사용시 보조 페이지 테이블을 해제함 */
+	vm_report_process();
 	supplemental_page_table_kill(&curr->spt);
 #endif
 
@@ -1043,9 +1087,17 @@ install_page(void *upage, void *kpage, bool writable)
 static bool
 lazy_load_segment(struct page *page, void *aux)
 {
-	/* TODO: 파일에서 세그먼트를 로드하십시오. */
-	/* TODO: 이 함수는 주소 VA에서 첫 페이지 폴트가 발생했을 때 호출됩니다. */
-	/* TODO: 이 함수를 호출할 때 VA는 유효합니다. */
+	/* Called on the first fault at the page: read its part of the
+	   segment and zero the rest. */
+	struct lazy_load *ll = aux;
+	struct file *file = ll->file != NULL ? ll->file : thread_current()->runn_file;
+	uint8_t *kva = page->frame->kva;
+	bool success;
+
+	success = file_read_at(file, kva, ll->read_bytes, ll->ofs) == (int)ll->read_bytes;
+	memset(kva + ll->read_bytes, 0, ll->zero_bytes);
+	free(ll);
+	return success;
 }
 
 /* FILE의 OFS 오프셋에서 시작하는 세그먼트를 주소 UPAGE에 로드합니다.
@@ -1060,7 +1112,7 @@ lazy_load_segment(struct page *page, void *aux)
  *
  * 성공 시 true, 메모리 할당 오류나 디스크 읽기 오류 시 false를 반환합니다. */
 static bool
-load_segment(struct file *file, off_t ofs, uint8_t *upage,
+load_segment(struct file *file UNUSED, off_t ofs, uint8_t *upage,
 			 uint32_t read_bytes, uint32_t zero_bytes, bool writable)
 {
 	ASSERT((read_bytes + zero_bytes) % PGSIZE == 0);
@@ -1075,16 +1127,28 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: lazy_load_segment에 정보를 전달하기 위한 aux를 설정하세요. */
-		void *aux = NULL;
+		/* What lazy_load_segment() should read.  A null file means
+		   the running executable, of which a forked child has its own
+		   copy. */
+		struct lazy_load *aux = malloc(sizeof *aux);
+		if (aux == NULL)
+			return false;
+		aux->file = NULL;
+		aux->ofs = ofs;
+		aux->read_bytes = page_read_bytes;
+		aux->zero_bytes = page_zero_bytes;
 		if (!vm_alloc_page_with_initializer(VM_ANON, upage,
 											writable, lazy_load_segment, aux))
+		{
+			free(aux);
 			return false;
+		}
 
 		/* 다음으로 진행. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
+		ofs += page_read_bytes;
 	}
 	return true;
 }
@@ -1096,10 +1160,14 @@ setup_stack(struct intr_frame *if_)
 	bool success = false;
 	void *stack_bottom = (void *)(((uint8_t *)USER_STACK) - PGSIZE);
 
-	/* TODO: stack_bottom에 스택을 매핑하고 즉시 클레임(claim)하십시오.
-	 * TODO: 성공 시 rsp를 적절히 설정하십시오.
-	 * TODO: 해당 페이지가 스택임을 표시해야 합니다. */
-	/* TODO: 여기에 코드를 작성하세요 */
+	/* VM_MARKER_0 marks stack pages.  Claim the first one now,
+	   since argument passing writes to it right away. */
+	if (vm_alloc_page(VM_ANON | VM_MARKER_0, stack_bottom, true)
+		&& vm_claim_page(stack_bottom))
+	{
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 
 	return success;
 }
@@ -7,6 +7,9 @@
 #include "threads/thread.h"
 #include "threads/loader.h"
 #include "userprog/gdt.h"
+#include "userprog/process.h"
+#include "userprog/tss.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "intrinsic.h"
 #include "threads/vaddr.h"
@@ -15,10 +18,23 @@
 #include "filesys/file.h"
 #include "threads/synch.h"
 #include "threads/init.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 #define MSR_STAR 0xc0000081
 #define MSR_LSTAR 0xc0000082
 #define MSR_SYSCALL_MASK 0xc0000084
+#define MSR_KERNEL_GS_BASE 0xc0000102
+
+/* Per-CPU data for syscall_entry, which reaches its own CPU's with
+   swapgs: %gs:0 and %gs:8 hold user registers while it finds the
+   kernel stack, and %gs:16 points to the CPU's TSS. */
+struct syscall_cpu {
+	uint64_t scratch[2];
+	struct task_state *tss;
+};
+static struct syscall_cpu syscall_cpus[NCPU_MAX];
 
 void syscall_entry(void);
 void syscall_handler(struct intr_frame *);
@@ -27,7 +43,6 @@ static void release_fd(int fd);
 static int allocate_fd(struct file *file);
 static struct file *get_file(int fd);
 static void check_buffer(void *buffer, unsigned size);
-static struct lock filesys_lock;
 
 
 
@@ -82,14 +97,10 @@ void syscall_init(void)
     write_msr(MSR_SYSCALL_MASK,
               FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
 
-    /*
-     * 파일시스템 접근용 락 초기화
-     * 
-     * Pintos의 파일시스템은 thread-safe하지 않으므로
-     * 모든 파일시스템 연산을 하나의 락으로 보호해야 함
-     * 이는 성능상 최적은 아니지만 안전성을 보장함
-     */
-    lock_init(&filesys_lock);
+    /* Each CPU runs this once, for its own MSRs. */
+    struct syscall_cpu *sc = &syscall_cpus[cpu_current()->id];
+    sc->tss = tss_get();
+    write_msr(MSR_KERNEL_GS_BASE, (uint64_t)sc);
 }
 
 /* ===== 시스템 콜 핸들러 - 모든 시스템 콜의 중앙 처리소 ===== */
@@ -117,6 +128,14 @@ void syscall_handler(struct intr_frame *f)
      */
     uint64_t nr = f->R.rax;
 
+    process_note_syscall();
+
+#ifdef VM
+    /* Saved for faults the kernel takes on the user stack during
+       the call, which must decide whether to grow it. */
+    thread_current()->user_rsp = (void *)f->rsp;
+#endif
+
     /*
      * 시스템 콜 번호에 따라 해당하는 처리를 수행함
      * 
@@ -221,17 +240,17 @@ void syscall_handler(struct intr_frame *f)
             }
 
             /*
-             * 파일시스템 락 획득 후 쓰기 수행
-             * 
-             * Pintos 파일시스템은 thread-safe하지 않으므로
-             * 모든 파일 연산을 락으로 보호해야 함
-             * 
-             * 이는 여러 프로세스가 동시에 같은 파일에 접근할 때
-             * 데이터 오염을 방지함
+             * No global lock: the file system locks each inode and
+             * directory itself, so writes to different files proceed
+             * concurrently.
              */
-            lock_acquire(&filesys_lock);
+#ifdef VM
+            vm_pin_buffer(buffer, size, false);
+#endif
             int bytes_written = file_write(file, buffer, size);
-            lock_release(&filesys_lock);
+#ifdef VM
+            vm_unpin_buffer(buffer, size);
+#endif
 
             f->R.rax = bytes_written;              // 실제로 쓴 바이트 수 반환
         }
@@ -275,11 +294,8 @@ void syscall_handler(struct intr_frame *f)
          * 실제 파일 생성 작업
          * 
          * filesys_create: 파일시스템에 새로운 파일을 생성하는 함수
-         * 락으로 보호하여 동시성 문제를 방지함
          */
-        lock_acquire(&filesys_lock);
         bool result = filesys_create(path, sz);
-        lock_release(&filesys_lock);
 
         f->R.rax = result;                         // 생성 결과 반환
         break;
@@ -306,9 +322,7 @@ void syscall_handler(struct intr_frame *f)
          * filesys_open: 실제 파일을 열고 file 구조체를 반환
          * 파일이 존재하지 않으면 NULL을 반환함
          */
-        lock_acquire(&filesys_lock);
         struct file *file = filesys_open(path);
-        lock_release(&filesys_lock);
 
         if (file == NULL)
         {
@@ -376,9 +390,7 @@ void syscall_handler(struct intr_frame *f)
              * file_close: 파일의 메모리 자원을 해제하고 파일시스템에 변경사항 반영
              * release_fd: fd 테이블에서 해당 슬롯을 NULL로 만들어 재사용 가능하게 함
              */
-            lock_acquire(&filesys_lock);
             file_close(file);
-            lock_release(&filesys_lock);
 
             release_fd(fd);                        // fd 슬롯 해제
         }
@@ -459,14 +471,18 @@ void syscall_handler(struct intr_frame *f)
             }
 
             /*
-             * 락 보호 하에 파일 읽기 수행
-             * 
              * file_read: 파일에서 실제 데이터를 읽는 함수
              * 반환값은 실제로 읽은 바이트 수임 (0이면 EOF)
              */
-            lock_acquire(&filesys_lock);
+#ifdef VM
+            /* Keep the buffer resident while the file system holds
+               its locks, so that faults cannot nest inside them. */
+            vm_pin_buffer(buffer, size, true);
+#endif
             int bytes_read = file_read(file, buffer, size);
-            lock_release(&filesys_lock);
+#ifdef VM
+            vm_unpin_buffer(buffer, size);
+#endif
 
             f->R.rax = bytes_read;
         }
@@ -496,9 +512,7 @@ void syscall_handler(struct intr_frame *f)
          * file_length: 파일의 전체 크기를 반환하는 함수
          * 이는 파일의 현재 읽기/쓰기 위치와는 무관함
          */
-        lock_acquire(&filesys_lock);
         off_t size = file_length(file);
-        lock_release(&filesys_lock);
 
         f->R.rax = size;
         break;
@@ -663,9 +677,7 @@ void syscall_handler(struct intr_frame *f)
              * 파일 크기를 넘어선 위치로 이동해도 에러가 발생하지 않음
              * (실제 읽기/쓰기할 때 처리됨)
              */
-            lock_acquire(&filesys_lock);
             file_seek(file, position);
-            lock_release(&filesys_lock);
         }
         /*
          * 유효하지 않은 fd에 대해서는 조용히 무시
@@ -697,9 +709,7 @@ void syscall_handler(struct intr_frame *f)
          * 
          * file_tell: 파일의 내부 포인터가 가리키는 현재 위치 반환
          */
-        lock_acquire(&filesys_lock);
         f->R.rax = file_tell(file);
-        lock_release(&filesys_lock);
         break;
     }
     
@@ -724,12 +734,34 @@ void syscall_handler(struct intr_frame *f)
          * filesys_remove: 파일시스템에서 파일을 제거하는 함수
          * 파일이 존재하지 않으면 false 반환
          */
-        lock_acquire(&filesys_lock);
         f->R.rax = filesys_remove(file);
-        lock_release(&filesys_lock);
         break;
     }
     
+#ifdef VM
+    case SYS_MMAP:
+    {
+        /* Maps the file open as fd, lazily.  Returns the address,
+           or NULL (MAP_FAILED) for the console descriptors and any
+           argument do_mmap() rejects. */
+        void *addr = (void *)f->R.rdi;
+        size_t length = (size_t)f->R.rsi;
+        int writable = (int)f->R.rdx;
+        int fd = (int)f->R.r10;
+        off_t offset = (off_t)f->R.r8;
+        struct file *file = get_file(fd);
+
+        f->R.rax = (uint64_t)(file != NULL
+                                  ? do_mmap(addr, length, writable, file, offset)
+                                  : NULL);
+        break;
+    }
+
+    case SYS_MUNMAP:
+        do_munmap((void *)f->R.rdi);
+        break;
+#endif
+
     default:
         /*
          * 알 수 없는 시스템 콜 번호
@@ -1,7 +1,15 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <bitmap.h>
+#include <stdio.h>
+#include <string.h>
 #include "vm/vm.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/zswap.h"
+#include "intrinsic.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +25,388 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Number of sectors in a swap slot, which holds one page. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Most pages read back by a single fault: the faulting page and
+ * the pages after it that were swapped out next to it. */
+#define SWAP_CLUSTER 8
+
+/* Swap slots in use, one bit per slot, and the lock guarding
+ * them.  Null if there is no swap disk.  Slots are handed out
+ * from SWAP_CURSOR onward, wrapping around. */
+static struct bitmap *swap_slots;
+static size_t swap_cursor;
+static struct lock swap_lock;
+
+/* A frame shared copy-on-write, by fork() or by merging, is
+ * written to a single slot that all of its pages then refer to.
+ * SLOT_SHARERS counts, for each slot, the pages referring to it
+ * beyond the first, so that the slot is freed along with the last
+ * of them.  Protected by SWAP_LOCK. */
+static unsigned *slot_sharers;
+
+/* Statistics, protected by SWAP_LOCK. */
+static long long swap_in_cnt;       /* Pages read from swap. */
+static long long swap_in_ops;       /* Faults that read them. */
+static long long swap_in_cycles;    /* Time those faults spent reading. */
+static long long swap_out_cnt;      /* Pages written to swap. */
+static long long swap_out_ops;      /* Batches that wrote them. */
+
+/* The compressed tier in front of the swap disk (see zswap.c), if
+ * the -zswap option made one.  ZSWAP_LOCK serializes the pool and
+ * every page's ZSWAP, and is held while a page moves from the pool
+ * to the disk, so that a fault on the page sees it in one place or
+ * the other.  It is acquired before SWAP_LOCK. */
+static bool zswap_enabled;
+static struct lock zswap_lock;
+static uint8_t *spill_buffer;       /* Page decompressed for spilling. */
+
+/* Statistics, protected by ZSWAP_LOCK. */
+static long long zswap_in_cnt;      /* Pages decompressed by faults. */
+static long long zswap_in_cycles;   /* Time spent decompressing them. */
+static long long zswap_spill_cnt;   /* Pages moved on to the disk. */
+
+static bool swap_out_to_disk (struct page *pages[], size_t cnt);
+static void share_slot (struct frame *frame, size_t slot);
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	if (swap_disk != NULL) {
+		size_t slot_cnt = disk_size (swap_disk) / SECTORS_PER_SLOT;
+
+		swap_slots = bitmap_create (slot_cnt);
+		slot_sharers = calloc (slot_cnt, sizeof *slot_sharers);
+		if (swap_slots == NULL || slot_sharers == NULL)
+			PANIC ("cannot allocate swap slot table");
+	}
+	lock_init (&swap_lock);
+
+	lock_init (&zswap_lock);
+	zswap_enabled = zswap_init ();
+	if (zswap_enabled && swap_disk != NULL)
+		spill_buffer = palloc_get_page (PAL_ASSERT);
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED, void *kva) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = BITMAP_ERROR;
+	anon_page->zswap = NULL;
+
+	/* Without a frame, the page starts out on the zero page. */
+	if (kva != NULL)
+		memset (kva, 0, PGSIZE);
+	return true;
+}
+
+/* Returns true if PAGE is an anonymous page that was never
+ * written: it has neither a frame nor a copy in swap, and reads
+ * as zeros through the shared zero page, if it is mapped at all. */
+bool
+anon_on_zero_page (struct page *page) {
+	return page->operations == &anon_ops && page->frame == NULL
+		&& page->anon.slot == BITMAP_ERROR && page->anon.zswap == NULL;
+}
+
+/* Returns the mean of TOTAL over CNT events, or 0 if there were
+ * none. */
+static long long
+mean (long long total, long long cnt) {
+	return cnt > 0 ? total / cnt : 0;
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Prints swap statistics, with the mean cycles a fault spends
+ * getting its page from each tier. */
+void
+anon_print_stats (void) {
+	if (zswap_enabled) {
+		zswap_print_stats ();
+		printf ("Compressed swap: %lld pages in, %lld cycles each, "
+				"%lld spilled to disk\n", zswap_in_cnt,
+				mean (zswap_in_cycles, zswap_in_cnt), zswap_spill_cnt);
+	}
+	if (swap_slots == NULL)
+		return;
+	printf ("Swap: %lld pages in by %lld faults, %lld pages out in %lld batches, "
+			"%zu of %zu slots in use\n",
+			swap_in_cnt, swap_in_ops, swap_out_cnt, swap_out_ops,
+			bitmap_count (swap_slots, 0, bitmap_size (swap_slots), true),
+			bitmap_size (swap_slots));
+	printf ("Swap: %lld cycles per fault\n", mean (swap_in_cycles, swap_in_ops));
+}
+
+/* Drops a page's reference to swap slot SLOT, freeing the slot
+ * if no other page refers to it.  SWAP_LOCK must be held. */
+static void
+put_slot (size_t slot) {
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+
+	if (slot_sharers[slot] > 0)
+		slot_sharers[slot]--;
+	else
+		bitmap_reset (swap_slots, slot);
+}
+
+/* Drops a page's reference to swap slot SLOT. */
+static void
+free_slot (size_t slot) {
+	lock_acquire (&swap_lock);
+	put_slot (slot);
+	lock_release (&swap_lock);
+}
+
+/* Returns the first sector of swap slot SLOT. */
+static disk_sector_t
+slot_to_sector (size_t slot) {
+	return slot * SECTORS_PER_SLOT;
+}
+
+/* Swap in the page by read contents from the swap disk.  A page
+ * in the compressed pool is decompressed instead, and a page with
+ * neither was never written and is filled with zeros.
+ *
+ * Pages evicted together usually belong to one process and sit
+ * in adjacent slots (see anon_swap_out_batch()), so the pages
+ * following PAGE in the address space whose slots follow PAGE's
+ * are read back too, as part of the same disk command, on the bet
+ * that they are about to fault as well. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	struct disk_request requests[SWAP_CLUSTER];
+	struct page *cluster[SWAP_CLUSTER];
+	size_t slot;
+	size_t cnt, i;
+	uint64_t start = rdtsc ();
+
+	if (zswap_enabled) {
+		bool found;
+
+		lock_acquire (&zswap_lock);
+		found = anon_page->zswap != NULL;
+		if (found) {
+			zswap_load (anon_page->zswap, kva);
+			zswap_free (anon_page->zswap);
+			anon_page->zswap = NULL;
+			zswap_in_cnt++;
+			zswap_in_cycles += rdtsc () - start;
+		}
+		lock_release (&zswap_lock);
+		if (found)
+			return true;
+	}
+
+	slot = anon_page->slot;
+	if (slot == BITMAP_ERROR) {
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
+
+	cluster[0] = page;
+	disk_submit (&requests[0], swap_disk, slot_to_sector (slot), kva,
+			SECTORS_PER_SLOT, false);
+
+	/* Only the owner can look its neighbours up; fork() may bring
+	 * back a parent's page from the child. */
+	for (cnt = 1; cnt < SWAP_CLUSTER
+			&& page->pml4 == thread_current ()->pml4; cnt++) {
+		struct page *next = spt_find_page (&thread_current ()->spt,
+				(uint8_t *) page->va + cnt * PGSIZE);
+		void *next_kva;
+
+		if (next == NULL || next->operations != &anon_ops
+				|| next->frame != NULL || next->anon.slot != slot + cnt)
+			break;
+		next_kva = vm_begin_claim (next);
+		if (next_kva == NULL)
+			break;
+		cluster[cnt] = next;
+		disk_submit (&requests[cnt], swap_disk, slot_to_sector (slot + cnt),
+				next_kva, SECTORS_PER_SLOT, false);
+	}
+
+	for (i = 0; i < cnt; i++) {
+		disk_wait (&requests[i]);
+		cluster[i]->anon.slot = BITMAP_ERROR;
+	}
+
+	lock_acquire (&swap_lock);
+	for (i = 0; i < cnt; i++)
+		put_slot (slot + i);
+	swap_in_cnt += cnt;
+	swap_in_ops++;
+	swap_in_cycles += rdtsc () - start;
+	lock_release (&swap_lock);
+
+	for (i = 1; i < cnt; i++)
+		vm_finish_claim (cluster[i], true);
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	return anon_swap_out_batch (&page, 1);
+}
+
+/* Moves the page stored longest ago in the compressed pool to the
+ * swap disk, to make room.  Returns false if the pool is empty or
+ * the disk cannot take the page.  ZSWAP_LOCK must be held. */
+static bool
+zswap_spill (void) {
+	struct zswap_entry *e = zswap_oldest ();
+	struct disk_request request;
+	struct page *page;
+	size_t slot;
+
+	ASSERT (lock_held_by_current_thread (&zswap_lock));
+
+	if (e == NULL || spill_buffer == NULL)
+		return false;
+	lock_acquire (&swap_lock);
+	slot = bitmap_scan_and_flip_next (swap_slots, &swap_cursor, 1, false);
+	if (slot != BITMAP_ERROR) {
+		swap_out_cnt++;
+		swap_out_ops++;
+	}
+	lock_release (&swap_lock);
+	if (slot == BITMAP_ERROR)
+		return false;
+
+	page = e->page;
+	zswap_load (e, spill_buffer);
+	disk_submit (&request, swap_disk, slot_to_sector (slot), spill_buffer,
+			SECTORS_PER_SLOT, true);
+	disk_wait (&request);
+	page->anon.slot = slot;
+	page->anon.zswap = NULL;
+	zswap_free (e);
+	zswap_spill_cnt++;
+	return true;
+}
+
+/* Writes the CNT anonymous PAGES, which must all still have their
+ * frames, to swap.  With a compressed pool, each page that
+ * compresses well goes there, spilling the oldest pages in the
+ * pool to the disk to make room; the rest go to the disk.  A page
+ * whose frame is shared goes to the disk too, since a compressed
+ * copy belongs to a single page.  CNT may be at most
+ * ANON_BATCH_MAX.  Returns false if swap is full. */
+bool
+anon_swap_out_batch (struct page *pages[], size_t cnt) {
+	struct page *to_disk[ANON_BATCH_MAX];
+	size_t disk_cnt = 0, i;
+
+	ASSERT (cnt <= ANON_BATCH_MAX);
+
+	if (!zswap_enabled)
+		return swap_out_to_disk (pages, cnt);
+
+	lock_acquire (&zswap_lock);
+	for (i = 0; i < cnt; i++) {
+		struct page *page = pages[i];
+		size_t size = 0;
+		struct zswap_entry *e = NULL;
+
+		if (page->frame->ref_cnt == 1)
+			size = zswap_compress (page->frame->kva);
+		if (size > 0)
+			while ((e = zswap_store (page, size)) == NULL && zswap_spill ())
+				continue;
+		if (e != NULL)
+			page->anon.zswap = e;
+		else
+			to_disk[disk_cnt++] = page;
+	}
+	lock_release (&zswap_lock);
+
+	return disk_cnt == 0 || swap_out_to_disk (to_disk, disk_cnt);
+}
+
+/* Writes the CNT anonymous PAGES, which must all still have their
+ * frames, to the swap disk.  Their slots are adjacent when
+ * possible, so that the disk queue merges the writes into one
+ * command and a later fault on one page can read its neighbours
+ * back with it.  Every other page sharing a page's frame is given
+ * the page's slot as well.  Returns false if swap is full. */
+static bool
+swap_out_to_disk (struct page *pages[], size_t cnt) {
+	struct disk_request requests[ANON_BATCH_MAX];
+	size_t slots[ANON_BATCH_MAX];
+	size_t first, i;
+
+	ASSERT (cnt <= ANON_BATCH_MAX);
+
+	if (swap_slots == NULL)
+		return false;
+
+	lock_acquire (&swap_lock);
+	first = bitmap_scan_and_flip_next (swap_slots, &swap_cursor, cnt,
+			false);
+	for (i = 0; i < cnt; i++) {
+		slots[i] = first != BITMAP_ERROR ? first + i
+			: bitmap_scan_and_flip_next (swap_slots, &swap_cursor, 1, false);
+		if (slots[i] == BITMAP_ERROR) {
+			while (i-- > 0)
+				bitmap_reset (swap_slots, slots[i]);
+			lock_release (&swap_lock);
+			return false;
+		}
+	}
+	swap_out_cnt += cnt;
+	swap_out_ops++;
+	lock_release (&swap_lock);
+
+	for (i = 0; i < cnt; i++)
+		disk_submit (&requests[i], swap_disk, slot_to_sector (slots[i]),
+				pages[i]->frame->kva, SECTORS_PER_SLOT, true);
+	for (i = 0; i < cnt; i++) {
+		disk_wait (&requests[i]);
+		share_slot (pages[i]->frame, slots[i]);
+	}
+	return true;
+}
+
+/* Records that every page of FRAME, which the eviction code holds
+ * pinned, is stored in swap slot SLOT. */
+static void
+share_slot (struct frame *frame, size_t slot) {
+	struct list_elem *e;
+
+	lock_acquire (&swap_lock);
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+
+		ASSERT (page->operations == &anon_ops);
+		ASSERT (page->anon.slot == BITMAP_ERROR);
+		if (e != list_begin (&frame->pages))
+			slot_sharers[slot]++;
+		page->anon.slot = slot;
+	}
+	lock_release (&swap_lock);
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	vm_release_frame (page);
+	if (zswap_enabled) {
+		lock_acquire (&zswap_lock);
+		if (anon_page->zswap != NULL)
+			zswap_free (anon_page->zswap);
+		anon_page->zswap = NULL;
+		lock_release (&zswap_lock);
+	}
+	if (anon_page->slot != BITMAP_ERROR)
+		free_slot (anon_page->slot);
 }
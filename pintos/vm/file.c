@@ -1,5 +1,16 @@
-/* file.c: Implementation of memory backed file object (mmaped object). */
+/* file.c: Implementation of memory backed file object (mmaped object).
+ *
+ * Every mapping of the same part of a file shares one frame, in
+ * whatever process it is mapped: vm.c looks a page's (inode,
+ * offset) up in its index of file frames before reading the file.
+ * A frame written through any of its mappings goes back to the
+ * file once, when its last mapping goes away or it is evicted. */
 
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
@@ -14,45 +25,232 @@ static const struct page_operations file_ops = {
 	.type = VM_FILE,
 };
 
+/* Protects every mapping's REF_CNT.  Pages of one mapping end up
+ * in several processes after fork(). */
+static struct lock map_lock;
+
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	lock_init (&map_lock);
+}
+
+/* Takes a reference to MAP. */
+static void
+map_get (struct mmap_file *map) {
+	lock_acquire (&map_lock);
+	map->ref_cnt++;
+	lock_release (&map_lock);
+}
+
+/* Drops a reference to MAP, closing its file with the last. */
+static void
+map_put (struct mmap_file *map) {
+	bool last;
+
+	lock_acquire (&map_lock);
+	last = --map->ref_cnt == 0;
+	lock_release (&map_lock);
+
+	if (last) {
+		file_close (map->file);
+		free (map);
+	}
 }
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
+	struct file_page *aux = page->uninit.aux;
+
 	/* Set up the handler */
 	page->operations = &file_ops;
 
-	struct file_page *file_page = &page->file;
+	/* AUX shares storage with PAGE->file. */
+	page->file = *aux;
+	free (aux);
+	return true;
+}
+
+/* Returns a copy of AUX, the struct file_page of a page not yet
+ * loaded, with its own reference to the mapping, or a null
+ * pointer if memory is short.  Used by fork(). */
+void *
+file_backed_copy_aux (const void *aux) {
+	struct file_page *copy = malloc (sizeof *copy);
+
+	if (copy != NULL) {
+		*copy = *(const struct file_page *) aux;
+		map_get (copy->map);
+	}
+	return copy;
+}
+
+/* Frees AUX, the struct file_page of a page never loaded. */
+void
+file_backed_free_aux (void *aux) {
+	struct file_page *file_page = aux;
+
+	if (file_page != NULL) {
+		map_put (file_page->map);
+		free (file_page);
+	}
+}
+
+/* Takes a reference to the mapping of PAGE, a loaded file page
+ * that fork() just copied. */
+void
+file_backed_fork (struct page *page) {
+	map_get (page->file.map);
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (file_read_at (file_page->map->file, kva, file_page->read_bytes,
+				file_page->ofs) != (off_t) file_page->read_bytes)
+		return false;
+	memset ((uint8_t *) kva + file_page->read_bytes, 0,
+			PGSIZE - file_page->read_bytes);
+	return true;
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.  Only a
+ * frame some mapping wrote to is written, and only the part that
+ * lies within the file. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+	struct frame *frame = page->frame;
+
+	if (frame->dirty) {
+		if (file_write_at (file_page->map->file, frame->kva,
+					file_page->read_bytes, file_page->ofs)
+				!= (off_t) file_page->read_bytes)
+			return false;
+		frame->dirty = false;
+	}
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	vm_release_frame (page);
+	map_put (page->file.map);
+}
+
+/* Returns the mapping PAGE belongs to, or a null pointer if PAGE
+ * is not file-backed. */
+static struct mmap_file *
+page_map (struct page *page) {
+	if (page == NULL || page_get_type (page) != VM_FILE)
+		return NULL;
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		return ((struct file_page *) page->uninit.aux)->map;
+	return page->file.map;
 }
 
-/* Do the mmap */
+/* Do the mmap.
+ *
+ * Maps LENGTH bytes of FILE, starting at OFFSET, at ADDR, and
+ * returns ADDR, or a null pointer if the arguments are bad or the
+ * range overlaps pages already in use.  The pages are loaded
+ * lazily; bytes beyond the end of the file read as zeros. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct mmap_file *map;
+	uint8_t *end = (uint8_t *) addr + ROUND_UP (length, PGSIZE);
+	off_t file_len;
+	uint8_t *upage;
+	void *result = addr;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || offset % PGSIZE != 0
+			|| offset < 0 || length == 0 || end <= (uint8_t *) addr
+			|| !is_user_vaddr (addr) || (uint64_t) end > KERN_BASE)
+		return NULL;
+	file_len = file_length (file);
+	if (file_len == 0 || !spt_range_empty (spt, addr, end))
+		return NULL;
+
+	map = malloc (sizeof *map);
+	if (map == NULL)
+		return NULL;
+	map->file = file_reopen (file);
+	if (map->file == NULL) {
+		free (map);
+		return NULL;
+	}
+	/* This reference keeps MAP alive while the pages are made. */
+	map->ref_cnt = 1;
+
+	for (upage = addr; upage < end; upage += PGSIZE) {
+		off_t ofs = offset + (upage - (uint8_t *) addr);
+		struct file_page *aux = malloc (sizeof *aux);
+
+		if (aux == NULL) {
+			result = NULL;
+			break;
+		}
+		aux->map = map;
+		aux->ofs = ofs;
+		aux->read_bytes = ofs >= file_len ? 0
+			: file_len - ofs < PGSIZE ? (size_t) (file_len - ofs) : PGSIZE;
+		map_get (map);
+		if (!vm_alloc_page_with_initializer (VM_FILE, upage, writable, NULL,
+					aux)) {
+			file_backed_free_aux (aux);
+			result = NULL;
+			break;
+		}
+	}
+	if (result == NULL)
+		do_munmap (addr);
+	map_put (map);
+	return result;
 }
 
-/* Do the munmap */
+/* A mapping being removed by do_munmap(). */
+struct unmap {
+	struct mmap_file *map;  /* The mapping. */
+	void *end;              /* End of the pages removed so far. */
+};
+
+/* Removes PAGE if it belongs to the mapping in UNMAP_; stops the
+ * iteration at the first page that does not. */
+static bool
+unmap_page (struct page *page, void *unmap_) {
+	struct unmap *unmap = unmap_;
+
+	if (page_map (page) != unmap->map)
+		return false;
+	unmap->end = (uint8_t *) page->va + PGSIZE;
+	spt_remove_page (&thread_current ()->spt, page);
+	return true;
+}
+
+/* Do the munmap.
+ *
+ * Removes the mapping that starts at ADDR.  Pages written through
+ * it are written back once no other mapping shares them.  The
+ * table nodes left empty are freed afterward. */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct unmap unmap;
+
+	unmap.map = page_map (spt_find_page (spt, addr));
+	unmap.end = addr;
+	if (unmap.map == NULL || pg_ofs (addr) != 0)
+		return;
+	if (addr != NULL && page_map (spt_find_page (spt,
+					(uint8_t *) addr - PGSIZE)) == unmap.map)
+		return;
+	spt_for_each (spt, addr, (void *) KERN_BASE, unmap_page, &unmap);
+	spt_prune (spt, addr, unmap.end);
 }
@@ -8,6 +8,7 @@
  * function.
  * */
 
+#include "threads/malloc.h"
 #include "vm/vm.h"
 #include "vm/uninit.h"
 
@@ -62,7 +63,13 @@ uninit_initialize (struct page *page, void *kva) {
  * PAGE will be freed by the caller. */
 static void
 uninit_destroy (struct page *page) {
-	struct uninit_page *uninit UNUSED = &page->uninit;
-	/* TODO: Fill this function.
-	 * TODO: If you don't have anything to do, just return. */
+	struct uninit_page *uninit = &page->uninit;
+
+	/* AUX is a struct file_page for a mapped file page, and a
+	 * struct lazy_load otherwise, owned by the page either way; the
+	 * initializer frees it once the page is loaded. */
+	if (VM_TYPE (uninit->type) == VM_FILE)
+		file_backed_free_aux (uninit->aux);
+	else
+		free (uninit->aux);
 }
@@ -1,9 +1,118 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#include "intrinsic.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
+/* The frame table: every frame holding user pages, in the order
+ * the clock hand visits them.  FRAME_LOCK protects the table, the
+ * hand, every frame's members and every page's FRAME. */
+static struct list frame_table;
+static struct list_elem *clock_hand;
+static size_t frame_cnt;
+static struct lock frame_lock;
+
+/* Frames emptied by eviction but not yet handed out, also
+ * protected by FRAME_LOCK.  Eviction frees EVICT_BATCH frames at
+ * a time, so that their pages go to swap in one disk command. */
+static struct list free_frames;
+#define EVICT_BATCH ANON_BATCH_MAX
+
+/* Victims are written out without FRAME_LOCK, pinned and marked
+ * EVICTING meanwhile.  Their pages stay linked to them until the
+ * write is over; anyone who needs such a page's frame waits on
+ * EVICT_DONE, with FRAME_LOCK, for the frame to let go of it.
+ * EVICTING_CNT counts the frames being written out. */
+static struct condition evict_done;
+static size_t evicting_cnt;
+
+/* Object caches for struct page and struct frame. */
+static struct kmem_cache *page_kmem_cache;
+static struct kmem_cache *frame_kmem_cache;
+
+/* Eviction statistics. */
+static long long evict_cnt;     /* Frames evicted. */
+static long long scan_cnt;      /* Frames examined to find victims. */
+
+/* Faults that had to read a page back in, and the timer ticks
+ * spent serving them. */
+static long long major_fault_cnt;
+static long long major_fault_ticks;
+
+/* Faults that loaded a page for the first time, and pages loaded
+ * ahead of such faults by vm_prefetch(). */
+static long long lazy_load_cnt;
+static long long prefetch_cnt;
+
+/* Pages loaded ahead once lazy loads are seen to be sequential. */
+#define PREFETCH_PAGES 8
+
+/* Frames holding parts of mapped files, keyed by inode and
+ * offset, so that every mapping of a part shares one frame.
+ * Protected by FRAME_LOCK. */
+static struct hash file_frames;
+static size_t file_frame_cnt, file_frame_peak;
+
+/* Mapped file pages read from their files, and faults on mapped
+ * file pages served by a frame another mapping had loaded. */
+static long long file_read_cnt;
+static long long file_share_cnt;
+
+/* A page of zeros, mapped read-only for reads of anonymous pages
+ * that were never written, in place of a frame of their own.
+ * Such a page gets a frame on its first write. */
+static void *zero_page;
+
+/* Read faults served by mapping the zero page, and zero pages
+ * later given a frame by a write. */
+static long long zero_map_cnt;
+static long long zero_fill_cnt;
+
+bool vm_process_stats;
+
+/* Same-page merging.  A daemon walks the frame table a few frames
+ * at a time, looking for anonymous frames with the same contents,
+ * and folds each such set into one frame that all of their pages
+ * map read-only, the way fork() leaves a frame.  The first write to
+ * any of the pages gives it a private copy in vm_handle_wp().
+ *
+ * A frame is considered only once its contents hash the same on
+ * two visits in a row, since merging a frame still being written
+ * would soon be undone.  Considered frames go into KSM_CANDIDATES
+ * under their hash; a frame whose hash is already there is compared
+ * with the frame found and merged into it if they are equal.  The
+ * candidates are forgotten after each pass over the table, since
+ * their contents may have changed since.  Protected by FRAME_LOCK,
+ * like the frames. */
+unsigned ksm_pages_per_tick;
+static struct hash ksm_candidates;
+static struct list_elem *ksm_cursor;   /* Next frame to scan. */
+
+/* Ticks between the daemon's scans. */
+#define KSM_INTERVAL (TIMER_FREQ / 10)
+
+static long long ksm_scan_cnt;         /* Frames scanned. */
+static long long ksm_merge_cnt;        /* Frames freed by merging. */
+static long long ksm_unmerge_cnt;      /* Merged pages copied on write. */
+static uint64_t ksm_scan_cycles;       /* Time spent scanning. */
+
+static uint64_t file_frame_hash (const struct hash_elem *, void *);
+static bool file_frame_less (const struct hash_elem *,
+		const struct hash_elem *, void *);
+static uint64_t ksm_hash (const struct hash_elem *, void *);
+static bool ksm_less (const struct hash_elem *, const struct hash_elem *,
+		void *);
+static thread_func ksm_daemon NO_RETURN;
+static void ksm_print_stats (void);
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -15,7 +124,86 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	page_kmem_cache = kmem_cache_create ("page", sizeof (struct page), 0,
+			NULL);
+	frame_kmem_cache = kmem_cache_create ("frame", sizeof (struct frame), 0,
+			NULL);
+	if (page_kmem_cache == NULL || frame_kmem_cache == NULL)
+		PANIC ("out of memory for page and frame caches");
+	list_init (&frame_table);
+	list_init (&free_frames);
+	clock_hand = list_end (&frame_table);
+	frame_cnt = 0;
+	lock_init (&frame_lock);
+	cond_init (&evict_done);
+	hash_init (&file_frames, file_frame_hash, file_frame_less, NULL);
+	zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	hash_init (&ksm_candidates, ksm_hash, ksm_less, NULL);
+	ksm_cursor = list_end (&frame_table);
+	if (ksm_pages_per_tick > 0)
+		thread_create ("ksm", PRI_DEFAULT, ksm_daemon, NULL);
+}
+
+/* Prints eviction statistics. */
+void
+vm_print_stats (void) {
+	printf ("Frames: %zu in use, %lld evictions, %lld scanned",
+			frame_cnt, evict_cnt, scan_cnt);
+	if (evict_cnt > 0)
+		printf (" (%lld.%02lld per eviction)", scan_cnt / evict_cnt,
+				scan_cnt * 100 / evict_cnt % 100);
+	printf ("\n");
+	printf ("Faults: %lld first touches, %lld pages prefetched\n",
+			lazy_load_cnt, prefetch_cnt);
+	if (major_fault_cnt > 0)
+		printf ("Faults: %lld served from backing store, "
+				"%lld.%02lld ticks mean service time\n",
+				major_fault_cnt, major_fault_ticks / major_fault_cnt,
+				major_fault_ticks * 100 / major_fault_cnt % 100);
+	printf ("Mapped files: %lld pages read, %lld faults served by shared "
+			"frames, %zu frames at peak\n",
+			file_read_cnt, file_share_cnt, file_frame_peak);
+	printf ("Zero page: %lld read faults mapped it, %lld of those pages "
+			"written later\n", zero_map_cnt, zero_fill_cnt);
+	if (ksm_pages_per_tick > 0)
+		ksm_print_stats ();
+	anon_print_stats ();
+}
+
+/* A process's pages by where they are, for vm_report_process(). */
+struct page_counts {
+	size_t mapped;          /* Pages in the address space. */
+	size_t resident;        /* Pages with a frame, maybe shared. */
+	size_t zero;            /* Pages reading the zero page. */
+};
+
+static bool
+count_page (struct page *page, void *counts_) {
+	struct page_counts *counts = counts_;
+
+	counts->mapped++;
+	if (page->frame != NULL)
+		counts->resident++;
+	else if (anon_on_zero_page (page))
+		counts->zero++;
+	return true;
+}
+
+/* Reports how many of the running process's pages have frames,
+ * if vm_process_stats is set.  Called as the process exits or
+ * execs, while it still has its pages. */
+void
+vm_report_process (void) {
+	struct thread *t = thread_current ();
+	struct page_counts counts = {0, 0, 0};
+
+	if (!vm_process_stats || t->spt.page_cnt == 0)
+		return;
+	lock_acquire (&frame_lock);
+	spt_for_each (&t->spt, NULL, (void *) KERN_BASE, count_page, &counts);
+	lock_release (&frame_lock);
+	printf ("%s: %zu pages mapped, %zu resident, %zu on the zero page\n",
+			t->name, counts.mapped, counts.resident, counts.zero);
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -50,75 +238,922 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		page = kmem_cache_alloc (page_kmem_cache);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, upage, init, type, aux, initializer);
+		page->writable = writable;
+		page->pml4 = thread_current ()->pml4;
 
-		/* TODO: Insert the page into the spt. */
+		if (!spt_insert_page (spt, page)) {
+			kmem_cache_free (page_kmem_cache, page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
-void
-spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	vm_dealloc_page (page);
-	return true;
+/* Links PAGE to FRAME.  FRAME_LOCK must be held. */
+static void
+frame_add_page (struct frame *frame, struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	list_push_back (&frame->pages, &page->frame_elem);
+	if (frame->page == NULL)
+		frame->page = page;
+	frame->ref_cnt++;
+	page->frame = frame;
+}
+
+/* Unlinks PAGE from FRAME and returns true if no page is left
+ * using FRAME.  FRAME_LOCK must be held. */
+static bool
+frame_remove_page (struct frame *frame, struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (page->frame == frame);
+
+	list_remove (&page->frame_elem);
+	if (frame->page == page)
+		frame->page = list_empty (&frame->pages) ? NULL
+			: list_entry (list_front (&frame->pages), struct page, frame_elem);
+	frame->ref_cnt--;
+	page->frame = NULL;
+	return frame->ref_cnt == 0;
+}
+
+static uint64_t
+file_frame_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct frame *frame = hash_entry (e, struct frame, file_elem);
+
+	return hash_bytes (&frame->inode, sizeof frame->inode) ^ frame->ofs;
+}
+
+static bool
+file_frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct frame *a = hash_entry (a_, struct frame, file_elem);
+	const struct frame *b = hash_entry (b_, struct frame, file_elem);
+
+	return a->inode != b->inode ? a->inode < b->inode : a->ofs < b->ofs;
+}
+
+/* Returns the frame holding INODE's page at OFS, or a null
+ * pointer if none does.  FRAME_LOCK must be held. */
+static struct frame *
+file_frame_find (struct inode *inode, off_t ofs) {
+	struct frame key;
+	struct hash_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	key.inode = inode;
+	key.ofs = ofs;
+	e = hash_find (&file_frames, &key.file_elem);
+	return e != NULL ? hash_entry (e, struct frame, file_elem) : NULL;
+}
+
+/* Records that FRAME, just read in, holds INODE's page at OFS.
+ * FRAME_LOCK must be held. */
+static void
+file_frame_insert (struct frame *frame, struct inode *inode, off_t ofs) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (frame->inode == NULL);
+
+	frame->inode = inode;
+	frame->ofs = ofs;
+	frame->dirty = false;
+	hash_insert (&file_frames, &frame->file_elem);
+	if (++file_frame_cnt > file_frame_peak)
+		file_frame_peak = file_frame_cnt;
+}
+
+/* Removes FRAME from the file frame index, if it is there.
+ * FRAME_LOCK must be held. */
+static void
+frame_forget_file (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame->inode != NULL) {
+		hash_delete (&file_frames, &frame->file_elem);
+		frame->inode = NULL;
+		frame->dirty = false;
+		file_frame_cnt--;
+	}
+}
+
+/* Removes FRAME from the merge candidates, if it is there.
+ * FRAME_LOCK must be held. */
+static void
+ksm_forget (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame->ksm_listed) {
+		hash_delete (&ksm_candidates, &frame->ksm_elem);
+		frame->ksm_listed = false;
+	}
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Removes FRAME from the frame table, moving the clock hand and
+ * the merging daemon's cursor past it, and from the indexes that
+ * find frames by contents.  FRAME_LOCK must be held. */
+static void
+frame_table_remove (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	if (ksm_cursor == &frame->elem)
+		ksm_cursor = list_next (ksm_cursor);
+	list_remove (&frame->elem);
+	frame_cnt--;
+	frame_forget_file (frame);
+	ksm_forget (frame);
+}
+
+/* Removes FRAME from the frame table and frees it.  FRAME_LOCK
+ * must be held. */
+static void
+frame_free (struct frame *frame) {
+	ASSERT (frame->ref_cnt == 0);
+
+	frame_table_remove (frame);
+	palloc_free_page (frame->kva);
+	kmem_cache_free (frame_kmem_cache, frame);
+}
+
+/* Waits until PAGE's frame, if it is being evicted, has been
+ * written out and has let go of PAGE.  FRAME_LOCK must be held;
+ * it is released while waiting. */
+static void
+frame_wait_evicted (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	while (page->frame != NULL && page->frame->evicting)
+		cond_wait (&evict_done, &frame_lock);
+}
+
+/* Returns the frame holding INODE's page at OFS, like
+ * file_frame_find(), but first waits for such a frame that is
+ * being evicted to leave the index.  FRAME_LOCK must be held; it
+ * is released while waiting. */
+static struct frame *
+file_frame_find_settled (struct inode *inode, off_t ofs) {
+	struct frame *frame;
+
+	while ((frame = file_frame_find (inode, ofs)) != NULL && frame->evicting)
+		cond_wait (&evict_done, &frame_lock);
+	return frame;
+}
+
+/* True if FRAME is shared copy-on-write, as fork() leaves the
+ * frames of anonymous pages.  File frames are shared for good:
+ * writes through any mapping are meant for all of them. */
+static bool
+frame_is_cow (const struct frame *frame) {
+	return frame->ref_cnt > 1 && frame->inode == NULL;
+}
+
+/* Returns true if any page mapping FRAME was accessed since the
+ * last call, clearing the pages' accessed bits.  FRAME_LOCK must
+ * be held. */
+static bool
+frame_accessed (struct frame *frame) {
+	struct list_elem *e;
+	bool accessed = false;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+
+		if (pml4_is_accessed (page->pml4, page->va)) {
+			pml4_set_accessed (page->pml4, page->va, false);
+			accessed = true;
+		}
+	}
+	return accessed;
+}
+
+/* Takes away every mapping of FRAME, so that its pages fault
+ * instead of using it.  The dirty bits of a file frame's mappings
+ * are collected into its DIRTY first.  FRAME_LOCK must be held. */
+static void
+frame_unmap (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+
+		if (frame->inode != NULL && pml4_is_dirty (page->pml4, page->va))
+			frame->dirty = true;
+		pml4_clear_page (page->pml4, page->va);
+	}
+}
+
+/* Unmaps PAGE and unlinks it from FRAME, freeing FRAME along with
+ * its last page.  The last mapping of a file frame writes it back
+ * first if any mapping wrote to it.  FRAME_LOCK must be held. */
+static void
+frame_drop_page (struct frame *frame, struct page *page) {
+	if (frame->inode != NULL && pml4_is_dirty (page->pml4, page->va))
+		frame->dirty = true;
+	pml4_clear_page (page->pml4, page->va);
+	if (frame->ref_cnt == 1 && frame->inode != NULL && !swap_out (page))
+		PANIC ("cannot write back page at %p", page->va);
+	if (frame_remove_page (frame, page))
+		frame_free (frame);
+}
+
+/* Get the struct frame, that will be evicted.
+ *
+ * This is the clock algorithm: the hand sweeps the frame table,
+ * giving each frame whose pages were accessed since the last visit
+ * a second chance by clearing their accessed bits.  Two sweeps are
+ * enough to find a victim if there is one, and each frame passed
+ * over costs O(1) per mapping, so a victim costs O(1) amortized.
+ * Pinned frames are skipped.  A frame shared copy-on-write goes to
+ * one swap slot that all of its pages refer to, and a shared file
+ * frame is written back once, so shared frames can go as well.
+ * FRAME_LOCK must be held. */
 static struct frame *
 vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	size_t n;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
 
-	return victim;
+	for (n = 0; n < 2 * frame_cnt; n++) {
+		struct frame *frame;
+
+		if (clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+		frame = list_entry (clock_hand, struct frame, elem);
+		clock_hand = list_next (clock_hand);
+		scan_cnt++;
+
+		if (frame->pin_cnt > 0 || frame_accessed (frame))
+			continue;
+		return frame;
+	}
+	return NULL;
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Return NULL on error.  FRAME_LOCK must be held; it is released
+ * while the victims are written out.
+ *
+ * Up to EVICT_BATCH victims are evicted together, so that the
+ * anonymous ones can go to adjacent swap slots in a single disk
+ * command.  The frames beyond the first are kept on FREE_FRAMES
+ * for the next allocations.
+ *
+ * The victims are chosen, pinned and unmapped under FRAME_LOCK,
+ * written out, compressed or written back without it, and then
+ * unlinked from their pages under it again, so that faults on
+ * other frames go on while the disk works. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct frame *victims[EVICT_BATCH];
+	struct page *anon[EVICT_BATCH];
+	size_t cnt, anon_cnt = 0, i;
 
-	return NULL;
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (cnt = 0; cnt < EVICT_BATCH; cnt++) {
+		struct frame *victim = vm_get_victim ();
+
+		if (victim == NULL)
+			break;
+
+		/* Pinning keeps the hand from choosing it twice.  Unmap
+		 * the pages first, so that their owners fault, and wait
+		 * in frame_wait_evicted(), instead of changing the frame
+		 * while it is written out. */
+		victim->pin_cnt++;
+		victim->evicting = true;
+		frame_unmap (victim);
+		victims[cnt] = victim;
+	}
+	if (cnt == 0)
+		return NULL;
+	evicting_cnt += cnt;
+	lock_release (&frame_lock);
+
+	for (i = 0; i < cnt; i++) {
+		struct page *page = victims[i]->page;
+
+		if (VM_TYPE (page->operations->type) == VM_ANON)
+			anon[anon_cnt++] = page;
+		else if (!swap_out (page))
+			PANIC ("cannot evict page at %p", page->va);
+	}
+	if (anon_cnt > 0 && !anon_swap_out_batch (anon, anon_cnt))
+		PANIC ("out of swap space");
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < cnt; i++) {
+		struct frame *victim = victims[i];
+
+		while (victim->ref_cnt > 0)
+			frame_remove_page (victim, victim->page);
+		frame_forget_file (victim);
+		ksm_forget (victim);
+		victim->pin_cnt--;
+		victim->evicting = false;
+		if (i > 0) {
+			frame_table_remove (victim);
+			list_push_back (&free_frames, &victim->elem);
+		}
+	}
+	evicting_cnt -= cnt;
+	evict_cnt += cnt;
+	cond_broadcast (&evict_done, &frame_lock);
+
+	return victims[0];
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * and return it.  That is, if the user pool memory is full, this
+ * function evicts the frame to get the available memory space.
+ * Returns a null pointer if every frame is pinned, so that the
+ * fault fails instead of the kernel.
+ *
+ * The frame is returned pinned; the caller unpins it once it has
+ * been filled and mapped. */
 static struct frame *
 vm_get_frame (void) {
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	void *kva = palloc_get_page (PAL_USER);
+
+	lock_acquire (&frame_lock);
+	while (kva == NULL && list_empty (&free_frames)) {
+		frame = vm_evict_frame ();
+		if (frame != NULL || evicting_cnt == 0)
+			break;
 
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
+		/* Every frame is pinned, some of them by evictions under
+		 * way, which will free frames. */
+		cond_wait (&evict_done, &frame_lock);
+	}
+	if (frame == NULL && (kva != NULL || !list_empty (&free_frames))) {
+		if (kva != NULL) {
+			frame = kmem_cache_alloc (frame_kmem_cache);
+			if (frame == NULL) {
+				palloc_free_page (kva);
+				lock_release (&frame_lock);
+				return NULL;
+			}
+			frame->kva = kva;
+			frame->page = NULL;
+			list_init (&frame->pages);
+			frame->ref_cnt = 0;
+			frame->inode = NULL;
+			frame->dirty = false;
+			frame->ksm_listed = false;
+			frame->evicting = false;
+		} else
+			frame = list_entry (list_pop_front (&free_frames), struct frame, elem);
+
+		/* Just behind the hand, so the hand reaches it last. */
+		list_insert (clock_hand, &frame->elem);
+		frame_cnt++;
+	}
+	if (frame != NULL) {
+		frame->pin_cnt = 1;
+		frame->checksum = 0;
+		frame->merged = false;
+	}
+	lock_release (&frame_lock);
+
+	ASSERT (frame == NULL || frame->page == NULL);
 	return frame;
 }
 
+/* Drops PAGE's reference to its frame, if it has one, and unmaps
+ * PAGE, which may be mapped to the zero page instead.  The frame is
+ * freed along with its last reference, after being written back if
+ * it holds part of a file and was written. */
+void
+vm_release_frame (struct page *page) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	frame_wait_evicted (page);
+	frame = page->frame;
+	if (frame != NULL)
+		frame_drop_page (frame, page);
+	else
+		pml4_clear_page (page->pml4, page->va);
+	lock_release (&frame_lock);
+}
+
+/* True if PAGE is mapped and the mapping allows writes. */
+static bool
+page_mapped_writable (struct page *page) {
+	uint64_t *pte = pml4e_walk (page->pml4, (uint64_t) page->va, 0);
+
+	return pte != NULL && (*pte & PTE_P) != 0 && is_writable (pte);
+}
+
+/* Pins the pages spanning SIZE bytes at BUFFER in memory,
+ * faulting them in first, so that a system call can use the
+ * buffer while holding file system locks without the pages being
+ * evicted underneath it.  WRITE is true if the kernel is going to
+ * write the buffer.  A bad buffer kills the process in the page
+ * fault handler, like any other bad user access. */
+void
+vm_pin_buffer (const void *buffer, size_t size, bool write) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	const uint8_t *end = (const uint8_t *) buffer + size;
+	uint8_t *upage;
+
+	for (upage = pg_round_down (buffer); upage < end; upage += PGSIZE) {
+		volatile uint8_t *addr = upage < (uint8_t *) buffer
+			? (uint8_t *) buffer : upage;
+
+		for (;;) {
+			struct page *page;
+			bool pinned = false;
+
+			/* A frame to be written must not be copy-on-write, or
+			 * the write would move the page to a new, unpinned
+			 * frame, and must be mapped writable, so that the write
+			 * does not fault while the caller holds its locks. */
+			lock_acquire (&frame_lock);
+			page = spt_find_page (spt, upage);
+			if (page != NULL)
+				frame_wait_evicted (page);
+			if (page != NULL && page->frame != NULL
+					&& (!write || (!frame_is_cow (page->frame)
+							&& page_mapped_writable (page)))) {
+				page->frame->pin_cnt++;
+				pinned = true;
+			} else if (page != NULL && !write && anon_on_zero_page (page)
+					&& pml4_get_page (page->pml4, upage) != NULL) {
+				/* The zero page never moves. */
+				pinned = true;
+			}
+			lock_release (&frame_lock);
+			if (pinned)
+				break;
+
+			if (write)
+				*addr = *addr;
+			else
+				(void) *addr;
+		}
+	}
+}
+
+/* Unpins the pages pinned by vm_pin_buffer (BUFFER, SIZE). */
+void
+vm_unpin_buffer (const void *buffer, size_t size) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	const uint8_t *end = (const uint8_t *) buffer + size;
+	uint8_t *upage;
+
+	lock_acquire (&frame_lock);
+	for (upage = pg_round_down (buffer); upage < end; upage += PGSIZE) {
+		struct page *page = spt_find_page (spt, upage);
+
+		if (page != NULL && page->frame != NULL && page->frame->pin_cnt > 0)
+			page->frame->pin_cnt--;
+	}
+	lock_release (&frame_lock);
+}
+
+static uint64_t
+ksm_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct frame, ksm_elem)->checksum;
+}
+
+static bool
+ksm_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct frame, ksm_elem)->checksum
+		< hash_entry (b, struct frame, ksm_elem)->checksum;
+}
+
+/* hash_clear() action that marks a frame no longer a candidate. */
+static void
+ksm_unlist (struct hash_elem *e, void *aux UNUSED) {
+	hash_entry (e, struct frame, ksm_elem)->ksm_listed = false;
+}
+
+/* Returns a hash of the page of memory at KVA, taken a word at a
+ * time. */
+static uint64_t
+page_checksum (const void *kva) {
+	const uint64_t *words = kva;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < PGSIZE / sizeof *words; i++)
+		hash = (hash ^ words[i]) * 0x100000001b3ULL;
+	return hash;
+}
+
+/* True if FRAME may be merged with another: an anonymous frame in
+ * use and not pinned.  FRAME_LOCK must be held. */
+static bool
+ksm_mergeable (const struct frame *frame) {
+	return frame->pin_cnt == 0 && frame->ref_cnt > 0 && frame->inode == NULL
+		&& VM_TYPE (frame->page->operations->type) == VM_ANON;
+}
+
+/* Takes write access to FRAME away from all of its pages, keeping
+ * their accessed and dirty bits.  A later write faults into
+ * vm_handle_wp(), which waits for FRAME_LOCK and then either copies
+ * the frame or maps it writable again.  FRAME_LOCK must be held. */
+static void
+frame_write_protect (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+
+		pml4_set_writable (page->pml4, page->va, false);
+	}
+}
+
+/* Gives write access to FRAME back to those of its pages that
+ * may write, unless FRAME is shared copy-on-write, undoing
+ * frame_write_protect().  FRAME_LOCK must be held. */
+static void
+frame_write_unprotect (struct frame *frame) {
+	struct list_elem *e;
+
+	if (frame_is_cow (frame))
+		return;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+
+		if (page->writable)
+			pml4_set_writable (page->pml4, page->va, true);
+	}
+}
+
+/* Merges DUP into KEEP if they hold the same contents: DUP's
+ * pages are mapped read-only to KEEP, and DUP is freed.  Frames
+ * that differ at a first comparison are left alone.  Otherwise
+ * both frames are write-protected and compared again, so that
+ * neither changes between the comparison and the merge even if
+ * we are preempted; if one changed before it was protected, both
+ * get their write access back.  FRAME_LOCK must be held. */
+static void
+ksm_merge (struct frame *keep, struct frame *dup) {
+	if (memcmp (keep->kva, dup->kva, PGSIZE) != 0)
+		return;
+	frame_write_protect (keep);
+	frame_write_protect (dup);
+	if (memcmp (keep->kva, dup->kva, PGSIZE) != 0) {
+		frame_write_unprotect (keep);
+		frame_write_unprotect (dup);
+		return;
+	}
+
+	while (dup->ref_cnt > 0) {
+		struct page *page = dup->page;
+
+		frame_remove_page (dup, page);
+		frame_add_page (keep, page);
+		pml4_set_page (page->pml4, page->va, keep->kva, false);
+	}
+	keep->merged = true;
+	frame_free (dup);
+	ksm_merge_cnt++;
+}
+
+/* Scans FRAME: merges it into the candidate with the same hash,
+ * if there is one, or else makes it a candidate, provided its
+ * contents hashed the same on the last visit.  FRAME_LOCK must be
+ * held. */
+static void
+ksm_scan_frame (struct frame *frame) {
+	uint64_t checksum;
+	struct hash_elem *e;
+
+	if (frame->ksm_listed || !ksm_mergeable (frame))
+		return;
+	checksum = page_checksum (frame->kva);
+	if (checksum != frame->checksum) {
+		/* Changed since the last visit, or never visited. */
+		frame->checksum = checksum;
+		return;
+	}
+
+	e = hash_find (&ksm_candidates, &frame->ksm_elem);
+	if (e == NULL) {
+		hash_insert (&ksm_candidates, &frame->ksm_elem);
+		frame->ksm_listed = true;
+	} else {
+		struct frame *keep = hash_entry (e, struct frame, ksm_elem);
+
+		if (ksm_mergeable (keep))
+			ksm_merge (keep, frame);
+	}
+}
+
+/* Scans ksm_pages_per_tick frames for every tick that passes,
+ * KSM_INTERVAL ticks' worth at a time.  FRAME_LOCK is taken for
+ * one frame at a time, so that faults are not held up behind a
+ * whole batch. */
+static void
+ksm_daemon (void *aux UNUSED) {
+	for (;;) {
+		size_t n;
+
+		timer_sleep (KSM_INTERVAL);
+		for (n = 0; n < (size_t) ksm_pages_per_tick * KSM_INTERVAL
+				&& n < frame_cnt; n++) {
+			uint64_t start = rdtsc ();
+
+			lock_acquire (&frame_lock);
+			if (ksm_cursor == list_end (&frame_table)) {
+				/* A pass is over; start the next one afresh. */
+				hash_clear (&ksm_candidates, ksm_unlist);
+				ksm_cursor = list_begin (&frame_table);
+			}
+			if (ksm_cursor != list_end (&frame_table)) {
+				struct frame *frame = list_entry (ksm_cursor, struct frame, elem);
+
+				ksm_cursor = list_next (ksm_cursor);
+				ksm_scan_frame (frame);
+				ksm_scan_cnt++;
+			}
+			lock_release (&frame_lock);
+			ksm_scan_cycles += rdtsc () - start;
+		}
+	}
+}
+
+/* Prints same-page merging statistics. */
+static void
+ksm_print_stats (void) {
+	size_t merged = 0, sharers = 0;
+	struct list_elem *e;
+
+	for (e = list_begin (&frame_table); e != list_end (&frame_table);
+			e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, elem);
+
+		if (frame->merged && frame->ref_cnt > 1) {
+			merged++;
+			sharers += frame->ref_cnt;
+		}
+	}
+	printf ("Merging: %lld frames scanned, %lld merged away, %lld pages "
+			"copied on write\n", ksm_scan_cnt, ksm_merge_cnt, ksm_unmerge_cnt);
+	printf ("Merging: %zu merged frames mapped by %zu pages, "
+			"%llu cycles scanning", merged, sharers,
+			(unsigned long long) ksm_scan_cycles);
+	if (ksm_scan_cnt > 0)
+		printf (" (%llu per frame)",
+				(unsigned long long) ksm_scan_cycles / ksm_scan_cnt);
+	printf ("\n");
+}
+
+/* Lowest address the stack may grow down to. */
+#define STACK_LIMIT (USER_STACK - (1 << 20))
+
 /* Growing the stack. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+vm_stack_growth (void *addr) {
+	void *upage = pg_round_down (addr);
+
+	if (vm_alloc_page (VM_ANON | VM_MARKER_0, upage, true))
+		vm_claim_page (upage);
+}
+
+/* Handle the fault on write_protected page.
+ *
+ * Writable pages are mapped read-only while fork() has them
+ * sharing a frame with another process.  The first write to one
+ * lands here: if other pages still share the frame, the writer
+ * gets a private copy of it; if the writer is the last one left,
+ * it keeps the frame and is simply mapped writable again.  Frames
+ * the merging daemon folded together are shared the same way.
+ *
+ * The first write to an anonymous page mapped to the zero page
+ * also lands here, and gives the page a zeroed frame of its own. */
+static bool
+vm_handle_wp (struct page *page) {
+	struct frame *old, *new = NULL;
+	bool success;
+
+	lock_acquire (&frame_lock);
+	for (;;) {
+		frame_wait_evicted (page);
+		old = page->frame;
+		if (old == NULL && anon_on_zero_page (page)) {
+			pml4_clear_page (page->pml4, page->va);
+			zero_fill_cnt++;
+			if (new != NULL)
+				frame_free (new);
+			lock_release (&frame_lock);
+			return vm_do_claim_page (page);
+		}
+		if (old == NULL || !frame_is_cow (old) || new != NULL)
+			break;
+
+		/* Allocate outside FRAME_LOCK, since allocating may evict.
+		 * The frame may be evicted, or merged with another one,
+		 * meanwhile, so look at it again afterward. */
+		lock_release (&frame_lock);
+		new = vm_get_frame ();
+		if (new == NULL)
+			return false;
+		lock_acquire (&frame_lock);
+	}
+
+	if (old == NULL) {
+		/* Evicted meanwhile; retrying the access faults it back
+		 * in. */
+		success = true;
+	} else {
+		if (frame_is_cow (old)) {
+			/* Copy while holding the lock, so that the other
+			 * sharers cannot take the frame back and write to it
+			 * meanwhile. */
+			memcpy (new->kva, old->kva, PGSIZE);
+			if (old->merged)
+				ksm_unmerge_cnt++;
+			frame_remove_page (old, page);
+			frame_add_page (new, page);
+			new->pin_cnt--;
+			new = NULL;
+		}
+		pml4_clear_page (page->pml4, page->va);
+		success = pml4_set_page (page->pml4, page->va, page->frame->kva, true);
+	}
+	if (new != NULL)
+		frame_free (new);
+	lock_release (&frame_lock);
+
+	return success;
+}
+
+/* Loads the pages following PAGE whose contents follow PAGE's LL
+ * in the same file, up to PREFETCH_PAGES of them.  Each page's
+ * own loader reads its part of the file straight into its frame,
+ * in file order, so the buffer cache's read-ahead keeps the disk
+ * one sector ahead of the reads.  Only anonymous pages are loaded
+ * this way, which covers executable segments. */
+static void
+vm_prefetch (struct page *page, const struct lazy_load *ll) {
+	struct thread *t = thread_current ();
+	struct page *batch[PREFETCH_PAGES];
+	off_t ofs = ll->ofs + ll->read_bytes;
+	size_t cnt, i;
+
+	if (ll->read_bytes != PGSIZE)
+		return;
+	for (cnt = 0; cnt < PREFETCH_PAGES; ) {
+		struct page *next = spt_find_page (&t->spt,
+				(uint8_t *) page->va + (cnt + 1) * PGSIZE);
+		struct lazy_load *next_ll;
+
+		if (next == NULL || VM_TYPE (next->operations->type) != VM_UNINIT
+				|| VM_TYPE (next->uninit.type) != VM_ANON
+				|| next->uninit.aux == NULL)
+			break;
+		next_ll = next->uninit.aux;
+		if (next_ll->file != ll->file || next_ll->ofs != ofs
+				|| next_ll->read_bytes == 0)
+			break;
+		batch[cnt++] = next;
+		ofs += next_ll->read_bytes;
+		if (next_ll->read_bytes != PGSIZE)
+			break;
+	}
+
+	/* Stop at the first page that cannot be loaded, out of frames
+	 * or short of its file; the rest load when they fault. */
+	for (i = 0; i < cnt; i++)
+		if (!vm_do_claim_page (batch[i]))
+			break;
+	prefetch_cnt += i;
+	if (i > 0)
+		t->last_load_va = batch[i - 1]->va;
+}
+
+/* Loads PAGE, which has never been loaded, on its first fault.
+ * A fault on the page right after the last one loaded this way
+ * suggests the program is walking through a segment, so the
+ * following pages are loaded along with it. */
+static bool
+vm_lazy_load (struct page *page) {
+	struct thread *t = thread_current ();
+	bool sequential = page->va == (uint8_t *) t->last_load_va + PGSIZE;
+	struct lazy_load ll;
+	bool has_ll = page->uninit.aux != NULL;
+
+	/* The loader frees its instructions; keep a copy. */
+	if (has_ll)
+		ll = *(struct lazy_load *) page->uninit.aux;
+	if (!vm_do_claim_page (page))
+		return false;
+
+	lazy_load_cnt++;
+	t->last_load_va = page->va;
+	if (sequential && has_ll && VM_TYPE (page->operations->type) == VM_ANON)
+		vm_prefetch (page, &ll);
+	return true;
 }
 
-/* Handle the fault on write_protected page */
+/* Returns true if PAGE, not yet loaded, is an anonymous page
+ * that would be loaded as all zeros, like a page of BSS. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+page_starts_zero (struct page *page) {
+	struct lazy_load *ll = page->uninit.aux;
+
+	return VM_TYPE (page->uninit.type) == VM_ANON
+		&& (ll == NULL || ll->read_bytes == 0);
+}
+
+/* Maps the zero page, read-only, for a read of PAGE, for which
+ * page_starts_zero() is true, turning it into an anonymous page
+ * without a frame. */
+static bool
+vm_map_zero_page (struct page *page) {
+	struct lazy_load *ll = page->uninit.aux;
+
+	/* Initialize the page without its loader, which would fill a
+	 * frame; the anonymous initializer leaves a null KVA alone. */
+	page->uninit.init = NULL;
+	page->uninit.aux = NULL;
+	free (ll);
+	if (!swap_in (page, NULL))
+		return false;
+	zero_map_cnt++;
+	return pml4_set_page (page->pml4, page->va, zero_page, false);
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
 	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
 
-	return vm_do_claim_page (page);
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	page = spt_find_page (spt, pg_round_down (addr));
+	if (!not_present) {
+		/* A rights violation is only legitimate as the first write
+		 * to a page fork() or the merging daemon left shared. */
+		if (write && page != NULL && page->writable)
+			return vm_handle_wp (page);
+		return false;
+	}
+
+	if (page == NULL) {
+		/* Faults in the kernel happen inside system calls, after
+		 * the user's RSP was saved on entry. */
+		uintptr_t rsp = user ? f->rsp
+			: (uintptr_t) thread_current ()->user_rsp;
+
+		if ((uintptr_t) addr >= rsp - 8 && (uintptr_t) addr < USER_STACK
+				&& (uintptr_t) addr >= STACK_LIMIT) {
+			vm_stack_growth (addr);
+			return true;
+		}
+		return false;
+	}
+	if (write && !page->writable)
+		return false;
+
+	/* A page that was loaded before and is now absent comes back
+	 * from swap or its file. */
+	if (VM_TYPE (page->operations->type) != VM_UNINIT) {
+		int64_t start = timer_ticks ();
+		bool success = vm_do_claim_page (page);
+
+		major_fault_ticks += timer_elapsed (start);
+		major_fault_cnt++;
+		return success;
+	}
+	if (!write && page_starts_zero (page))
+		return vm_map_zero_page (page);
+	return vm_lazy_load (page);
 }
 
 /* Free the page.
@@ -126,109 +1161,436 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 void
 vm_dealloc_page (struct page *page) {
 	destroy (page);
-	free (page);
+	kmem_cache_free (page_kmem_cache, page);
 }
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
 
+	if (page == NULL)
+		return false;
 	return vm_do_claim_page (page);
 }
 
-/* Claim the PAGE and set up the mmu. */
-static bool
-vm_do_claim_page (struct page *page) {
+/* First half of claiming PAGE: gives it a frame, pinned and not
+ * yet mapped, and returns the frame's kernel address for the
+ * caller to fill, or a null pointer if no frame can be had.
+ * vm_finish_claim() completes the claim.  Swap-in uses the two
+ * halves to read neighbouring pages along with the one that
+ * faulted. */
+void *
+vm_begin_claim (struct page *page) {
 	struct frame *frame = vm_get_frame ();
 
+	if (frame == NULL)
+		return NULL;
+
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	lock_acquire (&frame_lock);
+	frame_add_page (frame, page);
+	lock_release (&frame_lock);
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	return frame->kva;
+}
+
+/* Second half of claiming PAGE: if SUCCESS, maps PAGE, otherwise
+ * gives up its frame.  Unpins the frame either way.  Returns true
+ * if PAGE ends up mapped. */
+bool
+vm_finish_claim (struct page *page, bool success) {
+	struct frame *frame = page->frame;
 
-	return swap_in (page, frame->kva);
+	lock_acquire (&frame_lock);
+	if (success)
+		success = pml4_set_page (page->pml4, page->va, frame->kva,
+				page->writable);
+	frame->pin_cnt--;
+	if (!success && frame_remove_page (frame, page))
+		frame_free (frame);
+	lock_release (&frame_lock);
+
+	return success;
 }
 
+/* Claims PAGE, a mapped file page, mapping the frame that
+ * already holds its part of the file if another mapping, in any
+ * process, has read it.  Otherwise reads the file into a new
+ * frame and enters the frame in the file frame index. */
+static bool
+vm_claim_file_page (struct page *page) {
+	struct inode *inode;
+	struct frame *frame;
+	bool success;
 
-/* Copy supplemental page table from src to dst */
-bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+	/* The initializer only sets up PAGE->file; it does not touch
+	 * the frame, which is chosen below. */
+	if (VM_TYPE (page->operations->type) == VM_UNINIT
+			&& !swap_in (page, NULL))
+		return false;
+	inode = file_get_inode (page->file.map->file);
+
+	lock_acquire (&frame_lock);
+	frame = file_frame_find_settled (inode, page->file.ofs);
+	if (frame != NULL) {
+		frame_add_page (frame, page);
+		success = pml4_set_page (page->pml4, page->va, frame->kva,
+				page->writable);
+		if (!success)
+			frame_drop_page (frame, page);
+		file_share_cnt++;
+		lock_release (&frame_lock);
+		return success;
+	}
+	lock_release (&frame_lock);
+
+	/* Read outside FRAME_LOCK; the frame is pinned meanwhile and not
+	 * yet in the index, so nobody else can see it half-filled. */
+	frame = vm_get_frame ();
+	if (frame == NULL)
+		return false;
+	lock_acquire (&frame_lock);
+	frame_add_page (frame, page);
+	lock_release (&frame_lock);
+	success = swap_in (page, frame->kva);
+
+	lock_acquire (&frame_lock);
+	frame->pin_cnt--;
+	if (success) {
+		struct frame *other = file_frame_find_settled (inode,
+				page->file.ofs);
+
+		if (other != NULL) {
+			/* Another mapping read the same page meanwhile. */
+			frame_remove_page (frame, page);
+			frame_free (frame);
+			frame_add_page (other, page);
+			frame = other;
+		} else
+			file_frame_insert (frame, inode, page->file.ofs);
+		success = pml4_set_page (page->pml4, page->va, frame->kva,
+				page->writable);
+		file_read_cnt++;
+	}
+	if (!success)
+		frame_drop_page (frame, page);
+	lock_release (&frame_lock);
+
+	return success;
 }
 
-/* Free the resource hold by the supplemental page table */
-void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+/* Claim the PAGE and set up the mmu.  The frame is filled before
+ * it is mapped, and stays pinned until then so that it cannot be
+ * evicted half-filled. */
+static bool
+vm_do_claim_page (struct page *page) {
+	void *kva;
+
+	/* A page whose frame is being evicted is claimed again once it
+	 * is written out. */
+	lock_acquire (&frame_lock);
+	frame_wait_evicted (page);
+	lock_release (&frame_lock);
+
+	if (page_get_type (page) == VM_FILE)
+		return vm_claim_file_page (page);
+	kva = vm_begin_claim (page);
+	if (kva == NULL)
+		return false;
+	return vm_finish_claim (page, swap_in (page, kva));
 }
 
 
-/* 해시 함수: 페이지의 가상 주소를 해시값으로 변환 */
-static unsigned page_hash(const struct hash_elem *e, void *aux) {
-    // 1. hash_elem으로부터 struct page를 얻어야 함
-	// Pintos가 제공하는 hash_entry 매크로
-	struct page *p = hash_entry(e, struct page, hash_elem);
+/* Copies PARENT, a page of the running thread's parent, into the
+ * running thread's table DST.  Used by
+ * supplemental_page_table_copy() through spt_for_each(). */
+static bool
+copy_page (struct page *parent, void *dst_) {
+	struct supplemental_page_table *dst = dst_;
+	uint64_t *pml4 = thread_current ()->pml4;
+	bool is_file = page_get_type (parent) == VM_FILE;
+	struct page *child;
+	bool zero, success;
+
+	if (VM_TYPE (parent->operations->type) == VM_UNINIT) {
+		struct uninit_page *uninit = &parent->uninit;
+		void *aux = NULL;
+
+		if (is_file) {
+			aux = file_backed_copy_aux (uninit->aux);
+			if (aux == NULL)
+				return false;
+		} else if (uninit->aux != NULL) {
+			aux = malloc (sizeof (struct lazy_load));
+			if (aux == NULL)
+				return false;
+			memcpy (aux, uninit->aux, sizeof (struct lazy_load));
+		}
+		if (!vm_alloc_page_with_initializer (uninit->type, parent->va,
+					parent->writable, uninit->init, aux)) {
+			if (is_file)
+				file_backed_free_aux (aux);
+			else
+				free (aux);
+			return false;
+		}
+		return true;
+	}
+
+	child = kmem_cache_alloc (page_kmem_cache);
+	if (child == NULL)
+		return false;
 
-    // 2. page의 va를 해시값으로 변환
-	// unsigned va= &p->va;
-	return hash_bytes(&p->va, sizeof p->va);
+	/* A mapped file page need not be resident: the child can read
+	 * the file, or share the frame, when it faults.  Neither need a
+	 * page on the zero page. */
+	lock_acquire (&frame_lock);
+	frame_wait_evicted (parent);
+	zero = anon_on_zero_page (parent);
+	while (!is_file && !zero && parent->frame == NULL) {
+		lock_release (&frame_lock);
+		if (!vm_do_claim_page (parent)) {
+			kmem_cache_free (page_kmem_cache, child);
+			return false;
+		}
+		lock_acquire (&frame_lock);
+		frame_wait_evicted (parent);
+	}
 
+	/* Copy only now that the parent is resident, so that the
+	 * child does not inherit a swap slot the parent owns. */
+	memcpy (child, parent, sizeof *child);
+	child->pml4 = pml4;
+	child->frame = NULL;
+	if (!spt_insert_page (dst, child)) {
+		lock_release (&frame_lock);
+		kmem_cache_free (page_kmem_cache, child);
+		return false;
+	}
+	if (is_file)
+		file_backed_fork (child);
+	if (parent->frame == NULL) {
+		success = !zero || pml4_set_page (pml4, child->va, zero_page, false);
+		lock_release (&frame_lock);
+		return success;
+	}
+	frame_add_page (parent->frame, child);
+
+	/* Mapped file pages stay shared, writable or not.  Other pages
+	 * become copy-on-write; pml4_set_page() drops the parent's
+	 * stale writable TLB entry. */
+	success = pml4_set_page (pml4, child->va, parent->frame->kva,
+			is_file && child->writable);
+	if (!is_file && parent->writable)
+		pml4_set_page (parent->pml4, parent->va, parent->frame->kva, false);
+	lock_release (&frame_lock);
+	return success;
 }
 
-/* 비교 함수: 두 페이지를 비교 (a < b?) */
-static bool page_less(const struct hash_elem *a, 
-                      const struct hash_elem *b, 
-                      void *aux) {
-    // 1. 두 hash_elem으로부터 각각 struct page 얻기
-	struct page *p1= hash_entry(a, struct page, hash_elem);
-	struct page *p2= hash_entry(b, struct page, hash_elem);
-    
-	// 2. va 주소 비교
-	return p1->va < p2->va;
+/* Copy supplemental page table from src to dst.
+ *
+ * Pages that were never touched are copied as pending pages with
+ * their own copy of the loading instructions.  Every other page
+ * shares its frame with the parent: both mappings become
+ * read-only and the frame's reference count goes up, so fork()
+ * costs no copying until one side writes, which vm_handle_wp()
+ * then resolves.  Evicted pages are brought back in to be shared.
+ * Mapped file pages share their frames as they are, since every
+ * mapping of a file sees the same data.  Pages are visited in
+ * address order, so the child's table is built up one node at a
+ * time. */
+bool
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	return spt_for_each (src, NULL, (void *) KERN_BASE, copy_page, dst);
+}
 
-	/*
-	struct page *p1 = ...;
-	p1->va      // va에 "저장된 값" (가상 주소, 예: 0x400000)
-	&p1->va     // va 필드 자체의 "메모리 주소" (struct page 내부 어딘가)
-	*/
+/* Index of page number VPN's entry in a node at LEVEL, where the
+ * root is level 0. */
+static size_t
+spt_index (uint64_t vpn, int level) {
+	return (vpn >> ((SPT_LEVELS - 1 - level) * SPT_BITS)) & (SPT_FANOUT - 1);
+}
+
+/* Returns the leaf slot for VA in SPT.  Missing nodes are
+ * allocated if CREATE is true; otherwise, or if allocation fails,
+ * returns a null pointer.  So does a VA at or above SPT_LIMIT. */
+static struct page **
+spt_slot (struct supplemental_page_table *spt, const void *va, bool create) {
+	uint64_t vpn = pg_no (va);
+	void **slot = (void **) &spt->root;
+	int level;
+
+	if ((uint64_t) va >= SPT_LIMIT)
+		return NULL;
+
+	for (level = 0; level < SPT_LEVELS; level++) {
+		void **node = *slot;
+
+		if (node == NULL) {
+			if (!create)
+				return NULL;
+			node = palloc_get_page (PAL_ZERO);
+			if (node == NULL)
+				return NULL;
+			*slot = node;
+		}
+		slot = &node[spt_index (vpn, level)];
+	}
+	return (struct page **) slot;
 }
 
 /* Initializes the supplemental page table. */
-void supplemental_page_table_init(struct supplemental_page_table *spt) {
-    // hash_init(해시테이블, 해시함수, 비교함수, aux)
-    // aux는 NULL로 두면 됨 (지금은 안 씀)
-	hash_init(&spt->pages, page_hash, page_less, NULL);
+void
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	spt->root = NULL;
+	spt->page_cnt = 0;
 }
 
 /* Find VA from spt and return page. On error, return NULL. */
-struct page *spt_find_page(struct supplemental_page_table *spt, void *va) {
-    // 1. 임시 page 구조체 만들기 (키로 사용)
-    // 2. hash_find()로 찾기 - 해시 테이블에 저장된 struct page들 중에서, va가 일치하는 페이지
-    // 3. 결과가 NULL이면 NULL 리턴
-    // 4. hash_elem → struct page 변환해서 리턴
-	struct page p;
-	p.va=va; //검색할 가상주소만 스택에 저장
-
-	//임시 페이지의 hash_elem 주소를 hash_find에 전달
-	struct hash_elem *e= hash_find(&spt->pages, &p.hash_elem);
-
-	//못찾으면 널 리턴
-	if (e==NULL)
-		return NULL;
+struct page *
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page **slot = spt_slot (spt, va, false);
 
-	//찾았으면 hash_elem -> struct page 변환
-	return hash_entry(e, struct page, hash_elem);
+	return slot != NULL ? *slot : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
-bool spt_insert_page(struct supplemental_page_table *spt, struct page *page) {
-    // 1. hash_insert()로 삽입
-    // 2. 반환값이 NULL이면 성공 (기존에 없었음)
-    // 3. 반환값이 NULL 아니면 실패 (이미 존재)
+bool
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	struct page **slot = spt_slot (spt, page->va, true);
 
+	if (slot == NULL || *slot != NULL)
+		return false;
+	*slot = page;
+	spt->page_cnt++;
+	return true;
+}
 
-}
\ No newline at end of file
+void
+spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	struct page **slot = spt_slot (spt, page->va, false);
+
+	ASSERT (slot != NULL && *slot == page);
+	*slot = NULL;
+	spt->page_cnt--;
+	vm_dealloc_page (page);
+}
+
+/* Calls ACTION on each page of NODE, a node at LEVEL whose first
+ * entry covers page number BASE, whose page number lies in
+ * [FIRST, LAST], in ascending order.  Returns false if ACTION
+ * stopped the iteration. */
+static bool
+spt_walk (void **node, int level, uint64_t base, uint64_t first,
+		uint64_t last, spt_action_func *action, void *aux) {
+	int shift = (SPT_LEVELS - 1 - level) * SPT_BITS;
+	size_t i = first > base ? (first - base) >> shift : 0;
+
+	for (; i < SPT_FANOUT; i++) {
+		uint64_t entry_base = base + ((uint64_t) i << shift);
+
+		if (entry_base > last)
+			break;
+		if (node[i] == NULL)
+			continue;
+		if (level == SPT_LEVELS - 1) {
+			if (!action (node[i], aux))
+				return false;
+		} else if (!spt_walk (node[i], level + 1, entry_base, first, last,
+					action, aux))
+			return false;
+	}
+	return true;
+}
+
+/* Calls ACTION on each page of SPT in [START, END), in ascending
+ * order of address, skipping empty subtrees whole.  ACTION may
+ * remove the page it is given.  Returns false if ACTION returned
+ * false, true otherwise. */
+bool
+spt_for_each (struct supplemental_page_table *spt, void *start, void *end,
+		spt_action_func *action, void *aux) {
+	if (spt->root == NULL || end <= start)
+		return true;
+	return spt_walk (spt->root, 0, 0, pg_no (start), pg_no ((uint8_t *) end - 1),
+			action, aux);
+}
+
+static bool
+stop_at_page (struct page *page UNUSED, void *aux UNUSED) {
+	return false;
+}
+
+/* Returns true if SPT has no page in [START, END). */
+bool
+spt_range_empty (struct supplemental_page_table *spt, void *start,
+		void *end) {
+	return spt_for_each (spt, start, end, stop_at_page, NULL);
+}
+
+/* Frees the subtrees of NODE, a node at LEVEL whose first entry
+ * covers page number BASE, that overlap [FIRST, LAST] and hold no
+ * pages.  Returns true if NODE is left empty. */
+static bool
+spt_prune_node (void **node, int level, uint64_t base, uint64_t first,
+		uint64_t last) {
+	int shift = (SPT_LEVELS - 1 - level) * SPT_BITS;
+	bool empty = true;
+	size_t i;
+
+	for (i = 0; i < SPT_FANOUT; i++) {
+		uint64_t entry_base = base + ((uint64_t) i << shift);
+		uint64_t entry_last = entry_base + ((uint64_t) 1 << shift) - 1;
+
+		if (node[i] == NULL)
+			continue;
+		if (level < SPT_LEVELS - 1 && entry_base <= last && entry_last >= first
+				&& spt_prune_node (node[i], level + 1, entry_base, first, last)) {
+			palloc_free_page (node[i]);
+			node[i] = NULL;
+		} else
+			empty = false;
+	}
+	return empty;
+}
+
+/* Frees the nodes of SPT that cover part of [START, END) but no
+ * longer lead to any page.  spt_remove_page() leaves them, since
+ * it may be called from within spt_for_each(); do_munmap() calls
+ * this once it has removed a mapping's pages. */
+void
+spt_prune (struct supplemental_page_table *spt, void *start, void *end) {
+	if (spt->root == NULL || end <= start)
+		return;
+	if (spt_prune_node (spt->root, 0, 0, pg_no (start),
+				pg_no ((uint8_t *) end - 1))) {
+		palloc_free_page (spt->root);
+		spt->root = NULL;
+	}
+}
+
+/* Frees NODE, a node at LEVEL, with its subtrees and pages. */
+static void
+spt_destroy_node (void **node, int level) {
+	size_t i;
+
+	for (i = 0; i < SPT_FANOUT; i++) {
+		if (node[i] == NULL)
+			continue;
+		if (level == SPT_LEVELS - 1)
+			vm_dealloc_page (node[i]);
+		else
+			spt_destroy_node (node[i], level + 1);
+	}
+	palloc_free_page (node);
+}
+
+/* Free the resource hold by the supplemental page table */
+void
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	if (spt->root != NULL)
+		spt_destroy_node (spt->root, 0);
+	supplemental_page_table_init (spt);
+}
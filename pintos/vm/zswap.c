@@ -0,0 +1,249 @@
+/* zswap.c: A pool of compressed pages in kernel memory.
+ *
+ * Anonymous pages evicted from their frames are compressed into
+ * this pool, which sits in front of the swap disk: a fault on such
+ * a page decompresses it in memory rather than reading 8 sectors.
+ * The pool is zswap_pool_pages pages taken from the kernel pool at
+ * startup and split into CHUNK_SIZE-byte chunks; a compressed page
+ * takes as many adjacent chunks as it needs.  Entries are kept in
+ * least-recently-stored order, so that anon.c can spill the oldest
+ * ones to the swap disk when the pool fills up.
+ *
+ * The compressor is a small LZ77 variant.  Its output is a series
+ * of items, each starting with a control byte C: if C < 0x80, C +
+ * 1 literal bytes follow; otherwise the item copies (C & 0x7f) +
+ * LZ_MIN_MATCH bytes from a 16-bit little-endian distance back in
+ * the output.  A page of zeros compresses to about 100 bytes.
+ *
+ * None of this is synchronized; anon.c serializes its callers. */
+
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Allocation unit within the pool. */
+#define CHUNK_SIZE 64
+
+/* Pages that do not compress to this size or smaller go straight
+ * to the swap disk; keeping them would save too little. */
+#define MAX_COMPRESSED (PGSIZE * 3 / 4)
+
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERALS 0x80
+#define LZ_HASH_BITS 12
+
+size_t zswap_pool_pages;
+
+static uint8_t *pool;                   /* zswap_pool_pages pages. */
+static struct bitmap *used_chunks;      /* Chunks in use. */
+static struct list lru;                 /* Entries, oldest first. */
+
+/* Output of the last zswap_compress() call. */
+static uint8_t scratch[MAX_COMPRESSED];
+
+/* Most recent position + 1 of each hashed 3-byte string, or 0. */
+static uint16_t lz_hash[1 << LZ_HASH_BITS];
+
+/* Statistics. */
+static long long store_cnt;             /* Pages stored. */
+static long long store_bytes;           /* Compressed bytes stored. */
+static long long reject_cnt;            /* Pages too big compressed. */
+
+/* Allocates the pool, if the -zswap option asked for one.  Returns
+ * true if there is a pool. */
+bool
+zswap_init (void) {
+	if (zswap_pool_pages == 0)
+		return false;
+	pool = palloc_get_multiple (0, zswap_pool_pages);
+	used_chunks = bitmap_create (zswap_pool_pages * PGSIZE / CHUNK_SIZE);
+	if (pool == NULL || used_chunks == NULL) {
+		printf ("zswap: cannot allocate %zu pages, disabled\n",
+				zswap_pool_pages);
+		if (pool != NULL)
+			palloc_free_multiple (pool, zswap_pool_pages);
+		if (used_chunks != NULL)
+			bitmap_destroy (used_chunks);
+		zswap_pool_pages = 0;
+		return false;
+	}
+	list_init (&lru);
+	return true;
+}
+
+static size_t
+lz_hash_at (const uint8_t *p) {
+	uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends the CNT literal bytes at LITERALS to OUT, which holds
+ * *OUT_SIZE of MAX_COMPRESSED bytes.  Returns false if they do
+ * not fit. */
+static bool
+lz_put_literals (uint8_t *out, size_t *out_size, const uint8_t *literals,
+		size_t cnt) {
+	while (cnt > 0) {
+		size_t run = cnt < LZ_MAX_LITERALS ? cnt : LZ_MAX_LITERALS;
+
+		if (*out_size + 1 + run > MAX_COMPRESSED)
+			return false;
+		out[(*out_size)++] = run - 1;
+		memcpy (out + *out_size, literals, run);
+		*out_size += run;
+		literals += run;
+		cnt -= run;
+	}
+	return true;
+}
+
+/* Compresses the page at KVA into the scratch buffer.  Returns
+ * the compressed size, or 0 if it would exceed MAX_COMPRESSED. */
+size_t
+zswap_compress (const void *kva) {
+	const uint8_t *in = kva;
+	size_t ip = 0, lit = 0, op = 0;
+
+	memset (lz_hash, 0, sizeof lz_hash);
+	while (ip + LZ_MIN_MATCH <= PGSIZE) {
+		size_t h = lz_hash_at (in + ip);
+		size_t cand = lz_hash[h];
+		size_t len, dist;
+
+		lz_hash[h] = ip + 1;
+		if (cand == 0 || memcmp (in + cand - 1, in + ip, LZ_MIN_MATCH)) {
+			ip++;
+			continue;
+		}
+		cand--;
+		for (len = LZ_MIN_MATCH; len < LZ_MAX_MATCH && ip + len < PGSIZE
+				&& in[cand + len] == in[ip + len]; len++)
+			continue;
+
+		dist = ip - cand;
+		if (!lz_put_literals (scratch, &op, in + lit, ip - lit)
+				|| op + 3 > MAX_COMPRESSED)
+			goto reject;
+		scratch[op++] = 0x80 | (len - LZ_MIN_MATCH);
+		scratch[op++] = dist & 0xff;
+		scratch[op++] = dist >> 8;
+		ip += len;
+		lit = ip;
+	}
+	if (!lz_put_literals (scratch, &op, in + lit, PGSIZE - lit))
+		goto reject;
+	return op;
+
+reject:
+	reject_cnt++;
+	return 0;
+}
+
+/* Decompresses the SIZE bytes at IN into the page at OUT. */
+static void
+lz_decompress (const uint8_t *in, size_t size, uint8_t *out) {
+	size_t ip = 0, op = 0;
+
+	while (ip < size) {
+		uint8_t c = in[ip++];
+
+		if (c < 0x80) {
+			size_t run = c + 1;
+
+			ASSERT (ip + run <= size && op + run <= PGSIZE);
+			memcpy (out + op, in + ip, run);
+			ip += run;
+			op += run;
+		} else {
+			size_t len = (c & 0x7f) + LZ_MIN_MATCH;
+			size_t dist;
+
+			ASSERT (ip + 2 <= size);
+			dist = in[ip] | (in[ip + 1] << 8);
+			ip += 2;
+			ASSERT (dist > 0 && dist <= op && op + len <= PGSIZE);
+
+			/* Byte by byte: the source may overlap the copy. */
+			for (; len > 0; len--, op++)
+				out[op] = out[op - dist];
+		}
+	}
+	ASSERT (op == PGSIZE);
+}
+
+/* Stores the SIZE bytes of the last zswap_compress() output for
+ * PAGE.  Returns the new entry, or a null pointer if the pool has
+ * no room for it. */
+struct zswap_entry *
+zswap_store (struct page *page, size_t size) {
+	size_t chunks = DIV_ROUND_UP (size, CHUNK_SIZE);
+	struct zswap_entry *e;
+	size_t chunk;
+
+	ASSERT (size > 0 && size <= MAX_COMPRESSED);
+
+	chunk = bitmap_scan_and_flip (used_chunks, 0, chunks, false);
+	if (chunk == BITMAP_ERROR)
+		return NULL;
+	e = malloc (sizeof *e);
+	if (e == NULL) {
+		bitmap_set_multiple (used_chunks, chunk, chunks, false);
+		return NULL;
+	}
+	e->page = page;
+	e->chunk = chunk;
+	e->size = size;
+	memcpy (pool + chunk * CHUNK_SIZE, scratch, size);
+	list_push_back (&lru, &e->elem);
+
+	store_cnt++;
+	store_bytes += size;
+	return e;
+}
+
+/* Decompresses entry E into the page at KVA. */
+void
+zswap_load (const struct zswap_entry *e, void *kva) {
+	lz_decompress (pool + e->chunk * CHUNK_SIZE, e->size, kva);
+}
+
+/* Frees entry E and its chunks. */
+void
+zswap_free (struct zswap_entry *e) {
+	list_remove (&e->elem);
+	bitmap_set_multiple (used_chunks, e->chunk,
+			DIV_ROUND_UP (e->size, CHUNK_SIZE), false);
+	free (e);
+}
+
+/* Returns the entry stored longest ago, or a null pointer if the
+ * pool is empty. */
+struct zswap_entry *
+zswap_oldest (void) {
+	return list_empty (&lru) ? NULL
+		: list_entry (list_front (&lru), struct zswap_entry, elem);
+}
+
+/* Prints the pool's statistics. */
+void
+zswap_print_stats (void) {
+	size_t used;
+
+	if (pool == NULL)
+		return;
+	used = bitmap_count (used_chunks, 0, bitmap_size (used_chunks), true);
+	printf ("Compressed swap: %lld pages stored", store_cnt);
+	if (store_bytes > 0)
+		printf (" at %lld.%02lld:1", store_cnt * PGSIZE / store_bytes,
+				store_cnt * PGSIZE * 100 / store_bytes % 100);
+	printf (", %lld too big, %zu of %zu KB in use\n", reject_cnt,
+			used * CHUNK_SIZE / 1024, zswap_pool_pages * PGSIZE / 1024);
+}